@@ -0,0 +1,217 @@
+#include "benchmark/benchmark.h"
+#include "../include/tinytasks.h"
+
+using namespace tinytasks;
+
+namespace
+{
+
+//! Number of worker threads of the pools in the benchmarks
+const uint8_t kNumThreads = 8;
+
+//! Pool shared by the threads of a multi-threaded benchmark
+TinyTasksPool* sharedPool = nullptr;
+std::vector<TaskID> sharedTaskIDs;
+
+//! Latency of submitting an empty task until the calling thread sees it completed
+void BM_SubmitToCompleteLatency(benchmark::State& state)
+{
+    TinyTasksPool tinyTasksPool(static_cast<uint8_t>(state.range(0)));
+
+    //The tied tasks run on their own worker, so they're left out
+    std::vector<TaskID> tiedTaskIDs = tinyTasksPool.CreateTasks(tinyTasksPool.GetNumThreads());
+
+    for(auto _ : state)
+    {
+        TinyTasksPool::TaskHandle handle = tinyTasksPool.Submit([]{});
+        handle.Wait();
+        tinyTasksPool.ReleaseTask(handle.GetID());
+    }
+
+    for(const TaskID taskID : tiedTaskIDs) tinyTasksPool.ReleaseTask(taskID);
+}
+BENCHMARK(BM_SubmitToCompleteLatency)->Arg(2)->Arg(kNumThreads)->UseRealTime();
+
+//! Throughput of a batch of tiny tasks, for a number of threads
+void BM_TinyTasksThroughput(benchmark::State& state)
+{
+    TinyTasksPool tinyTasksPool(static_cast<uint8_t>(state.range(0)));
+    const uint32_t numTasks = static_cast<uint32_t>(state.range(1));
+    std::atomic<uint64_t> sum(0);
+
+    std::vector<std::function<void()>> lambdas(numTasks, [&sum]{ sum.fetch_add(1, std::memory_order_relaxed); });
+
+    for(auto _ : state)
+    {
+        std::vector<TinyTasksPool::TaskHandle> handles = tinyTasksPool.SubmitBatch(lambdas.begin(), lambdas.end());
+        tinyTasksPool.WaitAll();
+
+        for(const auto& handle : handles) tinyTasksPool.ReleaseTask(handle.GetID());
+    }
+
+    state.SetItemsProcessed(state.iterations() * numTasks);
+    benchmark::DoNotOptimize(sum.load());
+}
+BENCHMARK(BM_TinyTasksThroughput)->ArgsProduct({ { 1, 2, 4, kNumThreads, 16 }, { 1000, 10000 } })->UseRealTime();
+
+//! Cost of looking up tasks and their status, from many threads at once
+void BM_GetTaskLookup(benchmark::State& state)
+{
+    if(state.thread_index() == 0)
+    {
+        sharedPool = new TinyTasksPool(kNumThreads);
+        sharedTaskIDs = sharedPool->CreateTasks(1000);
+    }
+
+    size_t taskIndex = static_cast<size_t>(state.thread_index());
+
+    for(auto _ : state)
+    {
+        const TaskID taskID = sharedTaskIDs[taskIndex % sharedTaskIDs.size()];
+        benchmark::DoNotOptimize(sharedPool->GetTask(taskID));
+        benchmark::DoNotOptimize(sharedPool->GetTaskStatus(taskID));
+        taskIndex += 7;
+    }
+
+    state.SetItemsProcessed(state.iterations());
+
+    if(state.thread_index() == 0)
+    {
+        delete sharedPool;
+        sharedPool = nullptr;
+        sharedTaskIDs.clear();
+    }
+}
+BENCHMARK(BM_GetTaskLookup)->ThreadRange(1, 8)->UseRealTime();
+
+//! Round trip of resuming a task that pauses itself, until it's paused again
+void BM_PauseResumeRoundTrip(benchmark::State& state)
+{
+    TinyTasksPool tinyTasksPool(2);
+
+    const TaskID taskID = tinyTasksPool.CreateTask();
+    TinyTask* task = tinyTasksPool.GetTask(taskID);
+    std::atomic<bool> isDone(false);
+
+    tinyTasksPool.SetNewLambdaForTask(taskID, [task, &isDone]
+    {
+        while(!isDone)
+        {
+            task->Pause();
+            task->PauseIfNeeded();
+        }
+    });
+
+    for(auto _ : state)
+    {
+        task->WaitForStatus(TinyTask::Status::PAUSED);
+        task->Resume();
+    }
+
+    task->WaitForStatus(TinyTask::Status::PAUSED);
+    isDone = true;
+    task->Resume();
+    tinyTasksPool.Wait(taskID);
+}
+BENCHMARK(BM_PauseResumeRoundTrip)->UseRealTime();
+
+//! Progress updates of running tasks while another thread monitors their
+//! status. The benchmarks_packed target builds it with the state of the
+//! tasks packed in the same cache lines, to compare
+void BM_ProgressUpdatesWhileMonitored(benchmark::State& state)
+{
+    const uint8_t numTasks = static_cast<uint8_t>(state.range(0));
+    const uint32_t numUpdates = 100000;
+    
+    TinyTasksPool tinyTasksPool(numTasks);
+    std::vector<TaskID> taskIDs = tinyTasksPool.CreateTasks(numTasks);
+    std::vector<TinyTask*> tasks;
+    for(const TaskID taskID : taskIDs) tasks.push_back(tinyTasksPool.GetTask(taskID));
+    
+    for(auto _ : state)
+    {
+        std::atomic<uint32_t> numFinishedTasks(0);
+        
+        for(TinyTask* task : tasks)
+        {
+            tinyTasksPool.SetNewLambdaForTask(task->GetID(), [task, &numFinishedTasks]
+            {
+                for(uint32_t update = 0; update < numUpdates; ++update) task->SetProgress(static_cast<float>(update));
+                numFinishedTasks++;
+            });
+        }
+        
+        while(numFinishedTasks < numTasks)
+        {
+            for(const TinyTask* task : tasks) benchmark::DoNotOptimize(task->GetStatus());
+        }
+        
+        tinyTasksPool.WaitAll();
+    }
+    
+    state.SetItemsProcessed(state.iterations() * numTasks * numUpdates);
+    
+    for(const TaskID taskID : taskIDs) tinyTasksPool.ReleaseTask(taskID);
+}
+BENCHMARK(BM_ProgressUpdatesWhileMonitored)->Arg(2)->Arg(4)->UseRealTime();
+
+//! Time to queue a number of tasks and drain them with RunPendingTasks()
+void BM_RunPendingTasksDrain(benchmark::State& state)
+{
+    TinyTasksPool tinyTasksPool(kNumThreads);
+    const uint32_t numTasks = static_cast<uint32_t>(state.range(0));
+
+    //The tied tasks aren't queued, so they're left out
+    std::vector<TaskID> tiedTaskIDs = tinyTasksPool.CreateTasks(tinyTasksPool.GetNumThreads());
+
+    for(auto _ : state)
+    {
+        std::vector<TaskID> taskIDs = tinyTasksPool.CreateTasks(numTasks);
+
+        for(const TaskID taskID : taskIDs) tinyTasksPool.SetNewLambdaForTask(taskID, []{});
+        tinyTasksPool.RunPendingTasks();
+        tinyTasksPool.WaitAll();
+
+        for(const TaskID taskID : taskIDs) tinyTasksPool.ReleaseTask(taskID);
+    }
+
+    state.SetItemsProcessed(state.iterations() * numTasks);
+
+    for(const TaskID taskID : tiedTaskIDs) tinyTasksPool.ReleaseTask(taskID);
+}
+BENCHMARK(BM_RunPendingTasksDrain)->Arg(100)->Arg(10000)->UseRealTime();
+
+//! Throughput of submitting tiny tasks from many threads of outside the pool at once
+void BM_SubmitFromExternalThreads(benchmark::State& state)
+{
+    if(state.thread_index() == 0)
+    {
+        sharedPool = new TinyTasksPool(kNumThreads);
+        
+        //The tied tasks aren't queued, so they're left out. The capacity
+        //keeps the producers from running out of task IDs
+        sharedTaskIDs = sharedPool->CreateTasks(sharedPool->GetNumThreads());
+        sharedPool->SetQueueCapacity(constants::kInjectionQueueCapacity, TinyTasksPool::OverflowPolicy::BLOCK);
+    }
+
+    for(auto _ : state)
+    {
+        sharedPool->ReleaseTask(sharedPool->Submit([]{}).GetID());
+    }
+
+    state.SetItemsProcessed(state.iterations());
+
+    if(state.thread_index() == 0)
+    {
+        sharedPool->WaitAll();
+        for(const TaskID taskID : sharedTaskIDs) sharedPool->ReleaseTask(taskID);
+        delete sharedPool;
+        sharedPool = nullptr;
+        sharedTaskIDs.clear();
+    }
+}
+BENCHMARK(BM_SubmitFromExternalThreads)->ThreadRange(1, 8)->UseRealTime();
+
+} // namespace
+
+BENCHMARK_MAIN();
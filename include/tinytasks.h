@@ -37,28 +37,131 @@
 #include <memory>
 #include <string>
 #include <vector>
-#include <map>
 #include <queue>
+#include <deque>
+#include <unordered_map>
 #include <atomic>
 #include <mutex>
+#include <condition_variable>
 #include <thread>
 #include <chrono>
 #include <functional>
+#include <algorithm>
+#include <type_traits>
+#include <utility>
+#include <iterator>
+#include <new>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <ostream>
 #include <string.h>
 
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#define TINYTASKS_HAS_THREAD_AFFINITY 1
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/uio.h>
+#include <unistd.h>
+#include <limits.h>
+#include <errno.h>
+#define TINYTASKS_HAS_WRITEV 1
+#endif
+
 #define TINYTASKS_VERSION_MAJOR 1
 #define TINYTASKS_VERSION_MINOR 0
 #define TINYTASKS_VERSION_PATCH 0
 
+//! Size in bytes of the inline storage of the task functions. Callables
+//! that don't fit in it are allocated in the heap
+#ifndef TINYTASKS_TASK_FUNCTION_CAPACITY
+#define TINYTASKS_TASK_FUNCTION_CAPACITY 64
+#endif
+
+//! Size in bytes of the cache lines. The state of the tasks that is
+//! written by the running lambda is kept in a separate cache line from the
+//! state that other threads read, so they don't invalidate each other's
+//! lines. It's 64 by default, the value of
+//! std::hardware_destructive_interference_size on x86-64 (which needs
+//! C++17, and isn't meant for layouts in headers)
+#ifndef TINYTASKS_CACHE_LINE_SIZE
+#define TINYTASKS_CACHE_LINE_SIZE 64
+#endif
+
+//! Measures the queue wait and the run time of the tasks in the pool. It
+//! costs two reads of the clock per run, so it can be disabled by defining
+//! the macro as 0 (the counters of runs are kept)
+#ifndef TINYTASKS_ENABLE_METRICS
+#define TINYTASKS_ENABLE_METRICS 1
+#endif
+
+//! Records the events of the tasks in the TaskTracer, to follow them in a
+//! timeline. It's disabled by default, and then the events are compiled out
+#ifndef TINYTASKS_ENABLE_TRACING
+#define TINYTASKS_ENABLE_TRACING 0
+#endif
+
+//! Number of events kept per thread by the TaskTracer (a power of two).
+//! Once full, the oldest events are overwritten
+#ifndef TINYTASKS_TRACE_BUFFER_CAPACITY
+#define TINYTASKS_TRACE_BUFFER_CAPACITY 8192
+#endif
+
+//! Enables the coroutine layer (CoTask, TinyTasksPool::Schedule() and
+//! Delay()), which needs C++20. It's disabled by default, and the rest of
+//! the library only needs C++11
+#ifndef TINYTASKS_ENABLE_COROUTINES
+#define TINYTASKS_ENABLE_COROUTINES 0
+#endif
+
+#if TINYTASKS_ENABLE_COROUTINES
+#if !defined(__cpp_impl_coroutine)
+#error "TINYTASKS_ENABLE_COROUTINES needs a compiler with C++20 coroutines"
+#endif
+#include <coroutine>
+#include <optional>
+#endif
+
+#if TINYTASKS_ENABLE_TRACING
+#define TINYTASKS_TRACE(event, taskID) ::tinytasks::TaskTracer::Get().Record(::tinytasks::TaskTracer::event, taskID)
+#else
+#define TINYTASKS_TRACE(event, taskID) ((void)0)
+#endif
+
 namespace tinytasks
 {
 
+//! @brief Task identifier. In the TinyTasksPool class, the lower bits hold
+//! the index of the task in the pool and the upper bits its generation
+typedef uint32_t TaskID;
+
+//! @brief Timer identifier, in the order the timers are created (0 is
+//! never used)
+typedef uint64_t TimerID;
+
 //! @brief Local constants (used mainly in the TinyTasksPool class)
 namespace constants
 {
     static const uint8_t  kMaxNumThreadsInPool  = UINT8_MAX;
     static const uint8_t  kMinNumThreadsInPool  = 2;
     static const uint16_t kMaxNumTasksInPool    = UINT16_MAX;
+    static const uint32_t kNumTaskIndexBits     = 16;
+    static const uint32_t kTaskIndexMask        = (1u << kNumTaskIndexBits) - 1;
+    static const TaskID   kInvalidTaskID        = UINT32_MAX;
+    static const uint32_t kWorkerQueueCapacity  = 1024;
+    static const uint32_t kInjectionQueueCapacity = 4096;
+    static const uint32_t kDefaultScratchArenaSize = 64 * 1024;
+    static const uint32_t kNumTasksPerPage      = 256;
+    static const uint32_t kNumTaskPages         = (kMaxNumTasksInPool + kNumTasksPerPage) / kNumTasksPerPage;
+    static const uint32_t kNormalPriorityDelay  = 100;
+    static const uint32_t kLowPriorityDelay     = 1000;
+    static const uint8_t  kAnyNode              = UINT8_MAX;
+    static const uint32_t kMaxNumNumaNodes      = 64;
 }
 
 //! @brief Gets the current library version
@@ -92,6 +195,500 @@ protected:
     NonCopyableMovable& operator=(NonCopyableMovable&&)      = delete;
 };
 
+//! @brief Base class for the types aligned to cache lines, so they're
+//! aligned when allocated with new (before C++17, new only aligns to
+//! alignof(std::max_align_t))
+class CacheLineAligned
+{
+public:
+    static void* operator new(std::size_t size)     { return Allocate(size); }
+    static void* operator new[](std::size_t size)   { return Allocate(size); }
+    static void  operator delete(void* pointer)     { Deallocate(pointer); }
+    static void  operator delete[](void* pointer)   { Deallocate(pointer); }
+    
+private:
+    //! Allocates an aligned block, keeping the address of the whole
+    //! allocation right before it
+    static void* Allocate(const std::size_t size)
+    {
+        const std::size_t alignment = TINYTASKS_CACHE_LINE_SIZE;
+        static_assert((alignment & (alignment - 1)) == 0, "The cache line size has to be a power of two");
+        
+        void* allocation = ::operator new(size + sizeof(void*) + alignment - 1);
+        const std::uintptr_t address = (reinterpret_cast<std::uintptr_t>(allocation) + sizeof(void*) + alignment - 1) & ~(alignment - 1);
+        
+        void* block = reinterpret_cast<void*>(address);
+        static_cast<void**>(block)[-1] = allocation;
+        
+        return block;
+    }
+    
+    static void Deallocate(void* block)
+    {
+        if(block) ::operator delete(static_cast<void**>(block)[-1]);
+    }
+};
+
+//! @brief Move-only callable with no arguments, run by the tasks
+//!
+//! @details
+//! It replaces std::function<void()> in the tasks, so setting a lambda
+//! doesn't allocate: callables up to TINYTASKS_TASK_FUNCTION_CAPACITY
+//! bytes (that can be moved without throwing) are stored inline, and only
+//! bigger ones are allocated in the heap. As it's move-only, callables
+//! that can't be copied (e.g. holding a std::unique_ptr) are supported.
+//!
+class TaskFunction
+{
+public:
+    //! Initialize an empty function
+    TaskFunction() : m_operations(nullptr) {}
+    
+    //! Initialize an empty function
+    TaskFunction(std::nullptr_t) : m_operations(nullptr) {}
+    
+    //! Initialize the function with a callable
+    //! @param callable to move or copy into the function
+    template<typename Function, typename = typename std::enable_if<
+             !std::is_same<typename std::decay<Function>::type, TaskFunction>::value>::type>
+    TaskFunction(Function&& function) : m_operations(nullptr)
+    {
+        Assign(std::forward<Function>(function));
+    }
+    
+    //! Initialize the function by taking the callable of another one
+    TaskFunction(TaskFunction&& other) : m_operations(nullptr)
+    {
+        MoveFrom(other);
+    }
+    
+    //! Takes the callable of another function
+    TaskFunction& operator=(TaskFunction&& other)
+    {
+        if(this != &other)
+        {
+            Reset();
+            MoveFrom(other);
+        }
+        
+        return *this;
+    }
+    
+    //! Empties the function
+    TaskFunction& operator=(std::nullptr_t)
+    {
+        Reset();
+        return *this;
+    }
+    
+    TaskFunction(const TaskFunction&)               = delete;
+    TaskFunction& operator=(const TaskFunction&)    = delete;
+    
+    //! Destroys the function, and its callable
+    ~TaskFunction() { Reset(); }
+    
+    //! Replaces the callable, constructing the new one in place
+    //! @param callable to move or copy into the function
+    template<typename Function>
+    void Assign(Function&& function)
+    {
+        typedef typename std::decay<Function>::type Callable;
+        
+        Reset();
+        if(IsEmpty(function)) return;
+        
+        Construct<Callable>(std::forward<Function>(function), std::integral_constant<bool, IsStoredInline<Callable>()>());
+    }
+    
+    //! Empties the function
+    void Assign(std::nullptr_t) { Reset(); }
+    
+    //! Runs the callable (the function can't be empty)
+    void operator()()
+    {
+        assert(m_operations && "Can't run an empty task function");
+        m_operations->invoke(&m_storage);
+    }
+    
+    //! Gets if the function holds a callable
+    explicit operator bool() const { return m_operations != nullptr; }
+    
+    //! Destroys the callable, leaving the function empty
+    void Reset()
+    {
+        if(m_operations == nullptr) return;
+        
+        m_operations->destroy(&m_storage);
+        m_operations = nullptr;
+    }
+    
+    //! Gets if a type of callable is stored inline (without allocating)
+    template<typename Callable>
+    static constexpr bool IsStoredInline()
+    {
+        return sizeof(Callable) <= sizeof(Storage) && alignof(Callable) <= alignof(Storage) &&
+               std::is_nothrow_move_constructible<Callable>::value;
+    }
+
+private:
+    typedef typename std::aligned_storage<TINYTASKS_TASK_FUNCTION_CAPACITY, alignof(std::max_align_t)>::type Storage;
+    
+    //! Type-erased operations on the stored callable
+    struct Operations
+    {
+        void (*invoke)(void* storage);
+        void (*move)(void* destination, void* source);
+        void (*destroy)(void* storage);
+    };
+    
+    //! Operations on a callable stored inline
+    template<typename Callable>
+    struct InlineOperations
+    {
+        static void Invoke(void* storage)   { (*static_cast<Callable*>(storage))(); }
+        static void Destroy(void* storage)  { static_cast<Callable*>(storage)->~Callable(); }
+        
+        static void Move(void* destination, void* source)
+        {
+            new(destination) Callable(std::move(*static_cast<Callable*>(source)));
+            static_cast<Callable*>(source)->~Callable();
+        }
+        
+        static const Operations* Get()
+        {
+            static const Operations operations = { &Invoke, &Move, &Destroy };
+            return &operations;
+        }
+    };
+    
+    //! Operations on a callable allocated in the heap (the storage holds
+    //! a pointer to it)
+    template<typename Callable>
+    struct HeapOperations
+    {
+        static Callable*& Pointer(void* storage)    { return *static_cast<Callable**>(storage); }
+        
+        static void Invoke(void* storage)   { (*Pointer(storage))(); }
+        static void Destroy(void* storage)  { delete Pointer(storage); }
+        
+        static void Move(void* destination, void* source)
+        {
+            new(destination) Callable*(Pointer(source));
+        }
+        
+        static const Operations* Get()
+        {
+            static const Operations operations = { &Invoke, &Move, &Destroy };
+            return &operations;
+        }
+    };
+    
+    //! Gets if a callable is empty (e.g. a null function pointer)
+    template<typename Function>
+    static bool IsEmpty(const Function&)                        { return false; }
+    template<typename Signature>
+    static bool IsEmpty(const std::function<Signature>& function) { return !function; }
+    template<typename Result>
+    static bool IsEmpty(Result (*function)())                   { return function == nullptr; }
+    
+    //! Constructs a callable inline
+    template<typename Callable, typename Function>
+    void Construct(Function&& function, std::true_type)
+    {
+        new(&m_storage) Callable(std::forward<Function>(function));
+        m_operations = InlineOperations<Callable>::Get();
+    }
+    
+    //! Constructs a callable in the heap
+    template<typename Callable, typename Function>
+    void Construct(Function&& function, std::false_type)
+    {
+        new(&m_storage) Callable*(new Callable(std::forward<Function>(function)));
+        m_operations = HeapOperations<Callable>::Get();
+    }
+    
+    //! Takes the callable of another function, leaving it empty
+    void MoveFrom(TaskFunction& other)
+    {
+        if(other.m_operations == nullptr) return;
+        
+        other.m_operations->move(&m_storage, &other.m_storage);
+        m_operations = other.m_operations;
+        other.m_operations = nullptr;
+    }
+    
+    Storage             m_storage;
+    const Operations*   m_operations;
+};
+
+//! @brief Records timestamped events of the tasks, to dump them as a trace
+//!
+//! @details
+//! Each thread records its events in its own ring buffer, without locking.
+//! Only the thread writes to its buffer, and the readers check a sequence
+//! number per event, so the events can be read while they're recorded. The
+//! trace can be written in the Chrome trace format (JSON), to be opened in
+//! chrome://tracing or Perfetto: there is a track per thread, with the runs
+//! of the tasks and the time they're paused.
+//! The events are recorded with the TINYTASKS_TRACE macro, which is compiled
+//! out unless TINYTASKS_ENABLE_TRACING is 1.
+//!
+//! @note The buffers are kept until the end of the process, even if their
+//! threads finish, so that their events can be dumped
+//!
+class TaskTracer : public NonCopyableMovable
+{
+public:
+    //! Events of a task
+    enum Event : uint8_t
+    {
+        CREATED,
+        SCHEDULED,
+        DEQUEUED,
+        RUN_START,
+        PAUSE,
+        RESUME,
+        STOP,
+        COMPLETE,
+        NUM_EVENTS,
+    };
+    
+    //! @brief Event recorded by a thread
+    struct EventRecord
+    {
+        //! Nanoseconds since the tracer was created
+        int64_t     time;
+        TaskID      taskID;
+        Event       event;
+        //! Index of the thread that recorded the event
+        uint32_t    threadIndex;
+    };
+    
+    //! Gets the tracer of the process
+    static TaskTracer& Get()
+    {
+        static TaskTracer tracer;
+        return tracer;
+    }
+    
+    //! Records an event of a task in the buffer of the calling thread
+    void Record(const Event event, const TaskID taskID)
+    {
+        Buffer* buffer = GetCurrentBuffer();
+        const int64_t time = (std::chrono::steady_clock::now() - m_startTime).count();
+        const uint64_t data = (static_cast<uint64_t>(taskID) << 8) | event;
+        
+        const uint64_t index = buffer->numEvents.load(std::memory_order_relaxed);
+        Slot& slot = buffer->slots[index & (kBufferCapacity - 1)];
+        
+        //The sequence is odd while the slot is written
+        slot.sequence.store(2 * index + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        slot.time.store(time, std::memory_order_relaxed);
+        slot.data.store(data, std::memory_order_relaxed);
+        slot.sequence.store(2 * index + 2, std::memory_order_release);
+        
+        buffer->numEvents.store(index + 1, std::memory_order_release);
+    }
+    
+    //! Sets the name of the calling thread in the trace
+    void SetThreadName(const std::string& name)
+    {
+        Buffer* buffer = GetCurrentBuffer();
+        
+        std::lock_guard<std::mutex> lock(m_buffersMutex);
+        buffer->name = name;
+    }
+    
+    //! Gets the events in the buffers, in the order of each thread
+    std::vector<EventRecord> GetRecords() const
+    {
+        std::vector<EventRecord> records;
+        std::lock_guard<std::mutex> lock(m_buffersMutex);
+        
+        for(const auto& buffer : m_buffers)
+        {
+            const uint64_t numEvents = buffer->numEvents.load(std::memory_order_acquire);
+            const uint64_t firstIndex = std::max(buffer->firstIndex.load(std::memory_order_relaxed),
+                                                 numEvents > kBufferCapacity ? numEvents - kBufferCapacity : 0);
+            
+            for(uint64_t index = firstIndex; index < numEvents; ++index)
+            {
+                const Slot& slot = buffer->slots[index & (kBufferCapacity - 1)];
+                
+                const uint64_t sequence = slot.sequence.load(std::memory_order_acquire);
+                const int64_t time = slot.time.load(std::memory_order_relaxed);
+                const uint64_t data = slot.data.load(std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_acquire);
+                
+                //Overwritten meanwhile
+                if(sequence != 2 * index + 2 || slot.sequence.load(std::memory_order_relaxed) != sequence) continue;
+                
+                EventRecord record = { time, static_cast<TaskID>(data >> 8), static_cast<Event>(data & 0xFF), buffer->index };
+                records.push_back(record);
+            }
+        }
+        
+        return records;
+    }
+    
+    //! Discards the events recorded so far
+    void Clear()
+    {
+        std::lock_guard<std::mutex> lock(m_buffersMutex);
+        
+        for(auto& buffer : m_buffers)
+        {
+            buffer->firstIndex.store(buffer->numEvents.load(std::memory_order_acquire), std::memory_order_relaxed);
+        }
+    }
+    
+    //! Writes the events in the Chrome trace format (JSON)
+    void WriteChromeTrace(std::ostream& stream) const
+    {
+        static const char* kEventNames[NUM_EVENTS] =
+        {
+            "Created", "Scheduled", "Dequeued", "Run", "Paused", "Resumed", "Stop", "Complete"
+        };
+        
+        const std::vector<EventRecord> records = GetRecords();
+        bool isFirstEvent = true;
+        
+        stream << "{\"traceEvents\":[";
+        
+        {
+            std::lock_guard<std::mutex> lock(m_buffersMutex);
+            
+            for(const auto& buffer : m_buffers)
+            {
+                const std::string name = buffer->name.empty() ? "Thread " + std::to_string(buffer->index) : buffer->name;
+                stream << (isFirstEvent ? "" : ",") << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":"
+                       << buffer->index << ",\"args\":{\"name\":\"" << EscapeJSON(name) << "\"}}";
+                isFirstEvent = false;
+            }
+        }
+        
+        //Runs and pauses are slices, and the rest are instant events. Slices
+        //that started before the oldest event in a buffer are left out
+        std::vector<uint32_t> numOpenSlices;
+        
+        for(const EventRecord& record : records)
+        {
+            if(record.threadIndex >= numOpenSlices.size()) numOpenSlices.resize(record.threadIndex + 1, 0);
+            uint32_t& numThreadSlices = numOpenSlices[record.threadIndex];
+            
+            const char* phase = "i";
+            if(record.event == RUN_START || record.event == PAUSE)
+            {
+                phase = "B";
+                numThreadSlices++;
+            }
+            else if(record.event == COMPLETE || record.event == RESUME)
+            {
+                if(numThreadSlices == 0) continue;
+                phase = "E";
+                numThreadSlices--;
+            }
+            
+            const char* name = record.event == RUN_START ? "Task" : kEventNames[record.event];
+            
+            stream << (isFirstEvent ? "" : ",") << "\n{\"name\":\"" << name << "\",\"cat\":\"tinytasks\",\"ph\":\""
+                   << phase << "\",\"ts\":" << record.time / 1000 << "." << Pad3(record.time % 1000)
+                   << ",\"pid\":1,\"tid\":" << record.threadIndex;
+            if(phase[0] == 'i') stream << ",\"s\":\"t\"";
+            stream << ",\"args\":{\"task\":" << record.taskID << "}}";
+            isFirstEvent = false;
+        }
+        
+        stream << "\n]}\n";
+    }
+    
+    //! Writes the events in the Chrome trace format (JSON) to a file
+    //! @return false if the file couldn't be written
+    bool WriteChromeTrace(const std::string& fileName) const
+    {
+        std::ofstream file(fileName.c_str());
+        if(!file) return false;
+        
+        WriteChromeTrace(file);
+        return static_cast<bool>(file);
+    }
+    
+private:
+    static const uint64_t kBufferCapacity = TINYTASKS_TRACE_BUFFER_CAPACITY;
+    static_assert(kBufferCapacity > 0 && (kBufferCapacity & (kBufferCapacity - 1)) == 0,
+                  "The capacity of the trace buffers has to be a power of two");
+    
+    //! Event in a buffer. The sequence number is 2 * (index + 1) once the
+    //! event with that index is written
+    struct Slot
+    {
+        std::atomic<uint64_t>   sequence;
+        std::atomic<int64_t>    time;
+        std::atomic<uint64_t>   data;
+    };
+    
+    //! Ring buffer of the events of a thread
+    struct Buffer
+    {
+        explicit Buffer(const uint32_t bufferIndex)
+                : index(bufferIndex), numEvents(0), firstIndex(0), slots(new Slot[kBufferCapacity])
+        {
+            for(uint64_t slotIndex = 0; slotIndex < kBufferCapacity; ++slotIndex)
+            {
+                slots[slotIndex].sequence.store(0, std::memory_order_relaxed);
+            }
+        }
+        
+        const uint32_t              index;
+        std::string                 name;
+        std::atomic<uint64_t>       numEvents;
+        std::atomic<uint64_t>       firstIndex;
+        std::unique_ptr<Slot[]>     slots;
+    };
+    
+    explicit TaskTracer() : m_startTime(std::chrono::steady_clock::now()) {}
+    
+    //! Gets the buffer of the calling thread, and allocates it the first time
+    Buffer* GetCurrentBuffer()
+    {
+        static thread_local Buffer* currentBuffer = nullptr;
+        if(currentBuffer) return currentBuffer;
+        
+        std::lock_guard<std::mutex> lock(m_buffersMutex);
+        m_buffers.push_back(std::unique_ptr<Buffer>(new Buffer(static_cast<uint32_t>(m_buffers.size()))));
+        currentBuffer = m_buffers.back().get();
+        
+        return currentBuffer;
+    }
+    
+    //! Formats the fractional digits of a timestamp in microseconds
+    static std::string Pad3(const int64_t value)
+    {
+        char digits[8];
+        snprintf(digits, sizeof(digits), "%03d", static_cast<int>(value % 1000));
+        return digits;
+    }
+    
+    //! Escapes a string to be written in JSON
+    static std::string EscapeJSON(const std::string& text)
+    {
+        std::string escapedText;
+        
+        for(const char character : text)
+        {
+            if(character == '"' || character == '\\') escapedText += '\\';
+            if(static_cast<unsigned char>(character) >= 0x20) escapedText += character;
+        }
+        
+        return escapedText;
+    }
+    
+    const std::chrono::steady_clock::time_point     m_startTime;
+    mutable std::mutex                              m_buffersMutex;
+    std::vector<std::unique_ptr<Buffer>>            m_buffers;
+};
+
 //! @brief Models a task (minimal unit to be run asynchronously)
 //!
 //! @details
@@ -101,22 +698,24 @@ protected:
 //! @note This class doesn't handle any threads. So potentially any other
 //! threading API could be used to manage TinyTask objects
 //!
-class TinyTask : public NonCopyableMovable
+class TinyTask : public NonCopyableMovable, public CacheLineAligned
 {
 public:
     //! Initialize the task
     //! @param lambda function tied to the task
     //! @param ID for the task
-    TinyTask(std::function<void()> taskLambda, const uint16_t id)
-            : m_status(Status::PAUSED), m_lambda(taskLambda), m_ID(id), m_progress(0.0f), m_isStopping(false)
+    TinyTask(TaskFunction taskLambda, const TaskID id)
+            : m_status(Status::PAUSED), m_isStopping(false), m_numStatusWaiters(0), m_ID(id), m_progress(0.0f),
+              m_lambda(std::move(taskLambda))
     {
         assert(m_lambda && "Task requires a valid (non-nullptr) lambda");
     }
     
     //! Initialize the task
     //! @param ID for the task
-    TinyTask(const uint16_t id)
-            : m_status(Status::PAUSED), m_lambda(nullptr), m_ID(id), m_progress(0.0f), m_isStopping(false)
+    TinyTask(const TaskID id)
+            : m_status(Status::PAUSED), m_isStopping(false), m_numStatusWaiters(0), m_ID(id), m_progress(0.0f),
+              m_lambda(nullptr)
     {
     }
 
@@ -126,53 +725,73 @@ public:
     //! Run function for the task. This should be called by a thread
     void Run()
     {
-        m_status = Status::RUNNING;
+        SetStatus(Status::RUNNING);
+        TINYTASKS_TRACE(RUN_START, m_ID);
 
         assert(m_lambda && "Task requires a valid (non-nullptr) lambda");
         m_lambda();
         
+        TINYTASKS_TRACE(COMPLETE, m_ID);
+        
         if(IsStopping())
         {
             m_isStopping = false;
-            m_status = Status::STOPPED;
+            SetStatus(Status::STOPPED);
             return;
         }
 
-        m_status = Status::COMPLETED;
+        SetStatus(Status::COMPLETED);
     }
 
     //! Sets the state of the task to paused
     void Pause()
     {
         assert(m_status == Status::RUNNING && "Can't pause task as its state has changed");
-        m_status = Status::PAUSED;
+        SetStatus(Status::PAUSED);
     }
     
-    //! Sets the state of the task to running
+    //! Sets the state of the task to running, and wakes up the task if
+    //! it's blocked in PauseIfNeeded()
     void Resume()
     {
         assert(m_status == Status::PAUSED && "Can't resume task as its state has changed");
-        m_status = Status::RUNNING;
+        SetStatus(Status::RUNNING);
     }
 
     //! Sets the state of the task to stopping (after resuming it)
     void Stop()
     {
         assert((m_status == Status::RUNNING || m_status == Status::PAUSED) && "Can't stop task as its state has changed");
-
-        if(IsPaused()) Resume();
-        m_isStopping = true;
+        RequestStop();
     }
 
-    //! Sleeps the current thread if the task is paused
+    //! Blocks the current thread while the task is paused, until it's
+    //! resumed or stopped
     //! @note This function should be called often in the task lambda
     //! in order to support pausing the task
+    void PauseIfNeeded()
+    {
+        if(!IsPaused()) return;
+        
+        TINYTASKS_TRACE(PAUSE, m_ID);
+        WaitUntil([this]{ return !IsPaused(); });
+        TINYTASKS_TRACE(RESUME, m_ID);
+    }
+    
+    //! Sleeps the current thread if the task is paused, checking again
+    //! every given milliseconds
+    //! @note Kept for compatibility. PauseIfNeeded() wakes up as soon as
+    //! the task is resumed
     void PauseIfNeeded(const unsigned int milliseconds) const
     {
+        if(!IsPaused()) return;
+        
+        TINYTASKS_TRACE(PAUSE, m_ID);
         while(IsPaused())
         {
             std::this_thread::sleep_for(std::chrono::milliseconds(milliseconds));
         }
+        TINYTASKS_TRACE(RESUME, m_ID);
     }
 
     //! Possible states of the task
@@ -184,8 +803,26 @@ public:
         COMPLETED,
     };
     
+    //! Blocks the current thread until the task reaches a status, or
+    //! until it has completed or stopped
+    //! @param status to wait for
+    void WaitForStatus(const Status status)
+    {
+        WaitUntil([this, status]{ return m_status == status || HasCompleted() || HasStopped(); });
+    }
+    
+    //! Blocks the current thread until the task reaches a status, it has
+    //! completed or stopped, or the timeout expires
+    //! @param status to wait for
+    //! @param maximum time to wait
+    //! @return false if the timeout expired
+    bool WaitForStatus(const Status status, const std::chrono::milliseconds timeout)
+    {
+        return WaitUntil([this, status]{ return m_status == status || HasCompleted() || HasStopped(); }, timeout);
+    }
+    
     //! Gets this task ID
-    uint16_t GetID()    const { return m_ID; }
+    TaskID GetID()      const { return m_ID; }
     //! Gets this task status
     Status GetStatus()  const { return m_status; }
     
@@ -208,282 +845,5380 @@ public:
     float GetProgress() const               { return m_progress; }
 
     //! Sets the lambda that is tied to the task (e.g. run from a thread)
-    void SetLambda(std::function<void()> newLambda) { assert(newLambda); m_lambda = std::move(newLambda); }
+    //! @note The lambda is forwarded into the task, so passing an rvalue
+    //! doesn't copy it
+    template<typename Function>
+    void SetLambda(Function&& newLambda)
+    {
+        m_lambda.Assign(std::forward<Function>(newLambda));
+        assert(m_lambda && "Task requires a valid (non-nullptr) lambda");
+    }
 
 private:
-    std::atomic<Status>     m_status;
-    std::function<void()>   m_lambda;
-    uint16_t                m_ID;
-    std::atomic<float>      m_progress;
-    std::atomic<bool>       m_isStopping;
-};
-
-//! @brief Implements a thread pool for handling tasks
-//!
-//! @details
-//! To use this class, just instantiate an object of it and be sure to
-//! specify the number of desired worker threads in the constructor if
-//! you want to limit them in your application.
-//! Once you create tasks, the IDs are stored in the pool object and
-//! aren't recycled for new tasks. Have this into account in order to
-//! drive the logic of your application.
-//! Beware that the call to GetTask(taskID) returns a pointer to the task
-//! that is owned by the pool. If you delete the pointer it will lead
-//! to trouble. This probably needs a workaround in order to prevent it.
-//! If the number of tasks created exceeds the number of threads, the
-//! tasks are queued (with a "paused" state"), so if you want to run
-//! them you have to call the member function RunPendingTasks().
-//!
-//! @note This class handles std::thread objects. Any other threading API
-//! could potentially be used, but it will require some rework
-//!
-class TinyTasksPool : public NonCopyableMovable
-{
-public:
-    //! Possible results for the pool operations
-    enum Result
+    friend class TinyTasksPool;
+    
+    //! Sets the task to stopping, whatever its state (the pool can't know
+    //! if a task is about to start or finish)
+    void RequestStop()
     {
-        SUCCEEDED,
-        SUCCEEDED_AT_QUEUE,
-        TASK_NOT_FOUND,
-    };
-    
-    //! Initialize the pool with default values
-    explicit TinyTasksPool() : m_numThreads(constants::kMinNumThreadsInPool), m_nextFreeTaskId(0)
-    {
-        m_threadsTasks.reserve(m_numThreads);
-        InitThreads();
-        InitThreadsTasks();
+        m_isStopping = true;
+        TINYTASKS_TRACE(STOP, m_ID);
+        
+        //A paused task is resumed, so it can see that it's stopping
+        Status pausedStatus = Status::PAUSED;
+        if(m_status.compare_exchange_strong(pausedStatus, Status::RUNNING)) NotifyStatusChange();
     }
-
-    //! Initialize the pool
-    //! @param number of worker threads in the pool
-    TinyTasksPool(uint8_t numThreads) : m_numThreads(numThreads), m_nextFreeTaskId(0)
+    
+    //! Resets the task to its initial state, to be reused with a new ID
+    void Reset(const TaskID id)
     {
-        assert(m_numThreads > 0);
-        m_threadsTasks.reserve(m_numThreads);
-        InitThreads();
-        InitThreadsTasks();
+        m_status = Status::PAUSED;
+        m_lambda = nullptr;
+        m_ID = id;
+        m_progress = 0.0f;
+        m_isStopping = false;
     }
     
-    //! Destroys the pool, and deallocates resources
-    ~TinyTasksPool()
+    //! Blocks the current thread until the predicate on the status is met
+    template<typename Predicate>
+    void WaitUntil(Predicate predicate)
     {
-        assert(GetNumRunningTasks() == 0 && "There are still tasks running. Tasks must be stopped before pool destruction");
-        StopAllThreads();
-        InitThreadsTasks();
-        ClearPendingTasks();
-        DeleteTasksAllocations();
+        if(predicate()) return;
+        
+        m_numStatusWaiters++;
+        {
+            std::unique_lock<std::mutex> lock(m_statusMutex);
+            m_statusCondition.wait(lock, predicate);
+        }
+        m_numStatusWaiters--;
     }
     
-    //! Creates a new task in the pool and assigns a thread to it
-    //! @note It doesn't start the task until you assign a lambda to it
-    uint16_t CreateTask()
+    //! Blocks the current thread until the predicate on the status is met,
+    //! or the timeout expires
+    //! @return false if the timeout expired
+    template<typename Predicate>
+    bool WaitUntil(Predicate predicate, const std::chrono::milliseconds timeout)
     {
-        assert(m_nextFreeTaskId < constants::kMaxNumTasksInPool && "Can't create more tasks. Ran out of IDs");
-
-        std::lock_guard<std::mutex> lock(m_poolDataMutex);
-
-        uint8_t currentThreadIndex = 0;
-        for(auto& currentThreadTask : m_threadsTasks)
+        if(predicate()) return true;
+        
+        bool isMet = false;
+        m_numStatusWaiters++;
         {
-            if(m_threadsTasks[currentThreadIndex] == nullptr)
-            {
-                TinyTask* newTask = new TinyTask(m_nextFreeTaskId);
-                assert(newTask && "New task wasn't allocated");
-                m_tasks.insert(std::pair<uint16_t, TinyTask*>(m_nextFreeTaskId, newTask));
-                currentThreadTask = newTask;
-                return m_nextFreeTaskId++;
-            }
-            
-            currentThreadIndex++;
+            std::unique_lock<std::mutex> lock(m_statusMutex);
+            isMet = m_statusCondition.wait_for(lock, timeout, predicate);
         }
+        m_numStatusWaiters--;
+        
+        return isMet;
+    }
+    
+    //! Changes the status, and wakes up the threads waiting for a change
+    void SetStatus(const Status newStatus)
+    {
+        m_status = newStatus;
+        NotifyStatusChange();
+    }
+    
+    //! Wakes up the threads waiting for a status change (if any)
+    void NotifyStatusChange()
+    {
+        //Waiters are counted before checking the status, so either they see
+        //the new status or they are woken up here
+        if(m_numStatusWaiters == 0) return;
+        
+        std::lock_guard<std::mutex> lock(m_statusMutex);
+        m_statusCondition.notify_all();
+    }
+    
+    //The state read by the threads that monitor the task shares the first
+    //cache line of the task (after the vtable pointer)
+    std::atomic<Status>     m_status;
+    std::atomic<bool>       m_isStopping;
+    std::atomic<uint32_t>   m_numStatusWaiters;
+    TaskID                  m_ID;
+    std::mutex              m_statusMutex;
+    
+    //The state written by the running lambda (the progress, and the captures
+    //inside the function) starts a new line. The task size is rounded up to
+    //whole lines, so neighbouring tasks don't share them either
+    alignas(TINYTASKS_CACHE_LINE_SIZE)
+    std::atomic<float>      m_progress;
+    TaskFunction            m_lambda;
+    std::condition_variable m_statusCondition;
+};
 
-        //If there is no space in the thread vector, create new task and queque it
-        TinyTask* newTask = new TinyTask(m_nextFreeTaskId);
-        assert(newTask && "New task wasn't allocated");
-        m_tasks.insert(std::pair<uint16_t, TinyTask*>(m_nextFreeTaskId, newTask));
-        m_pendingTasks.push(newTask);
-
-        return m_nextFreeTaskId++;
+//! @brief Bounded work-stealing deque of pointers (Chase-Lev)
+//!
+//! @details
+//! The owner thread pushes and pops items at the bottom of the deque
+//! without locking, while any other thread can steal items from the top.
+//! This is used by each worker of the TinyTasksPool to hold the tasks
+//! that are queued from the worker thread itself.
+//!
+//! @note Only the owner thread can call Push() and Pop()
+//!
+template<typename T>
+class WorkStealingQueue : public NonCopyableMovable
+{
+public:
+    //! Initialize the queue
+    //! @param capacity of the queue (has to be a power of two)
+    explicit WorkStealingQueue(const uint32_t capacity)
+            : m_top(0), m_bottom(0), m_mask(capacity - 1), m_items(new std::atomic<T*>[capacity])
+    {
+        assert(capacity > 0 && (capacity & (capacity - 1)) == 0 && "Queue capacity has to be a power of two");
     }
     
-    //! Sets a lambda function to a task, and starts running it (if possible)
-    //! @param ID of the task to set the new lambda to
-    //! @param lambda function to set (has to be valid)
-    Result SetNewLambdaForTask(const uint16_t taskID, std::function<void()> newLambda)
+    //! Pushes an item at the bottom of the queue (owner thread only)
+    //! @return false if the queue is full
+    bool Push(T* item)
+    {
+        const int64_t bottom = m_bottom.load(std::memory_order_relaxed);
+        const int64_t top = m_top.load(std::memory_order_acquire);
+        
+        if(bottom - top > static_cast<int64_t>(m_mask)) return false;
+        
+        m_items[bottom & m_mask].store(item, std::memory_order_relaxed);
+        m_bottom.store(bottom + 1, std::memory_order_release);
+        return true;
+    }
+    
+    //! Pops the item at the bottom of the queue (owner thread only)
+    //! @return nullptr if the queue is empty
+    T* Pop()
     {
-        assert(newLambda);
+        const int64_t bottom = m_bottom.load(std::memory_order_relaxed) - 1;
+        m_bottom.store(bottom, std::memory_order_seq_cst);
+        int64_t top = m_top.load(std::memory_order_seq_cst);
+        
+        if(top > bottom)
+        {
+            m_bottom.store(bottom + 1, std::memory_order_relaxed);
+            return nullptr;
+        }
         
-        std::lock_guard<std::mutex> lock(m_poolDataMutex);
+        T* item = m_items[bottom & m_mask].load(std::memory_order_relaxed);
         
-        uint8_t currentThreadIndex = 0;
-        for(auto& threadTask : m_threadsTasks)
+        //Last item, so race against the thieves for it
+        if(top == bottom)
         {
-            assert(threadTask);
-            if(threadTask->GetID() == taskID)
+            if(!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
             {
-                assert(threadTask->HasCompleted() || !threadTask->IsRunning() || !threadTask->IsPaused());
-                threadTask->SetLambda(newLambda);
-                m_threads[currentThreadIndex].join();
-                std::thread newTaskThread(&TinyTask::Run, threadTask);
-                m_threads[currentThreadIndex] = std::move(newTaskThread);
-                return Result::SUCCEEDED;
+                item = nullptr;
             }
             
-            currentThreadIndex++;
+            m_bottom.store(bottom + 1, std::memory_order_relaxed);
         }
         
-        auto task = m_tasks.find(taskID);
-        if(task->second)
+        return item;
+    }
+    
+    //! Steals the item at the top of the queue (any thread)
+    //! @return nullptr if the queue is empty or another thread won the item
+    T* Steal()
+    {
+        int64_t top = m_top.load(std::memory_order_seq_cst);
+        const int64_t bottom = m_bottom.load(std::memory_order_seq_cst);
+        
+        if(top >= bottom) return nullptr;
+        
+        T* item = m_items[top & m_mask].load(std::memory_order_relaxed);
+        
+        if(!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
         {
-            task->second->SetLambda(newLambda);
-            return Result::SUCCEEDED_AT_QUEUE;
+            return nullptr;
         }
+        
+        return item;
+    }
     
-        return Result::TASK_NOT_FOUND;
+    //! Gets if the queue is empty (approximate if other threads modify it)
+    bool IsEmpty() const
+    {
+        return m_top.load(std::memory_order_acquire) >= m_bottom.load(std::memory_order_acquire);
     }
     
-    //! Runs the pending tasks that are in the queue (if possible)
-    Result RunPendingTasks()
+    //! Gets the number of items in the queue (approximate if other threads modify it)
+    uint32_t GetSize() const
     {
-        std::lock_guard<std::mutex> lock(m_poolDataMutex);
+        const int64_t size = m_bottom.load(std::memory_order_acquire) - m_top.load(std::memory_order_acquire);
+        return size > 0 ? static_cast<uint32_t>(size) : 0;
+    }
+
+private:
+    std::atomic<int64_t>                m_top;
+    std::atomic<int64_t>                m_bottom;
+    const uint32_t                      m_mask;
+    std::unique_ptr<std::atomic<T*>[]>  m_items;
+};
+
+//! @brief Bounded multi-producer multi-consumer queue of pointers (Vyukov)
+//!
+//! @details
+//! Each cell of the ring has a sequence number that tells whether it's
+//! free to push to, or has an item to pop, in the current lap. Threads
+//! claim a position with a compare-and-swap on the push or pop position,
+//! so any number of threads push and pop without locking. The two
+//! positions are kept in separate cache lines.
+//! This is used by the TinyTasksPool to queue the tasks submitted from
+//! threads of outside the pool.
+//!
+template<typename T>
+class MPMCQueue : public NonCopyableMovable
+{
+public:
+    //! Initialize the queue
+    //! @param capacity of the queue (has to be a power of two)
+    explicit MPMCQueue(const uint32_t capacity) : m_mask(capacity - 1), m_cells(new Cell[capacity])
+    {
+        assert(capacity > 0 && (capacity & (capacity - 1)) == 0 && "Queue capacity has to be a power of two");
+        
+        for(uint32_t cellIndex = 0; cellIndex < capacity; ++cellIndex)
+        {
+            m_cells[cellIndex].sequence.store(cellIndex, std::memory_order_relaxed);
+            m_cells[cellIndex].item = nullptr;
+        }
         
-        uint8_t currentThreadIndex = 0;
+        m_pushPosition.value.store(0, std::memory_order_relaxed);
+        m_popPosition.value.store(0, std::memory_order_relaxed);
+    }
+    
+    //! Pushes an item at the end of the queue (any thread)
+    //! @return false if the queue is full
+    bool Push(T* item)
+    {
+        uint64_t position = m_pushPosition.value.load(std::memory_order_relaxed);
+        Cell* cell = nullptr;
         
-        for(auto& threadTask : m_threadsTasks)
+        while(true)
         {
-            assert(threadTask);
-            if(threadTask->HasStopped() || threadTask->HasCompleted())
+            cell = &m_cells[position & m_mask];
+            const uint64_t sequence = cell->sequence.load(std::memory_order_acquire);
+            const int64_t difference = static_cast<int64_t>(sequence - position);
+            
+            //The cell is free in this lap, so try to claim it
+            if(difference == 0)
             {
-                if(m_pendingTasks.empty()) break;
-                m_threads[currentThreadIndex].join();
-                threadTask = m_pendingTasks.front();
-                m_pendingTasks.pop();
-                std::thread newTaskThread(&TinyTask::Run, threadTask);
-                m_threads[currentThreadIndex] = std::move(newTaskThread);
+                if(m_pushPosition.value.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) break;
+            }
+            //The cell still has the item of the previous lap
+            else if(difference < 0)
+            {
+                return false;
+            }
+            else
+            {
+                position = m_pushPosition.value.load(std::memory_order_relaxed);
             }
-            
-            currentThreadIndex++;
         }
         
-        return Result::SUCCEEDED;
+        cell->item = item;
+        cell->sequence.store(position + 1, std::memory_order_release);
+        return true;
     }
     
-    //! Gets the number of tasks that are currently running
-    uint8_t GetNumRunningTasks()
+    //! Pops the item at the front of the queue (any thread)
+    //! @return nullptr if the queue is empty
+    T* Pop()
     {
-        std::lock_guard<std::mutex> lock(m_poolDataMutex);
-        
-        uint8_t numRunningTasks = 0;
+        uint64_t position = m_popPosition.value.load(std::memory_order_relaxed);
+        Cell* cell = nullptr;
         
-        for(auto& threadTask : m_threadsTasks)
+        while(true)
         {
-            if(threadTask && threadTask->IsRunning())
+            cell = &m_cells[position & m_mask];
+            const uint64_t sequence = cell->sequence.load(std::memory_order_acquire);
+            const int64_t difference = static_cast<int64_t>(sequence - (position + 1));
+            
+            //The cell has an item in this lap, so try to claim it
+            if(difference == 0)
             {
-                numRunningTasks++;
+                if(m_popPosition.value.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) break;
+            }
+            //The item of this lap isn't pushed yet
+            else if(difference < 0)
+            {
+                return nullptr;
+            }
+            else
+            {
+                position = m_popPosition.value.load(std::memory_order_relaxed);
             }
         }
         
-        return numRunningTasks;
+        T* item = cell->item;
+        cell->sequence.store(position + m_mask + 1, std::memory_order_release);
+        return item;
+    }
+    
+    //! Gets the number of items in the queue (approximate if other threads modify it)
+    uint32_t GetSize() const
+    {
+        const uint64_t popPosition = m_popPosition.value.load(std::memory_order_acquire);
+        const uint64_t pushPosition = m_pushPosition.value.load(std::memory_order_acquire);
+        return pushPosition > popPosition ? static_cast<uint32_t>(pushPosition - popPosition) : 0;
     }
+    
+private:
+    struct Cell
+    {
+        std::atomic<uint64_t>   sequence;
+        T*                      item;
+    };
+    
+    //! Position padded to a whole cache line
+    struct PaddedPosition
+    {
+        std::atomic<uint64_t>   value;
+        char                    padding[TINYTASKS_CACHE_LINE_SIZE];
+    };
+    
+    const uint64_t          m_mask;
+    std::unique_ptr<Cell[]> m_cells;
+    PaddedPosition          m_pushPosition;
+    PaddedPosition          m_popPosition;
+};
 
-    //! Gets a task that is in the pool, given its ID
-    //! @param ID of the task
-    //! @note This is a thread safe operation
-    TinyTask* GetTask(const uint16_t taskID)
+//! @brief Bump allocator for the temporary buffers of the tasks
+//!
+//! @details
+//! Each worker of the TinyTasksPool owns an arena, that the lambdas taking
+//! a TaskContext& get with TaskContext::GetScratchArena(). Allocating moves
+//! an offset forward in a single block, so it doesn't lock nor call malloc,
+//! and consecutive tasks reuse the same (cached) memory. Nothing is freed
+//! on its own: the arena is rewound once the task finishes, so the memory
+//! mustn't be used after the lambda returns, and no destructors are run.
+//! The block is allocated with the first allocation, by the worker thread.
+//! Allocations that don't fit are made in the heap, and freed when
+//! rewinding. Only the thread running the task can use the arena.
+//!
+class ScratchArena : public NonCopyableMovable
+{
+public:
+    //! Position of the arena, to rewind it to (see GetMarker())
+    struct Marker
+    {
+        std::size_t     offset;
+        void*           overflowBlocks;
+    };
+
+    //! Initialize the arena
+    //! @param size of the block in bytes (0 to allocate everything in the heap)
+    explicit ScratchArena(const std::size_t capacity)
+            : m_capacity(capacity), m_offset(0), m_overflowBlocks(nullptr), m_numOverflows(0) {}
+
+    //! Destroys the arena, and frees its memory
+    ~ScratchArena()
+    {
+        Reset();
+    }
+
+    //! Allocates memory that lasts until the arena is rewound
+    //! @param size in bytes
+    //! @param alignment (has to be a power of two)
+    void* Allocate(const std::size_t size, const std::size_t alignment = alignof(std::max_align_t))
+    {
+        assert(alignment > 0 && (alignment & (alignment - 1)) == 0 && "Alignment has to be a power of two");
+
+        if(!m_block && m_capacity > 0) m_block.reset(new char[m_capacity]);
+
+        const std::uintptr_t base = reinterpret_cast<std::uintptr_t>(m_block.get());
+        const std::uintptr_t address = (base + m_offset + alignment - 1) & ~(alignment - 1);
+
+        if(m_block && address + size <= base + m_capacity)
+        {
+            m_offset = address + size - base;
+            return reinterpret_cast<void*>(address);
+        }
+
+        return AllocateOverflowBlock(size, alignment);
+    }
+
+    //! Allocates an array that lasts until the arena is rewound
+    //! @param number of items (default initialized)
+    template<typename T>
+    T* AllocateArray(const std::size_t count)
+    {
+        static_assert(std::is_trivially_destructible<T>::value, "The arena doesn't run destructors");
+
+        T* items = static_cast<T*>(Allocate(sizeof(T) * count, alignof(T)));
+        for(std::size_t index = 0; index < count; ++index) new(&items[index]) T;
+
+        return items;
+    }
+
+    //! Gets the current position, to free what's allocated afterwards
+    Marker GetMarker() const { return Marker{ m_offset, m_overflowBlocks }; }
+
+    //! Frees what was allocated after a position
+    //! @param position from GetMarker()
+    void Rewind(const Marker& marker)
+    {
+        assert(marker.offset <= m_offset && "Can't rewind the arena forward");
+
+        while(m_overflowBlocks != marker.overflowBlocks)
+        {
+            OverflowBlock* block = static_cast<OverflowBlock*>(m_overflowBlocks);
+            m_overflowBlocks = block->next;
+            ::operator delete(block);
+        }
+
+        m_offset = marker.offset;
+    }
+
+    //! Frees everything that was allocated
+    void Reset() { Rewind(Marker{ 0, nullptr }); }
+
+    //! Gets the size of the block in bytes
+    std::size_t GetCapacity() const     { return m_capacity; }
+    //! Gets the bytes used in the block (excluding the heap allocations)
+    std::size_t GetUsedSize() const     { return m_offset; }
+    //! Gets the number of allocations that didn't fit in the block, so
+    //! they were made in the heap (any thread)
+    uint64_t    GetNumOverflows() const { return m_numOverflows.load(std::memory_order_relaxed); }
+
+private:
+    //! Header of an allocation in the heap, linked to the previous one
+    struct OverflowBlock
+    {
+        void*   next;
+    };
+
+    void* AllocateOverflowBlock(const std::size_t size, const std::size_t alignment)
+    {
+        m_numOverflows.store(m_numOverflows.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+        OverflowBlock* block = static_cast<OverflowBlock*>(::operator new(sizeof(OverflowBlock) + size + alignment - 1));
+        block->next = m_overflowBlocks;
+        m_overflowBlocks = block;
+
+        const std::uintptr_t address = reinterpret_cast<std::uintptr_t>(block + 1);
+        return reinterpret_cast<void*>((address + alignment - 1) & ~(alignment - 1));
+    }
+
+    const std::size_t       m_capacity;
+    std::unique_ptr<char[]> m_block;
+    std::size_t             m_offset;
+    void*                   m_overflowBlocks;
+    std::atomic<uint64_t>   m_numOverflows;
+};
+
+//! @brief Histogram of latencies with log-linear buckets (HDR style)
+//!
+//! @details
+//! Each power of two is split in kNumSubBuckets buckets, so a value is
+//! kept with a relative error below 1 / kNumSubBuckets, for the whole range
+//! of 64 bit values. Recording a value is a relaxed increment, and it's
+//! meant to be done by a single thread. Any thread can take a snapshot
+//! meanwhile, which is consistent per bucket.
+//!
+class LatencyHistogram : public NonCopyableMovable
+{
+public:
+    static const uint32_t kNumSubBucketBits = 3;
+    static const uint32_t kNumSubBuckets    = 1u << kNumSubBucketBits;
+    static const uint32_t kNumBuckets       = (64 - kNumSubBucketBits + 1) * kNumSubBuckets;
+    
+    //! @brief Copy of the counts of a histogram
+    class Snapshot
     {
-        std::lock_guard<std::mutex> lock(m_poolDataMutex);
+    public:
+        //! Initialize an empty snapshot
+        Snapshot() : m_counts(kNumBuckets, 0), m_count(0), m_sum(0), m_max(0) {}
+        
+        //! Adds the counts of another snapshot
+        void Merge(const Snapshot& other)
+        {
+            for(uint32_t bucket = 0; bucket < kNumBuckets; ++bucket) m_counts[bucket] += other.m_counts[bucket];
+            
+            m_count += other.m_count;
+            m_sum += other.m_sum;
+            m_max = std::max(m_max, other.m_max);
+        }
+        
+        //! Gets the value below which a percentage of the values are
+        //! @param percentile in the range [0, 100]
+        //! @return upper bound of the bucket of the percentile (0 if empty)
+        uint64_t GetPercentile(const double percentile) const
+        {
+            assert(percentile >= 0.0 && percentile <= 100.0);
+            if(m_count == 0) return 0;
+            
+            const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(percentile / 100.0 * m_count + 0.5));
+            uint64_t numValues = 0;
+            
+            for(uint32_t bucket = 0; bucket < kNumBuckets; ++bucket)
+            {
+                numValues += m_counts[bucket];
+                if(numValues >= rank) return std::min(GetBucketUpperBound(bucket), m_max);
+            }
+            
+            return m_max;
+        }
         
-        auto foundPair = m_tasks.find(taskID);
+        //! Gets the number of values
+        uint64_t    GetCount()  const { return m_count; }
+        //! Gets the mean of the values (0 if empty)
+        double      GetMean()   const { return m_count ? static_cast<double>(m_sum) / m_count : 0.0; }
+        //! Gets the largest value
+        uint64_t    GetMax()    const { return m_max; }
         
-        if(foundPair != m_tasks.end())
-            return m_tasks.find(taskID)->second;
+    private:
+        friend class LatencyHistogram;
         
-        return nullptr;
-    }
+        std::vector<uint64_t>   m_counts;
+        uint64_t                m_count;
+        uint64_t                m_sum;
+        uint64_t                m_max;
+    };
     
-    //! Gets the status of a task in the pool
-    //! @param ID of the task
-    //! @note This is a thread safe operation
-    TinyTask::Status GetTaskStatus(const uint16_t taskID)
+    //! Initialize an empty histogram
+    explicit LatencyHistogram() : m_sum(0), m_max(0)
     {
-        TinyTask* task = GetTask(taskID);
-        assert(task && "Task not found!");
-        
-        return task->GetStatus();
+        for(auto& count : m_counts) count.store(0, std::memory_order_relaxed);
     }
     
-    //! Gets the number of threads in the pool
-    uint8_t     GetNumThreads()         const { return m_numThreads; }
-    //! Gets the number of pending tasks that are queued in the pool
-    uint16_t    GetNumPendingTasks()    const { return static_cast<uint16_t>(m_pendingTasks.size()); }
+    //! Records a value (from a single thread)
+    void Record(const uint64_t value)
+    {
+        std::atomic<uint64_t>& count = m_counts[GetBucket(value)];
+        count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        m_sum.store(m_sum.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+        if(value > m_max.load(std::memory_order_relaxed)) m_max.store(value, std::memory_order_relaxed);
+    }
     
-private:
-    //! Initialises the threads for the pool
-    void InitThreads()
+    //! Copies the counts of the histogram (from any thread)
+    Snapshot GetSnapshot() const
     {
-        assert(m_threads.size() == 0);
-        m_threads.reserve(m_numThreads);
+        Snapshot snapshot;
         
-        for(uint8_t threadIndex = 0; threadIndex < m_numThreads; ++threadIndex)
+        for(uint32_t bucket = 0; bucket < kNumBuckets; ++bucket)
         {
-            std::thread newThread([]{});
-            m_threads.push_back(std::move(newThread));
+            snapshot.m_counts[bucket] = m_counts[bucket].load(std::memory_order_relaxed);
+            snapshot.m_count += snapshot.m_counts[bucket];
         }
+        
+        snapshot.m_sum = m_sum.load(std::memory_order_relaxed);
+        snapshot.m_max = m_max.load(std::memory_order_relaxed);
+        
+        return snapshot;
+    }
+    
+    //! Gets the bucket of a value
+    static uint32_t GetBucket(const uint64_t value)
+    {
+        if(value < kNumSubBuckets) return static_cast<uint32_t>(value);
+        
+        const uint32_t exponent = GetHighestBit(value);
+        const uint32_t subBucket = static_cast<uint32_t>(value >> (exponent - kNumSubBucketBits)) & (kNumSubBuckets - 1);
+        
+        return (exponent - kNumSubBucketBits + 1) * kNumSubBuckets + subBucket;
     }
     
-    //! Initialises the tasks that are tied to the threads
-    void InitThreadsTasks()
+    //! Gets the largest value of a bucket
+    static uint64_t GetBucketUpperBound(const uint32_t bucket)
     {
-        m_threadsTasks.clear();
+        if(bucket < kNumSubBuckets) return bucket;
+        
+        const uint32_t exponent = bucket / kNumSubBuckets + kNumSubBucketBits - 1;
+        const uint64_t subBucket = bucket % kNumSubBuckets;
+        const uint32_t shift = exponent - kNumSubBucketBits;
         
-        for(uint8_t currentIndex = 0; currentIndex < m_numThreads; ++currentIndex)
+        return ((kNumSubBuckets + subBucket + 1) << shift) - 1;
+    }
+    
+private:
+    //! Gets the index of the highest bit set of a value (that isn't 0)
+    static uint32_t GetHighestBit(uint64_t value)
+    {
+#if defined(__GNUC__) || defined(__clang__)
+        return 63 - static_cast<uint32_t>(__builtin_clzll(value));
+#else
+        uint32_t bit = 0;
+        for(uint32_t shift = 32; shift > 0; shift /= 2)
         {
-            m_threadsTasks.push_back(nullptr);
+            if(value >> shift) { value >>= shift; bit += shift; }
         }
+        return bit;
+#endif
     }
     
-    //! Clears the pending tasks in the queue
-    void ClearPendingTasks()
+    std::atomic<uint64_t>   m_counts[kNumBuckets];
+    std::atomic<uint64_t>   m_sum;
+    std::atomic<uint64_t>   m_max;
+};
+
+//! @brief CPUs of each NUMA node of the machine
+//!
+//! @details
+//! The topology is read from /sys/devices/system/node on Linux. On other
+//! platforms, or when there is no NUMA information, the machine is taken
+//! as a single node with all the hardware threads.
+//!
+class CpuTopology
+{
+public:
+    //! Initialize the topology with the CPUs of each node
+    explicit CpuTopology(std::vector<std::vector<uint32_t>> nodeCPUs) : m_nodeCPUs(std::move(nodeCPUs))
     {
-        std::queue<TinyTask*> empty;
-        std::swap(m_pendingTasks, empty);
+        assert(!m_nodeCPUs.empty() && m_nodeCPUs.size() <= constants::kMaxNumNumaNodes);
     }
     
-    //! Deletes the allocated TinyTask objects in the pool
-    void DeleteTasksAllocations()
+    //! Detects the topology of the machine
+    static CpuTopology Detect()
     {
-        for(auto& task : m_tasks)
+        std::vector<std::vector<uint32_t>> nodeCPUs;
+        
+        //Node numbers can have gaps, so all of them are checked
+        for(uint32_t node = 0; node < constants::kMaxNumNumaNodes; ++node)
         {
-            assert(task.second && "The task object has been deleted outside of the pool");
+            std::ifstream file("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+            std::string cpuList;
+            if(!std::getline(file, cpuList)) continue;
             
-            if(task.second)
-            {
-                delete task.second;
-                task.second = nullptr;
-            }
+            std::vector<uint32_t> cpus = ParseCPUList(cpuList);
+            if(!cpus.empty()) nodeCPUs.push_back(std::move(cpus));
+        }
+        
+        if(nodeCPUs.empty())
+        {
+            nodeCPUs.push_back(std::vector<uint32_t>());
+            const uint32_t numCPUs = std::max(std::thread::hardware_concurrency(), 1u);
+            for(uint32_t cpu = 0; cpu < numCPUs; ++cpu) nodeCPUs.back().push_back(cpu);
         }
+        
+        return CpuTopology(std::move(nodeCPUs));
     }
     
-    //! Stops the threads in the pool)
-    void StopAllThreads()
+    //! Parses a list of CPUs in the kernel format (e.g. "0-3,8,10-11")
+    //! @return the CPUs in the list (empty if the format isn't valid)
+    static std::vector<uint32_t> ParseCPUList(const std::string& cpuList)
     {
-        for(auto& aThread : m_threads)
+        std::vector<uint32_t> cpus;
+        std::istringstream stream(cpuList);
+        std::string range;
+        
+        while(std::getline(stream, range, ','))
         {
-            aThread.join();
+            unsigned int first = 0, last = 0;
+            const int numValues = sscanf(range.c_str(), "%u-%u", &first, &last);
+            if(numValues < 1) continue;
+            if(numValues == 1) last = first;
+            if(last < first) return std::vector<uint32_t>();
+            
+            for(unsigned int cpu = first; cpu <= last; ++cpu) cpus.push_back(cpu);
         }
+        
+        return cpus;
     }
     
-    uint8_t                         m_numThreads;
-    std::vector<std::thread>        m_threads;
-    std::vector<TinyTask*>          m_threadsTasks;
-    std::queue<TinyTask*>           m_pendingTasks;
-    std::map<uint16_t, TinyTask*>   m_tasks;
-    uint16_t                        m_nextFreeTaskId;
-    std::mutex                      m_poolDataMutex;
-};
+    //! Pins the calling thread to a set of CPUs
+    //! @return false if the platform doesn't support it, or the CPUs aren't valid
+    static bool PinCurrentThread(const std::vector<uint32_t>& cpus)
+    {
+#if defined(TINYTASKS_HAS_THREAD_AFFINITY)
+        cpu_set_t cpuSet;
+        CPU_ZERO(&cpuSet);
+        
+        for(const uint32_t cpu : cpus)
+        {
+            if(cpu < CPU_SETSIZE) CPU_SET(cpu, &cpuSet);
+        }
+        
+        return CPU_COUNT(&cpuSet) > 0 && pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet) == 0;
+#else
+        (void)cpus;
+        return false;
+#endif
+    }
+    
+    //! Gets the number of NUMA nodes
+    size_t                          GetNumNodes()                   const { return m_nodeCPUs.size(); }
+    //! Gets the CPUs of a NUMA node
+    const std::vector<uint32_t>&    GetNodeCPUs(const size_t node)  const { return m_nodeCPUs[node]; }
     
+private:
+    std::vector<std::vector<uint32_t>> m_nodeCPUs;
+};
+
+//! @brief Placement of the workers of a TinyTasksPool on the CPUs
+//!
+//! @details
+//! By default the workers aren't pinned, and the OS can move them between
+//! CPUs. PinToCPUs() pins each worker to one CPU of a list, round robin.
+//! PerNumaNode() spreads the workers on the NUMA nodes, round robin, and
+//! pins each one to the CPUs of its node. Then tasks can be queued with
+//! a node hint, so they run near their memory.
+//!
+struct WorkerPlacement
+{
+    //! Initialize a placement with unpinned workers
+    WorkerPlacement() : isPerNode(false) {}
+    
+    //! Pins each worker to a CPU of a list
+    static WorkerPlacement PinToCPUs(const std::vector<uint32_t>& cpus)
+    {
+        WorkerPlacement placement;
+        for(const uint32_t cpu : cpus) placement.cpuSets.push_back(std::vector<uint32_t>(1, cpu));
+        
+        return placement;
+    }
+    
+    //! Partitions the workers on the nodes of a topology
+    static WorkerPlacement PerNumaNode(const CpuTopology& topology)
+    {
+        WorkerPlacement placement;
+        placement.isPerNode = true;
+        for(size_t node = 0; node < topology.GetNumNodes(); ++node) placement.cpuSets.push_back(topology.GetNodeCPUs(node));
+        
+        return placement;
+    }
+    
+    //! Gets the number of nodes that the workers are partitioned on
+    uint8_t GetNumNodes() const { return isPerNode ? static_cast<uint8_t>(cpuSets.size()) : 1; }
+    
+    //! Sets of CPUs that the workers are pinned to, round robin (empty for unpinned workers)
+    std::vector<std::vector<uint32_t>>  cpuSets;
+    //! Each set of CPUs is a NUMA node
+    bool                                isPerNode;
+};
+
+//! @brief Token to check if an operation has been cancelled
+//!
+//! @details
+//! Tokens are copied cheaply (they share the state of their source), and
+//! checking them is a single atomic load. A default token is never
+//! cancelled.
+//!
+class CancellationToken
+{
+public:
+    //! Initialize a token that is never cancelled
+    CancellationToken() {}
+    
+    //! Gets if the operation has been cancelled
+    bool IsCancelled() const { return m_state && m_state->isCancelled.load(std::memory_order_acquire); }
+    //! Gets if the token has a source that can cancel it
+    bool CanBeCancelled() const { return m_state != nullptr; }
+    
+private:
+    friend class CancellationSource;
+    
+    //! State shared by a source and its tokens
+    struct State
+    {
+        State() : isCancelled(false) {}
+        
+        std::atomic<bool>                   isCancelled;
+        std::mutex                          childrenMutex;
+        std::vector<std::weak_ptr<State>>   children;
+    };
+    
+    explicit CancellationToken(std::shared_ptr<State> state) : m_state(std::move(state)) {}
+    
+    std::shared_ptr<State> m_state;
+};
+
+//! @brief Cancels the operations that hold its tokens
+//!
+//! @details
+//! A source can be the child of a token: then it's cancelled when the
+//! parent is, so cancelling a task or a group cancels the children too.
+//! Cancelling is cooperative: the tasks check it with
+//! TaskContext::IsCancelled() and return early.
+//!
+class CancellationSource
+{
+public:
+    //! Initialize a source that isn't cancelled
+    CancellationSource() : m_state(std::make_shared<CancellationToken::State>()) {}
+    
+    //! Initialize a source that is cancelled when a parent token is
+    //! @param parent token (the source is cancelled straight away if the
+    //! parent is cancelled already)
+    explicit CancellationSource(const CancellationToken& parent) : m_state(std::make_shared<CancellationToken::State>())
+    {
+        const std::shared_ptr<CancellationToken::State>& parentState = parent.m_state;
+        if(parentState == nullptr) return;
+        
+        {
+            std::lock_guard<std::mutex> lock(parentState->childrenMutex);
+            
+            if(!parentState->isCancelled)
+            {
+                //Expired children are removed, so the list doesn't grow forever
+                std::vector<std::weak_ptr<CancellationToken::State>>& children = parentState->children;
+                children.erase(std::remove_if(children.begin(), children.end(),
+                                              [](const std::weak_ptr<CancellationToken::State>& child) { return child.expired(); }),
+                               children.end());
+                children.push_back(m_state);
+                return;
+            }
+        }
+        
+        Cancel();
+    }
+    
+    //! Cancels the tokens of the source, and the sources that are its children
+    void Cancel() { Cancel(m_state); }
+    
+    //! Gets if the source has been cancelled
+    bool IsCancelled() const { return m_state->isCancelled; }
+    //! Gets a token of the source
+    CancellationToken GetToken() const { return CancellationToken(m_state); }
+    
+private:
+    static void Cancel(const std::shared_ptr<CancellationToken::State>& state)
+    {
+        //The flag goes first, so the children that are added meanwhile see it
+        if(state->isCancelled.exchange(true)) return;
+        
+        std::vector<std::weak_ptr<CancellationToken::State>> children;
+        {
+            std::lock_guard<std::mutex> lock(state->childrenMutex);
+            children.swap(state->children);
+        }
+        
+        for(const auto& child : children)
+        {
+            std::shared_ptr<CancellationToken::State> childState = child.lock();
+            if(childState) Cancel(childState);
+        }
+    }
+    
+    std::shared_ptr<CancellationToken::State> m_state;
+};
+
+//! @brief Hierarchical timer wheel, which keeps timers sorted by the tick
+//! they expire at in constant time
+//!
+//! @details
+//! The wheel has 4 levels of 64 slots. The first level holds the timers due
+//! in the next 64 ticks, one slot per tick, and each next level covers 64
+//! times the span of the previous one. When the first level wraps around,
+//! the timers of the next slot of the level above are moved down
+//! (cascaded). Adding a timer and advancing a tick are O(1), whatever the
+//! number of timers. Delays longer than the whole wheel are cascaded again
+//! until they're in range.
+//!
+//! @note This class doesn't lock or handle any threads (see
+//! TinyTasksPool::ScheduleAfter())
+//!
+class TimerWheel : public NonCopyableMovable
+{
+public:
+    //! Timer in the wheel, with the function to run when it expires
+    struct Timer
+    {
+        Timer(const TimerID timerID, TaskFunction timerFunction, const uint64_t expiry, const uint64_t period, const bool runOnStop = false)
+                : id(timerID), function(std::move(timerFunction)), expiryTick(expiry), periodTicks(period),
+                  runsOnStop(runOnStop), isCancelled(false), isRunning(false) {}
+        
+        TimerID             id;
+        TaskFunction        function;
+        uint64_t            expiryTick;
+        //! Ticks between the expiries of a periodic timer (0 if it's one-shot)
+        uint64_t            periodTicks;
+        //! If the timers are stopped before it expires, the function runs
+        //! in the thread that stops them (e.g. to resume a coroutine)
+        bool                runsOnStop;
+        std::atomic<bool>   isCancelled;
+        std::atomic<bool>   isRunning;
+    };
+    
+    static const uint32_t kNumLevels    = 4;
+    static const uint32_t kNumSlotBits  = 6;
+    static const uint32_t kNumSlots     = 1u << kNumSlotBits;
+    
+    //! Initialize an empty wheel at tick 0
+    TimerWheel() : m_currentTick(0), m_numTimers(0) {}
+    
+    //! Adds a timer. Timers that have expired already are due at the next tick
+    void Add(std::shared_ptr<Timer> timer)
+    {
+        m_numTimers++;
+        Insert(std::move(timer), m_currentTick + 1);
+    }
+    
+    //! Advances the wheel up to a tick, and takes the timers that expire
+    //! meanwhile (the cancelled ones are dropped)
+    //! @param tick to advance to
+    //! @param list where the expired timers are added
+    void Advance(const uint64_t tick, std::vector<std::shared_ptr<Timer>>& expiredTimers)
+    {
+        //An empty wheel doesn't need to go through the ticks
+        if(m_numTimers == 0 && tick > m_currentTick) m_currentTick = tick;
+        
+        while(m_currentTick < tick)
+        {
+            m_currentTick++;
+            
+            //The slots of the upper levels are cascaded when the levels below wrap around
+            for(uint32_t level = 1; level < kNumLevels; ++level)
+            {
+                if((m_currentTick & ((uint64_t(1) << (level * kNumSlotBits)) - 1)) != 0) break;
+                Cascade(level, GetSlotIndex(m_currentTick, level));
+            }
+            
+            std::vector<std::shared_ptr<Timer>> slotTimers;
+            slotTimers.swap(m_slots[0][GetSlotIndex(m_currentTick, 0)]);
+            
+            for(std::shared_ptr<Timer>& timer : slotTimers)
+            {
+                if(timer->isCancelled)
+                {
+                    m_numTimers--;
+                }
+                else if(timer->expiryTick > m_currentTick)
+                {
+                    Insert(std::move(timer), m_currentTick);
+                }
+                else
+                {
+                    m_numTimers--;
+                    expiredTimers.push_back(std::move(timer));
+                }
+            }
+        }
+    }
+    
+    //! Gets the number of ticks until the wheel has to be advanced again:
+    //! until the next timer of the first level, or until the first level wraps around
+    //! @return UINT64_MAX if the wheel is empty
+    uint64_t GetTicksUntilNextCheck() const
+    {
+        if(m_numTimers == 0) return UINT64_MAX;
+        
+        uint64_t numTicks = 1;
+        
+        for(; numTicks < kNumSlots; ++numTicks)
+        {
+            const uint64_t tick = m_currentTick + numTicks;
+            if(!m_slots[0][GetSlotIndex(tick, 0)].empty() || GetSlotIndex(tick, 0) == 0) break;
+        }
+        
+        return numTicks;
+    }
+    
+    //! Gets the tick that the wheel has advanced to
+    uint64_t GetCurrentTick()   const { return m_currentTick; }
+    //! Gets the number of timers in the wheel (including the cancelled ones
+    //! that haven't been dropped yet)
+    size_t   GetNumTimers()     const { return m_numTimers; }
+    
+private:
+    static uint32_t GetSlotIndex(const uint64_t tick, const uint32_t level)
+    {
+        return static_cast<uint32_t>(tick >> (level * kNumSlotBits)) & (kNumSlots - 1);
+    }
+    
+    //! Puts a timer in the level that covers its delay
+    //! @param timer to put in the wheel
+    //! @param first tick that the timer can be put at (the slot of the
+    //! current tick is only taken after cascading)
+    void Insert(std::shared_ptr<Timer> timer, const uint64_t minTick)
+    {
+        uint64_t expiryTick = std::max(timer->expiryTick, minTick);
+        
+        //Longer delays go to the last slot of the last level in range, and are cascaded again
+        const uint64_t maxDelay = (uint64_t(1) << (kNumLevels * kNumSlotBits)) - 1;
+        if(expiryTick - m_currentTick > maxDelay) expiryTick = m_currentTick + maxDelay;
+        
+        const uint64_t delay = expiryTick - m_currentTick;
+        uint32_t level = 0;
+        while(level + 1 < kNumLevels && (delay >> ((level + 1) * kNumSlotBits)) != 0) level++;
+        
+        m_slots[level][GetSlotIndex(expiryTick, level)].push_back(std::move(timer));
+    }
+    
+    //! Moves the timers of a slot to the levels below
+    void Cascade(const uint32_t level, const uint32_t slotIndex)
+    {
+        std::vector<std::shared_ptr<Timer>> slotTimers;
+        slotTimers.swap(m_slots[level][slotIndex]);
+        
+        for(std::shared_ptr<Timer>& timer : slotTimers)
+        {
+            if(timer->isCancelled) m_numTimers--;
+            else Insert(std::move(timer), m_currentTick);
+        }
+    }
+    
+    std::vector<std::shared_ptr<Timer>> m_slots[kNumLevels][kNumSlots];
+    uint64_t                            m_currentTick;
+    size_t                              m_numTimers;
+};
+
+class TaskContext;
+
+template<typename T>
+class Future;
+
+template<typename T>
+class FutureState;
+
+template<typename Index>
+class ParallelRange;
+
+//! @brief Implements a thread pool for handling tasks
+//!
+//! @details
+//! To use this class, just instantiate an object of it and be sure to
+//! specify the number of desired worker threads in the constructor if
+//! you want to limit them in your application.
+//! Once you create tasks, the IDs are stored in the pool object until
+//! the tasks are released with ReleaseTask(taskID). Released tasks are
+//! recycled for new tasks: an ID holds the index of the task in the pool
+//! and a generation, so the ID of a released task isn't valid anymore
+//! even if its index is reused.
+//! Beware that the call to GetTask(taskID) returns a pointer to the task
+//! that is owned by the pool. If you delete the pointer it will lead
+//! to trouble, and the pointer must not be used after releasing the task.
+//! Tasks are stored in pages of a table indexed by their IDs, so getting
+//! a task or its status doesn't lock, and doesn't wait for the creation
+//! of tasks. The pages are only deallocated when the pool is destroyed.
+//! The first tasks created in the pool are tied to a worker thread each.
+//! Once all the worker threads have a task tied, the next tasks are
+//! queued (with a "paused" state") when they have a lambda assigned.
+//! Queued tasks are started automatically as soon as a worker thread is
+//! free, so there is no need to poll the member function RunPendingTasks().
+//! The worker threads are started once when the pool is constructed and
+//! are kept alive until the pool is destroyed, so running a task doesn't
+//! require creating a new thread.
+//! Each worker has its own queue: tasks queued from inside a running task
+//! lambda go to the queue of the worker that runs it, and tasks queued
+//! from other threads go to a lock-free injection queue (or to the shared
+//! queue, once it's full). Idle workers steal tasks from the queues of busy
+//! workers.
+//! Tasks can have a priority class and a deadline. The shared queue is
+//! ordered by the time each task is due: high priority tasks are due when
+//! queued, normal and low priority ones after a delay of their class, and
+//! tasks with a deadline by then at the latest. So low priority tasks are
+//! never starved, and only normal priority tasks without a deadline go to
+//! the queues of the workers.
+//! Instead of polling the status of the tasks, the calling thread can
+//! block until a task finishes with Wait(taskID) or WaitFor(taskID,
+//! timeout), or until all of them finish with WaitAll(). Submit(lambda)
+//! creates and runs a task in one call, and returns a handle to wait for
+//! it.
+//! The number of workers can change at runtime with Resize(), or by
+//! itself in elastic mode, growing while all the workers are busy and
+//! shrinking when the last worker is idle. Workers are never freed until
+//! the pool is destroyed, so retiring a worker only finishes its thread.
+//!
+//! @note This class handles std::thread objects. Any other threading API
+//! could potentially be used, but it will require some rework
+//!
+class TinyTasksPool : public NonCopyableMovable
+{
+public:
+    //! Possible results for the pool operations
+    enum Result
+    {
+        SUCCEEDED,
+        SUCCEEDED_AT_QUEUE,
+        TASK_NOT_FOUND,
+        TIMED_OUT,
+        SHUT_DOWN,
+        QUEUE_FULL,
+        ALREADY_SCHEDULED,
+    };
+    
+    //! How Shutdown() handles the tasks that haven't finished
+    enum ShutdownMode
+    {
+        DRAIN,      //!< The queued tasks are run
+        CANCEL,     //!< The running and queued tasks are stopped
+    };
+    
+    //! What submitting a task does once the queues are full (see
+    //! SetQueueCapacity())
+    enum OverflowPolicy
+    {
+        BLOCK,          //!< The submitting thread waits until there's room
+        REJECT,         //!< The task isn't run, and QUEUE_FULL is returned
+        RUN_IN_CALLER,  //!< The task runs in the submitting thread
+    };
+    
+    //! Priority classes of the queued tasks
+    enum Priority : uint8_t
+    {
+        HIGH,
+        NORMAL,
+        LOW,
+        NUM_PRIORITIES,
+    };
+    
+    //! @brief Handle to a task submitted to the pool, to wait for it
+    //! without polling its status
+    class TaskHandle
+    {
+    public:
+        //! Initialize an empty handle (not tied to any task)
+        TaskHandle() : m_pool(nullptr), m_ID(constants::kInvalidTaskID) {}
+        
+        //! Gets the ID of the task
+        TaskID      GetID()     const { return m_ID; }
+        //! Gets the task (nullptr if the handle is empty or the task was released)
+        TinyTask*   GetTask()   const { return m_pool ? m_pool->GetTask(m_ID) : nullptr; }
+        //! Gets if the handle refers to a task in the pool
+        bool        IsValid()   const { return GetTask() != nullptr; }
+        
+        //! Blocks the current thread until the task finishes running
+        Result Wait() const
+        {
+            return m_pool ? m_pool->Wait(m_ID) : Result::TASK_NOT_FOUND;
+        }
+        
+        //! Blocks the current thread until the task finishes running, or
+        //! the timeout expires
+        Result WaitFor(const std::chrono::milliseconds timeout) const
+        {
+            return m_pool ? m_pool->WaitFor(m_ID, timeout) : Result::TASK_NOT_FOUND;
+        }
+        
+    private:
+        friend class TinyTasksPool;
+        
+        TaskHandle(TinyTasksPool* pool, const TaskID taskID) : m_pool(pool), m_ID(taskID) {}
+        
+        TinyTasksPool*  m_pool;
+        TaskID          m_ID;
+    };
+    
+    //! @brief Metrics of a worker of the pool
+    struct WorkerMetrics
+    {
+        uint8_t     index;
+        uint8_t     node;
+        //! false if the worker is retiring or has retired
+        bool        isActive;
+        //! Tasks in the queue of the worker
+        uint32_t    queueLength;
+        uint64_t    numCompletedRuns;
+        //! Finished runs of tasks that were stopped
+        uint64_t    numStoppedRuns;
+        //! Allocations of the scratch arena that were made in the heap
+        uint64_t    numScratchArenaOverflows;
+    };
+    
+    //! @brief Snapshot of the metrics of the pool (see GetMetrics())
+    struct Metrics
+    {
+        //! Runs of tasks scheduled since the pool was created
+        uint64_t                    numScheduledRuns;
+        uint64_t                    numCompletedRuns;
+        uint64_t                    numStoppedRuns;
+        //! Runs by threads of outside the pool, while they wait for tasks
+        //! (they're counted in the completed runs too)
+        uint64_t                    numExternalRuns;
+        //! Runs that weren't queued because the queues were full
+        uint64_t                    numRejectedRuns;
+        //! Tasks waiting in the queues
+        uint32_t                    numPendingTasks;
+        uint8_t                     numRunningTasks;
+        uint8_t                     numThreads;
+        uint8_t                     numParkedWorkers;
+        //! Time from scheduling a run until it starts, in nanoseconds
+        LatencyHistogram::Snapshot  queueWaitTimes;
+        //! Time that the runs take, in nanoseconds
+        LatencyHistogram::Snapshot  runTimes;
+        std::vector<WorkerMetrics>  workers;
+    };
+    
+    //! Initialize the pool with default values
+    //! @note The number of worker threads is the number of hardware threads
+    explicit TinyTasksPool() : TinyTasksPool(GetDefaultNumThreads(), WorkerPlacement()) {}
+
+    //! Initialize the pool
+    //! @param number of worker threads in the pool
+    TinyTasksPool(uint8_t numThreads) : TinyTasksPool(numThreads, WorkerPlacement()) {}
+    
+    //! Initialize the pool with its workers pinned to CPUs
+    //! @param number of worker threads in the pool
+    //! @param placement of the workers on the CPUs (see WorkerPlacement)
+    //! @note Workers that can't be pinned (e.g. the CPUs aren't valid)
+    //! run unpinned
+    TinyTasksPool(uint8_t numThreads, const WorkerPlacement& placement)
+            : TinyTasksPool(numThreads, placement, constants::kDefaultScratchArenaSize) {}
+    
+    //! Initialize the pool with its workers pinned to CPUs, and the size
+    //! of their scratch arenas
+    //! @param number of worker threads in the pool
+    //! @param placement of the workers on the CPUs (see WorkerPlacement)
+    //! @param size in bytes of the scratch arena of each worker (see
+    //! TaskContext::GetScratchArena()). It's only allocated once a task uses it
+    TinyTasksPool(uint8_t numThreads, const WorkerPlacement& placement, const std::size_t scratchArenaSize)
+            : m_numThreads(numThreads), m_numWorkerSlots(0), m_numTiedWorkers(0), m_numTaskSlots(0),
+              m_freeTaskSlots(kNoFreeTaskSlots), m_numSharedTasks(0), m_injectedTasks(constants::kInjectionQueueCapacity),
+              m_numPendingTasks(0), m_numParkedWorkers(0),
+              m_stopWorkers(false), m_numUnfinishedTasks(0), m_numWaiters(0), m_numUrgentTasks(0),
+              m_numQueuedTasks(0), m_isElastic(false), m_minNumElasticThreads(0),
+              m_maxNumElasticThreads(0), m_elasticIdleTimeout(0), m_placement(placement), m_scratchArenaSize(scratchArenaSize),
+              m_nodeTasks(placement.GetNumNodes()), m_numNodeTasks(0), m_numScheduledRuns(0),
+              m_isCancellingTasks(false), m_isRejectingTasks(false), m_isShutDown(false),
+              m_externalThreadsHelp(false), m_numExternalRuns(0), m_numExternalStoppedRuns(0),
+              m_lastTimerID(0), m_stopTimers(false), m_timersStartTime(std::chrono::steady_clock::now()),
+              m_queueCapacity(0), m_overflowPolicy(OverflowPolicy::BLOCK), m_numBlockedSubmitters(0), m_numRejectedRuns(0)
+    {
+        InitPriorityDelays();
+        assert(m_numThreads > 0);
+        assert(!placement.isPerNode || (placement.GetNumNodes() > 0 && placement.GetNumNodes() <= constants::kMaxNumNumaNodes));
+        InitTaskPages();
+        InitThreads();
+    }
+    
+    //! Destroys the pool, and deallocates resources
+    ~TinyTasksPool()
+    {
+        assert(GetNumRunningTasks() == 0 && "There are still tasks running. Tasks must be stopped before pool destruction");
+        StopTimers();
+        StopAllThreads();
+        DeleteWorkers();
+        ClearPendingTasks();
+        DeleteTasksAllocations();
+    }
+    
+    //! Changes the number of worker threads in the pool. New workers start
+    //! straight away, and the extra ones retire once their current task
+    //! and their own queue are done
+    //! @param number of worker threads
+    //! @note Tasks tied to a retired worker are queued instead, until a
+    //! worker is started again in its place. A queued run of a tied task
+    //! still has to finish before the task is scheduled again, whichever
+    //! worker takes it (see SetNewLambdaForTask())
+    void Resize(const uint8_t numThreads)
+    {
+        assert(numThreads > 0);
+        
+        std::lock_guard<std::mutex> lock(m_resizeMutex);
+        if(m_stopWorkers) return;
+        
+        SetNumWorkers(m_isElastic ? Clamp(numThreads, m_minNumElasticThreads, m_maxNumElasticThreads) : numThreads);
+    }
+    
+    //! Enables the elastic mode: a worker is added when tasks are queued
+    //! and no workers are free, and the last worker retires after being
+    //! idle for a while
+    //! @param minimum number of worker threads
+    //! @param maximum number of worker threads
+    //! @param time that the last worker waits for tasks before retiring
+    void EnableElasticMode(const uint8_t minNumThreads, const uint8_t maxNumThreads, const std::chrono::milliseconds idleTimeout)
+    {
+        assert(minNumThreads > 0 && minNumThreads <= maxNumThreads);
+        
+        std::lock_guard<std::mutex> lock(m_resizeMutex);
+        if(m_stopWorkers) return;
+        
+        m_minNumElasticThreads = minNumThreads;
+        m_maxNumElasticThreads = maxNumThreads;
+        m_elasticIdleTimeout = idleTimeout.count();
+        m_isElastic = true;
+        
+        SetNumWorkers(Clamp(m_numThreads, minNumThreads, maxNumThreads));
+        
+        //Parked workers start waiting with a timeout
+        WakeUpAllWorkers();
+    }
+    
+    //! Disables the elastic mode, keeping the current number of workers
+    void DisableElasticMode()
+    {
+        std::lock_guard<std::mutex> lock(m_resizeMutex);
+        m_isElastic = false;
+    }
+    
+    //! Gets if the pool is in elastic mode
+    bool IsElastic() const { return m_isElastic; }
+    
+    //! Gets the default number of worker threads (the number of hardware
+    //! threads, within the limits of the pool)
+    static uint8_t GetDefaultNumThreads()
+    {
+        return Clamp(std::thread::hardware_concurrency(), constants::kMinNumThreadsInPool, constants::kMaxNumThreadsInPool);
+    }
+    
+    //! Creates a new task in the pool and assigns a thread to it
+    //! @note It doesn't start the task until you assign a lambda to it
+    //! @note This is a thread safe operation
+    TaskID CreateTask()
+    {
+        TaskEntry* newEntry = nullptr;
+        AllocateTaskEntries(1, &newEntry);
+        
+        return newEntry->id.load(std::memory_order_relaxed);
+    }
+    
+    //! Creates new tasks in the pool in one call, reserving their storage
+    //! at once
+    //! @param number of tasks to create
+    //! @return IDs of the new tasks
+    //! @note It doesn't start the tasks until you assign a lambda to them
+    //! @note This is a thread safe operation
+    std::vector<TaskID> CreateTasks(const uint32_t numTasks)
+    {
+        std::vector<TaskEntry*> newEntries(numTasks);
+        AllocateTaskEntries(numTasks, newEntries.data());
+        
+        std::vector<TaskID> newTaskIDs;
+        newTaskIDs.reserve(numTasks);
+        
+        for(TaskEntry* entry : newEntries)
+        {
+            newTaskIDs.push_back(entry->id.load(std::memory_order_relaxed));
+        }
+        
+        return newTaskIDs;
+    }
+    
+    //! Sets a lambda function to a task, and starts running it (if possible)
+    //! @param ID of the task to set the new lambda to
+    //! @param lambda function to set (has to be valid)
+    //! @note If the task isn't tied to a worker thread, it's queued and
+    //! run as soon as a worker thread is free. A task runs once at a time,
+    //! so ALREADY_SCHEDULED is returned while its previous run is queued
+    //! or running
+    template<typename Function>
+    Result SetNewLambdaForTask(const TaskID taskID, Function&& newLambda)
+    {
+        return SetNewLambdaForTask(taskID, std::forward<Function>(newLambda), CancellationToken());
+    }
+    
+    //! Sets a lambda function to a task, with a cancellation token, and
+    //! starts running it (if possible)
+    //! @param ID of the task to set the new lambda to
+    //! @param lambda function to set (has to be valid). If it takes a
+    //! TaskContext&, it can check the token with TaskContext::IsCancelled()
+    //! @param cancellation token of the run
+    //! @return QUEUE_FULL if the task had to be queued, but the queues are
+    //! full and the overflow policy is REJECT. SUCCEEDED if the task ran
+    //! in the calling thread (see SetQueueCapacity()). ALREADY_SCHEDULED if
+    //! the previous run of the task is still queued or running, so its
+    //! lambda isn't replaced (a run that is finishing is waited for)
+    template<typename Function>
+    Result SetNewLambdaForTask(const TaskID taskID, Function&& newLambda, const CancellationToken& token)
+    {
+        return ScheduleLambda(taskID, std::forward<Function>(newLambda), token, true, m_overflowPolicy);
+    }
+    
+    //! Creates a new task in the pool and runs a lambda in it, only if it
+    //! can be run straight away or queued
+    //! @param lambda function to run (has to be valid)
+    //! @return handle to wait for the task, or an empty handle if the queues
+    //! are full or the pool is shut down
+    //! @note It never blocks, nor runs the task in the calling thread,
+    //! whatever the overflow policy. The task has to be released with
+    //! ReleaseTask() once it's no longer needed
+    template<typename Function>
+    TaskHandle TrySubmit(Function&& lambda)
+    {
+        const TaskID taskID = CreateTask();
+        const Result result = ScheduleLambda(taskID, std::forward<Function>(lambda), CancellationToken(), true, OverflowPolicy::REJECT);
+        
+        return GetSubmittedTaskHandle(taskID, result);
+    }
+    
+    //! Limits the number of tasks waiting in the queues, so the pool
+    //! degrades gracefully under overload instead of growing its queues
+    //! @param maximum number of queued tasks (0 for no limit, the default)
+    //! @param what submitting a task does once the queues are full
+    //! @note The limit applies to the tasks queued by SetNewLambdaForTask()
+    //! and the Submit() functions (the tied tasks aren't queued, and the
+    //! batches, the timers and the tasks of the groups, graphs, futures and
+    //! coroutines aren't limited, as they are waited for). A task lambda submitting with
+    //! the BLOCK policy runs the task itself instead, as the workers could
+    //! all end up waiting for each other
+    void SetQueueCapacity(const uint32_t capacity, const OverflowPolicy policy)
+    {
+        m_queueCapacity = capacity;
+        m_overflowPolicy = policy;
+        
+        //The blocked submitters check the new capacity
+        WakeUpBlockedSubmitters();
+    }
+    
+    //! Gets the maximum number of queued tasks (0 if there's no limit)
+    uint32_t GetQueueCapacity() const { return m_queueCapacity; }
+    
+    //! Creates a new task in the pool and runs a lambda in it
+    //! @param lambda function to run (has to be valid)
+    //! @return handle to wait for the task, or an empty handle if the queues
+    //! are full and the overflow policy is REJECT, or the pool is shut down
+    //! @note The task has to be released with ReleaseTask() once it's
+    //! no longer needed (an empty handle has no task to release)
+    template<typename Function>
+    TaskHandle Submit(Function&& lambda)
+    {
+        const TaskID taskID = CreateTask();
+        const Result result = SetNewLambdaForTask(taskID, std::forward<Function>(lambda));
+        
+        return GetSubmittedTaskHandle(taskID, result);
+    }
+    
+    //! Creates a new task in the pool with a cancellation token, and runs a
+    //! lambda in it
+    //! @param lambda function to run (has to be valid). If it takes a
+    //! TaskContext&, it can check the token with TaskContext::IsCancelled()
+    //! @param cancellation token of the task
+    //! @return handle to wait for the task, or an empty handle if it isn't
+    //! run (as Submit(lambda))
+    //! @note The task has to be released with ReleaseTask() once it's
+    //! no longer needed
+    template<typename Function>
+    TaskHandle Submit(Function&& lambda, const CancellationToken& token)
+    {
+        const TaskID taskID = CreateTask();
+        const Result result = SetNewLambdaForTask(taskID, std::forward<Function>(lambda), token);
+        
+        return GetSubmittedTaskHandle(taskID, result);
+    }
+    
+    //! Creates a new task in the pool with a priority, and runs a lambda in it
+    //! @param lambda function to run (has to be valid)
+    //! @param priority of the task when it's queued
+    //! @return handle to wait for the task, or an empty handle if it isn't
+    //! run (as Submit(lambda))
+    //! @note The task has to be released with ReleaseTask() once it's
+    //! no longer needed
+    template<typename Function>
+    TaskHandle Submit(Function&& lambda, const Priority priority)
+    {
+        const TaskID taskID = CreateTask();
+        SetTaskPriority(taskID, priority);
+        const Result result = SetNewLambdaForTask(taskID, std::forward<Function>(lambda));
+        
+        return GetSubmittedTaskHandle(taskID, result);
+    }
+    
+    //! Creates a new task in the pool with a node hint, and runs a lambda in it
+    //! @param lambda function to run (has to be valid)
+    //! @param NUMA node to run the task on (see SetTaskNode())
+    //! @return handle to wait for the task, or an empty handle if it isn't
+    //! run (as Submit(lambda))
+    //! @note The task has to be released with ReleaseTask() once it's
+    //! no longer needed
+    template<typename Function>
+    TaskHandle SubmitOnNode(Function&& lambda, const uint8_t node)
+    {
+        const TaskID taskID = CreateTask();
+        SetTaskNode(taskID, node);
+        const Result result = SetNewLambdaForTask(taskID, std::forward<Function>(lambda));
+        
+        return GetSubmittedTaskHandle(taskID, result);
+    }
+    
+    //! Sets the NUMA node that a task is run on, when the workers are
+    //! partitioned per node (see WorkerPlacement::PerNumaNode()). The workers
+    //! of the node take the task first, and the other workers only take it
+    //! when they have nothing else to run
+    //! @param ID of the task
+    //! @param node of the task (constants::kAnyNode for no hint)
+    //! @note It applies the next time the task is queued. The hint is
+    //! ignored for high priority tasks and tasks with deadlines, and for
+    //! nodes that the pool doesn't have
+    Result SetTaskNode(const TaskID taskID, const uint8_t node)
+    {
+        TaskEntry* entry = FindTaskEntry(taskID);
+        if(entry == nullptr) return Result::TASK_NOT_FOUND;
+        
+        entry->node = node;
+        return Result::SUCCEEDED;
+    }
+    
+    //! Sets the priority of a task, used when it's queued. Queued tasks are
+    //! dispatched by how long they have waited, weighted by the priority
+    //! (see SetPriorityDelay()), so low priority tasks aren't starved
+    //! @param ID of the task
+    //! @param priority of the task (tasks are created with normal priority)
+    //! @note It applies the next time the task is queued
+    Result SetTaskPriority(const TaskID taskID, const Priority priority)
+    {
+        assert(priority < Priority::NUM_PRIORITIES);
+        
+        TaskEntry* entry = FindTaskEntry(taskID);
+        if(entry == nullptr) return Result::TASK_NOT_FOUND;
+        
+        entry->priority = priority;
+        return Result::SUCCEEDED;
+    }
+    
+    //! Sets the deadline of a task: once queued, it's dispatched before
+    //! the tasks that are due later (whatever their priority)
+    //! @param ID of the task
+    //! @param time by which the task should start running
+    //! @note It applies the next time the task is queued, and it's kept
+    //! until the task is released
+    Result SetTaskDeadline(const TaskID taskID, const std::chrono::steady_clock::time_point deadline)
+    {
+        TaskEntry* entry = FindTaskEntry(taskID);
+        if(entry == nullptr) return Result::TASK_NOT_FOUND;
+        
+        entry->deadline = std::max<int64_t>(deadline.time_since_epoch().count(), 1);
+        return Result::SUCCEEDED;
+    }
+    
+    //! Sets how long a queued task of a priority class waits, compared to
+    //! a high priority task queued at the same time. A task that has waited
+    //! longer than that goes before the high priority tasks queued after it
+    //! @param priority class
+    //! @param delay of the priority class (high priority tasks have none)
+    void SetPriorityDelay(const Priority priority, const std::chrono::milliseconds delay)
+    {
+        assert(priority < Priority::NUM_PRIORITIES);
+        m_priorityDelays[priority] = std::chrono::duration_cast<std::chrono::steady_clock::duration>(delay).count();
+    }
+    
+    //! Creates new tasks in the pool and runs a range of lambdas in them.
+    //! The queued tasks are published at once, so the cost per task
+    //! doesn't depend on the size of the batch
+    //! @param first lambda of the range (use std::make_move_iterator to
+    //! move the lambdas instead of copying them)
+    //! @param end of the range of lambdas
+    //! @return handles to wait for the tasks, in the order of the lambdas
+    //! @note The tasks have to be released with ReleaseTask() once they're
+    //! no longer needed
+    template<typename Iterator>
+    std::vector<TaskHandle> SubmitBatch(Iterator first, Iterator last)
+    {
+        const size_t numTasks = static_cast<size_t>(std::distance(first, last));
+        
+        std::vector<TaskEntry*> newEntries(numTasks);
+        AllocateTaskEntries(static_cast<uint32_t>(numTasks), newEntries.data());
+        
+        std::vector<TaskHandle> handles;
+        handles.reserve(numTasks);
+        
+        std::vector<TaskEntry*> queuedEntries;
+        queuedEntries.reserve(numTasks);
+        
+        //Once shut down, the tasks are created but never run
+        const bool isShutDown = !IsAcceptingTasks();
+        
+        for(TaskEntry* entry : newEntries)
+        {
+            handles.push_back(TaskHandle(this, entry->id.load(std::memory_order_relaxed)));
+            SetTaskLambda(*entry, *first++, CancellationToken());
+            
+            if(isShutDown) continue;
+            
+            //The tasks are new, so nobody else can schedule them meanwhile
+            entry->isScheduled = true;
+            if(entry->tiedWorker && ScheduleTiedTask(*entry)) continue;
+            
+            entry->numActiveRefs++;
+            CountScheduledRun(*entry);
+            queuedEntries.push_back(entry);
+        }
+        
+        PushPendingTasks(queuedEntries.data(), queuedEntries.size());
+        
+        return handles;
+    }
+    
+    //! Blocks the current thread until the runs of a task that were
+    //! scheduled before this call have finished. Called from a task
+    //! lambda (or from any thread, see SetExternalThreadsHelp()), it runs
+    //! queued tasks meanwhile, so nested tasks can't starve the pool
+    //! @param ID of the task
+    //! @note A worker also runs the task tied to it meanwhile, so waiting
+    //! for a task tied to the same worker returns too
+    Result Wait(const TaskID taskID)
+    {
+        TaskEntry* entry = AcquireTaskEntry(taskID);
+        if(entry == nullptr) return Result::TASK_NOT_FOUND;
+        
+        const uint32_t numScheduledRuns = entry->numScheduledRuns;
+        auto hasFinished = [entry, numScheduledRuns]{ return HasFinishedRuns(*entry, numScheduledRuns); };
+        
+        Worker* worker = GetCurrentWorker();
+        if(worker || m_externalThreadsHelp) HelpUntil(worker, hasFinished);
+        else WaitUntil(hasFinished);
+        
+        ReleaseActiveRef(*entry);
+        
+        return Result::SUCCEEDED;
+    }
+    
+    //! Blocks the current thread until the runs of a task that were
+    //! scheduled before this call have finished, or the timeout expires.
+    //! It runs queued tasks meanwhile, as Wait()
+    //! @param ID of the task
+    //! @param maximum time to wait
+    Result WaitFor(const TaskID taskID, const std::chrono::milliseconds timeout)
+    {
+        TaskEntry* entry = AcquireTaskEntry(taskID);
+        if(entry == nullptr) return Result::TASK_NOT_FOUND;
+        
+        const uint32_t numScheduledRuns = entry->numScheduledRuns;
+        auto hasFinishedRuns = [entry, numScheduledRuns]{ return HasFinishedRuns(*entry, numScheduledRuns); };
+        
+        Worker* worker = GetCurrentWorker();
+        const bool hasFinished = worker || m_externalThreadsHelp ? HelpUntil(worker, hasFinishedRuns, timeout) :
+                                                                   WaitUntil(hasFinishedRuns, timeout);
+        ReleaseActiveRef(*entry);
+        
+        return hasFinished ? Result::SUCCEEDED : Result::TIMED_OUT;
+    }
+    
+    //! Sets if the threads of outside the pool run queued tasks while they
+    //! wait for a task with Wait() or WaitFor() (the workers always do)
+    //! @param true to run queued tasks while waiting (false by default)
+    //! @note The runs of the external threads aren't timed in the metrics
+    void SetExternalThreadsHelp(const bool externalThreadsHelp) { m_externalThreadsHelp = externalThreadsHelp; }
+    
+    //! Blocks the current thread until a task reaches a status, or it has
+    //! completed or stopped
+    //! @param ID of the task
+    //! @param status to wait for
+    Result WaitForStatus(const TaskID taskID, const TinyTask::Status status)
+    {
+        TaskEntry* entry = AcquireTaskEntry(taskID);
+        if(entry == nullptr) return Result::TASK_NOT_FOUND;
+        
+        entry->task.WaitForStatus(status);
+        ReleaseActiveRef(*entry);
+        
+        return Result::SUCCEEDED;
+    }
+    
+    //! Blocks the current thread until there are no tasks queued or
+    //! running in the pool
+    //! @note It mustn't be called from a task lambda
+    void WaitAll()
+    {
+        assert(GetCurrentWorker() == nullptr && "Can't wait for all the tasks from a task of the pool");
+        WaitUntil([this]{ return m_numUnfinishedTasks <= 0; });
+    }
+    
+    //! Runs a lambda in a new task once a delay has elapsed
+    //! @param delay before running the lambda (rounded up to milliseconds)
+    //! @param lambda function to run (has to be valid)
+    //! @return ID of the timer to cancel it, or 0 if the pool is shut down
+    //! @note The timers are kept in a timer wheel by a single thread that
+    //! is started with the first timer. The lambda is only queued when
+    //! it's due, and its task is released once it finishes
+    template<typename Function>
+    TimerID ScheduleAfter(const std::chrono::milliseconds delay, Function&& lambda)
+    {
+        return AddTimer(TaskFunction(std::forward<Function>(lambda)), delay, 0);
+    }
+    
+    //! Runs a lambda in a new task every period, starting after the first
+    //! period, until the timer is cancelled
+    //! @param period between runs (has to be greater than 0)
+    //! @param lambda function to run (has to be valid)
+    //! @return ID of the timer to cancel it, or 0 if the pool is shut down
+    //! @note The runs are at a fixed rate. If a run is still going when
+    //! the next one is due, the next one is skipped, so they never overlap
+    template<typename Function>
+    TimerID ScheduleEvery(const std::chrono::milliseconds period, Function&& lambda)
+    {
+        assert(period.count() > 0);
+        return AddTimer(TaskFunction(std::forward<Function>(lambda)), period, static_cast<uint64_t>(period.count()));
+    }
+    
+    //! Cancels a timer, so its lambda isn't run anymore
+    //! @param ID of the timer
+    //! @return false if the timer isn't found (e.g. a one-shot timer has
+    //! been queued already)
+    //! @note A run that is queued or running already isn't stopped
+    bool CancelTimer(const TimerID timerID)
+    {
+        std::lock_guard<std::mutex> lock(m_timersMutex);
+        
+        auto timerIt = m_timers.find(timerID);
+        if(timerIt == m_timers.end()) return false;
+        
+        timerIt->second->isCancelled = true;
+        m_timers.erase(timerIt);
+        
+        return true;
+    }
+    
+    //! Gets the number of timers that haven't expired or been cancelled
+    size_t GetNumTimers()
+    {
+        std::lock_guard<std::mutex> lock(m_timersMutex);
+        return m_timers.size();
+    }
+    
+#if TINYTASKS_ENABLE_COROUTINES
+    //! @brief Awaiter that suspends a coroutine, and resumes it in a task
+    //! of the pool (see Schedule())
+    class ScheduleAwaiter
+    {
+    public:
+        explicit ScheduleAwaiter(TinyTasksPool& pool) : m_pool(pool) {}
+        
+        bool await_ready() const { return false; }
+        
+        //! @return false to resume the coroutine in the current thread, if
+        //! the pool is shut down
+        bool await_suspend(std::coroutine_handle<> handle)
+        {
+            //The coroutine can be resumed, and the awaiter destroyed, before it returns
+            return m_pool.SubmitInternal(CoroutineResume{ handle }) != Result::SHUT_DOWN;
+        }
+        
+        void await_resume() const {}
+        
+    private:
+        TinyTasksPool& m_pool;
+    };
+    
+    //! @brief Awaiter that suspends a coroutine, and resumes it in a task
+    //! of the pool once a delay has elapsed (see Delay())
+    class DelayAwaiter
+    {
+    public:
+        DelayAwaiter(TinyTasksPool& pool, const std::chrono::milliseconds delay) : m_pool(pool), m_delay(delay) {}
+        
+        bool await_ready() const { return m_delay.count() <= 0; }
+        
+        //! @return false to resume the coroutine in the current thread, if
+        //! the timers are stopped (the pool is shut down). If they're
+        //! stopped while it waits, it's resumed by the thread that stops them
+        bool await_suspend(std::coroutine_handle<> handle)
+        {
+            //The coroutine can be resumed, and the awaiter destroyed, before it returns
+            return m_pool.AddTimer(TaskFunction(CoroutineResume{ handle }), m_delay, 0, true) != 0;
+        }
+        
+        void await_resume() const {}
+        
+    private:
+        TinyTasksPool&                  m_pool;
+        std::chrono::milliseconds       m_delay;
+    };
+    
+    //! Gets an awaiter to move a coroutine to the pool: co_await
+    //! pool.Schedule() suspends the coroutine, and resumes it in a task
+    //! @note The worker is free while the coroutine is suspended. If the
+    //! pool is shut down, the coroutine isn't suspended: it goes on in the
+    //! current thread
+    ScheduleAwaiter Schedule() { return ScheduleAwaiter(*this); }
+    
+    //! Gets an awaiter to suspend a coroutine for a delay: co_await
+    //! pool.Delay(delay) doesn't hold a worker meanwhile (see ScheduleAfter())
+    //! @param delay before resuming the coroutine in a task of the pool
+    //! @note If the pool is shut down, the coroutine is resumed in the
+    //! current thread. If it's shut down during the delay, the coroutine is
+    //! resumed by the thread that shuts it down
+    DelayAwaiter Delay(const std::chrono::milliseconds delay) { return DelayAwaiter(*this, delay); }
+#endif
+    
+    //! Shuts down the pool: waits for the tasks that haven't finished and
+    //! stops the worker threads, all woken up at once
+    //! @param DRAIN to run the queued tasks, or CANCEL to stop the running
+    //! and queued tasks, and return once their lambdas exit
+    //! @note Stopping is cooperative, the lambdas have to check
+    //! IsStopping() (or TaskContext::IsCancelled()). The timers are
+    //! cancelled first. Tasks can't be run once the pool is shut down, and
+    //! it mustn't be called from a task lambda
+    Result Shutdown(const ShutdownMode mode)
+    {
+        assert(GetCurrentWorker() == nullptr && "Can't shut down the pool from a task of the pool");
+        
+        StopTimers();
+        if(mode == ShutdownMode::CANCEL) CancelAllTasks();
+        WaitUntil([this]{ return m_numUnfinishedTasks <= 0; });
+        StopAllThreads();
+        
+        return Result::SUCCEEDED;
+    }
+    
+    //! Shuts down the pool, waiting up to a timeout for the tasks that
+    //! haven't finished (see Shutdown(mode))
+    //! @param DRAIN to run the queued tasks, or CANCEL to stop them
+    //! @param maximum time to wait
+    //! @return TIMED_OUT if the tasks didn't finish in time. Then the
+    //! tasks are cancelled (also when draining), and the workers keep
+    //! running until the pool is shut down again or destroyed. New runs of
+    //! tasks get SHUT_DOWN meanwhile, and no timers can be scheduled
+    Result Shutdown(const ShutdownMode mode, const std::chrono::milliseconds timeout)
+    {
+        assert(GetCurrentWorker() == nullptr && "Can't shut down the pool from a task of the pool");
+        
+        StopTimers();
+        if(mode == ShutdownMode::CANCEL) CancelAllTasks();
+        
+        if(!WaitUntil([this]{ return m_numUnfinishedTasks <= 0; }, timeout))
+        {
+            //Rejected first, so no new runs are scheduled after cancelling
+            m_isRejectingTasks = true;
+            CancelAllTasks();
+            return Result::TIMED_OUT;
+        }
+        
+        StopAllThreads();
+        
+        return Result::SUCCEEDED;
+    }
+    
+    //! Gets if the pool has been shut down
+    bool IsShutDown() const { return m_isShutDown; }
+    
+    //! Releases a task, so its storage can be recycled for new tasks
+    //! @param ID of the task
+    //! @note If the task is queued or running, it's recycled once it
+    //! finishes. The task ID and pointer mustn't be used after this call
+    Result ReleaseTask(const TaskID taskID)
+    {
+        //Hold a reference, so the ID can't be recycled while releasing it
+        TaskEntry* entry = AcquireTaskEntry(taskID);
+        if(entry == nullptr) return Result::TASK_NOT_FOUND;
+        
+        uint8_t expectedState = TaskEntry::ALIVE;
+        const bool released = entry->releaseState.compare_exchange_strong(expectedState, TaskEntry::RELEASED);
+        
+        //The last reference recycles the task
+        ReleaseActiveRef(*entry);
+        
+        return released ? Result::SUCCEEDED : Result::TASK_NOT_FOUND;
+    }
+    
+    //! Runs the pending tasks that are in the queue (if possible)
+    //! @note Pending tasks are dispatched automatically by the workers, so
+    //! calling this function is only needed by legacy code
+    Result RunPendingTasks()
+    {
+        if(m_numPendingTasks > 0) WakeUpAllWorkers();
+        
+        return Result::SUCCEEDED;
+    }
+    
+    //! Gets the number of tasks that are currently running
+    uint8_t GetNumRunningTasks() const
+    {
+        uint8_t numRunningTasks = 0;
+        const uint32_t numWorkerSlots = m_numWorkerSlots;
+        
+        for(uint32_t workerIndex = 0; workerIndex < numWorkerSlots; ++workerIndex)
+        {
+            TinyTask* task = m_workers[workerIndex].load()->runningTask.load();
+            if(task && task->IsRunning())
+            {
+                numRunningTasks++;
+            }
+        }
+        
+        return numRunningTasks;
+    }
+
+    //! Gets a task that is in the pool, given its ID
+    //! @param ID of the task
+    //! @note This is a thread safe operation, and it doesn't lock
+    TinyTask* GetTask(const TaskID taskID) const
+    {
+        TaskEntry* entry = FindTaskEntry(taskID);
+        
+        return entry ? &entry->task : nullptr;
+    }
+    
+    //! Gets the status of a task in the pool
+    //! @param ID of the task
+    //! @note This is a thread safe operation, and it doesn't lock
+    TinyTask::Status GetTaskStatus(const TaskID taskID) const
+    {
+        TinyTask* task = GetTask(taskID);
+        assert(task && "Task not found!");
+        
+        return task->GetStatus();
+    }
+    
+    //! Gets the index of a task in the pool, given its ID
+    static uint32_t GetTaskIndex(const TaskID taskID)       { return taskID & constants::kTaskIndexMask; }
+    //! Gets the generation of a task in the pool, given its ID
+    static uint32_t GetTaskGeneration(const TaskID taskID)  { return taskID >> constants::kNumTaskIndexBits; }
+    
+    //! Gets the number of threads in the pool (excluding retiring ones)
+    uint8_t     GetNumThreads()         const { return m_numThreads; }
+    //! Gets the number of NUMA nodes that the workers are partitioned on
+    uint8_t     GetNumNodes()           const { return m_placement.GetNumNodes(); }
+    //! Gets the size in bytes of the scratch arena of each worker
+    std::size_t GetScratchArenaSize()   const { return m_scratchArenaSize; }
+    //! Gets the node of the worker running in the calling thread
+    //! @return constants::kAnyNode if the calling thread isn't a worker of this pool
+    uint8_t     GetCurrentNode()        const
+    {
+        const Worker* worker = GetCurrentWorker();
+        return worker ? worker->node : constants::kAnyNode;
+    }
+    //! Gets the number of pending tasks that are queued in the pool
+    uint16_t    GetNumPendingTasks()    const { return static_cast<uint16_t>(m_numPendingTasks.load()); }
+    
+    //! Takes a snapshot of the metrics of the pool, while it keeps running.
+    //! The counters of each worker are read without locking, so the totals
+    //! can be slightly behind the runs in progress
+    //! @note The latency histograms are empty if TINYTASKS_ENABLE_METRICS is 0
+    Metrics GetMetrics() const
+    {
+        Metrics metrics;
+        metrics.numScheduledRuns = m_numScheduledRuns.load(std::memory_order_relaxed);
+        metrics.numStoppedRuns = m_numExternalStoppedRuns.load(std::memory_order_relaxed);
+        metrics.numExternalRuns = m_numExternalRuns.load(std::memory_order_relaxed);
+        metrics.numCompletedRuns = metrics.numExternalRuns;
+        metrics.numRejectedRuns = m_numRejectedRuns.load(std::memory_order_relaxed);
+        metrics.numPendingTasks = m_numPendingTasks;
+        metrics.numRunningTasks = GetNumRunningTasks();
+        metrics.numThreads = m_numThreads;
+        metrics.numParkedWorkers = static_cast<uint8_t>(m_numParkedWorkers.load());
+        
+        const uint32_t numWorkerSlots = m_numWorkerSlots;
+        
+        for(uint32_t workerIndex = 0; workerIndex < numWorkerSlots; ++workerIndex)
+        {
+            const Worker& worker = *m_workers[workerIndex].load();
+            
+            WorkerMetrics workerMetrics;
+            workerMetrics.index = worker.index;
+            workerMetrics.node = worker.node;
+            workerMetrics.isActive = worker.index < metrics.numThreads;
+            workerMetrics.queueLength = worker.queue.GetSize();
+            workerMetrics.numCompletedRuns = worker.numCompletedRuns.load(std::memory_order_relaxed);
+            workerMetrics.numStoppedRuns = worker.numStoppedRuns.load(std::memory_order_relaxed);
+            workerMetrics.numScratchArenaOverflows = worker.scratchArena.GetNumOverflows();
+            metrics.workers.push_back(workerMetrics);
+            
+            metrics.numCompletedRuns += workerMetrics.numCompletedRuns;
+            metrics.numStoppedRuns += workerMetrics.numStoppedRuns;
+            metrics.queueWaitTimes.Merge(worker.queueWaitTimes.GetSnapshot());
+            metrics.runTimes.Merge(worker.runTimes.GetSnapshot());
+        }
+        
+        return metrics;
+    }
+    
+private:
+    friend class TaskGroup;
+    friend class TaskGraph;
+    template<typename> friend class FutureState;
+    template<typename> friend class ParallelRange;
+    template<typename Function> friend Future<typename std::result_of<typename std::decay<Function>::type&()>::type> Async(TinyTasksPool&, Function&&);
+    
+    struct Worker;
+    
+    //! Task owned by the pool, and its scheduling state
+    struct TaskEntry
+    {
+        //! Possible release states of the task
+        enum ReleaseState : uint8_t
+        {
+            ALIVE,
+            RELEASED,
+            RECYCLED,
+        };
+        
+        TaskEntry() : task(constants::kInvalidTaskID), id(constants::kInvalidTaskID), index(0), generation(0),
+                      tiedWorker(nullptr), isScheduled(false), numActiveRefs(0), releaseState(RECYCLED),
+                      nextFreeIndex(0), numScheduledRuns(0), numFinishedRuns(0),
+                      priority(Priority::NORMAL), deadline(0), node(constants::kAnyNode), scheduledTime(0) {}
+        
+        TinyTask                task;
+        std::atomic<TaskID>     id;
+        uint32_t                index;
+        uint32_t                generation;
+        Worker*                 tiedWorker;
+        //! A run is scheduled and hasn't finished (it's queued or running)
+        std::atomic<bool>       isScheduled;
+        std::atomic<uint32_t>   numActiveRefs;
+        std::atomic<uint8_t>    releaseState;
+        std::atomic<uint32_t>   nextFreeIndex;
+        std::atomic<uint32_t>   numScheduledRuns;
+        std::atomic<uint32_t>   numFinishedRuns;
+        std::atomic<uint8_t>    priority;
+        std::atomic<int64_t>    deadline;
+        std::atomic<uint8_t>    node;
+        std::atomic<int64_t>    scheduledTime;
+    };
+    
+    //! Task in the shared queue, ordered by the time it's due
+    struct PendingTask
+    {
+        TaskEntry*  entry;
+        int64_t     dueTime;
+        uint64_t    sequence;
+        bool        isUrgent;
+    };
+    
+    //! Orders the shared queue so the task due first is on top (and the
+    //! first queued one, if they're due at the same time)
+    struct IsDueLater
+    {
+        bool operator()(const PendingTask& left, const PendingTask& right) const
+        {
+            return left.dueTime != right.dueTime ? left.dueTime > right.dueTime : left.sequence > right.sequence;
+        }
+    };
+    
+    //! Queue of the tasks that are shared by all the workers
+    typedef std::priority_queue<PendingTask, std::vector<PendingTask>, IsDueLater> SharedQueue;
+    
+    //! Long-lived worker thread, with its own queue of tasks
+    struct Worker
+    {
+        //! Possible states of the run of the tied task. A retired worker
+        //! doesn't take runs, so its tied task is queued instead
+        enum TiedRunState : uint8_t
+        {
+            NO_RUN,
+            SCHEDULED_RUN,
+            RETIRED,
+        };
+        
+        Worker(const uint8_t workerIndex, const uint8_t workerNode, const std::vector<uint32_t>& workerCPUs, const std::size_t scratchArenaSize)
+                : index(workerIndex), node(workerNode), cpus(workerCPUs), tiedEntry(nullptr), runningTask(nullptr),
+                  tiedRunState(NO_RUN), queue(constants::kWorkerQueueCapacity), scratchArena(scratchArenaSize),
+                  numCompletedRuns(0), numStoppedRuns(0) {}
+
+        const uint8_t                   index;
+        const uint8_t                   node;
+        const std::vector<uint32_t>     cpus;
+        std::thread                     thread;
+        std::atomic<TaskEntry*>         tiedEntry;
+        std::atomic<TinyTask*>          runningTask;
+        std::atomic<uint8_t>            tiedRunState;
+        WorkStealingQueue<TaskEntry>    queue;
+        //Only used by the worker thread, for the tasks it runs
+        ScratchArena                    scratchArena;
+        
+        //Metrics, only written by the worker thread
+        std::atomic<uint64_t>           numCompletedRuns;
+        std::atomic<uint64_t>           numStoppedRuns;
+        LatencyHistogram                queueWaitTimes;
+        LatencyHistogram                runTimes;
+    };
+    
+    //! Possible results of parking a worker
+    enum ParkResult
+    {
+        WAKE_UP,
+        IDLE_TIMEOUT,
+        STOP,
+    };
+    
+    //! Block of consecutive task entries in the table of tasks
+    struct TaskPage : public CacheLineAligned
+    {
+        TaskEntry entries[constants::kNumTasksPerPage];
+    };
+    
+    //! Pool and worker running in the current thread (if any)
+    struct WorkerContext
+    {
+        const TinyTasksPool*    pool;
+        Worker*                 worker;
+    };
+    
+    //! Head of the list of free task slots: the ABA tag is in the upper
+    //! 32 bits, and the index of the first free slot in the lower ones
+    static const uint64_t kNoFreeTaskSlots = UINT32_MAX;
+    
+    //! Makes a task ID from the index and the generation of its slot
+    static TaskID MakeTaskID(const uint32_t index, const uint32_t generation)
+    {
+        return ((generation & constants::kTaskIndexMask) << constants::kNumTaskIndexBits) | index;
+    }
+
+    //! Initialises the table of tasks (pages are allocated on demand)
+    void InitTaskPages()
+    {
+        for(auto& page : m_taskPages)
+        {
+            page.store(nullptr, std::memory_order_relaxed);
+        }
+    }
+    
+    //! Gets the page of the table of tasks for a task index, and allocates
+    //! it if it doesn't exist yet
+    TaskPage& GetTaskPage(const uint32_t taskIndex)
+    {
+        std::atomic<TaskPage*>& pageSlot = m_taskPages[taskIndex / constants::kNumTasksPerPage];
+        TaskPage* page = pageSlot.load(std::memory_order_acquire);
+        
+        if(page == nullptr)
+        {
+            //Several threads could race to allocate the page, so only one wins
+            TaskPage* newPage = new TaskPage();
+            if(pageSlot.compare_exchange_strong(page, newPage, std::memory_order_acq_rel, std::memory_order_acquire))
+            {
+                page = newPage;
+            }
+            else
+            {
+                delete newPage;
+            }
+        }
+        
+        return *page;
+    }
+    
+    //! Gets the entry of a task slot, given its index
+    //! @note The page of the slot has to exist
+    TaskEntry& GetTaskEntry(const uint32_t taskIndex) const
+    {
+        TaskPage* page = m_taskPages[taskIndex / constants::kNumTasksPerPage].load(std::memory_order_acquire);
+        assert(page);
+        
+        return page->entries[taskIndex % constants::kNumTasksPerPage];
+    }
+    
+    //! Allocates the entries for new tasks: free slots are reused first,
+    //! and the rest are reserved at once from the unused slots
+    //! @param number of entries to allocate
+    //! @param array where the initialised entries are written
+    void AllocateTaskEntries(const uint32_t numEntries, TaskEntry** newEntries)
+    {
+        uint32_t numAllocatedEntries = 0;
+        
+        while(numAllocatedEntries < numEntries)
+        {
+            TaskEntry* entry = PopFreeTaskSlot();
+            if(entry == nullptr) break;
+            
+            newEntries[numAllocatedEntries++] = entry;
+        }
+        
+        const uint32_t numNewSlots = numEntries - numAllocatedEntries;
+        
+        if(numNewSlots > 0)
+        {
+            const uint32_t firstIndex = m_numTaskSlots.fetch_add(numNewSlots);
+            assert(firstIndex + numNewSlots <= constants::kMaxNumTasksInPool && "Can't create more tasks. Ran out of IDs");
+            
+            for(uint32_t newIndex = firstIndex; newIndex < firstIndex + numNewSlots; ++newIndex)
+            {
+                TaskEntry& entry = GetTaskPage(newIndex).entries[newIndex % constants::kNumTasksPerPage];
+                entry.index = newIndex;
+                newEntries[numAllocatedEntries++] = &entry;
+            }
+        }
+        
+        for(uint32_t entryIndex = 0; entryIndex < numEntries; ++entryIndex)
+        {
+            InitTaskEntry(*newEntries[entryIndex]);
+        }
+    }
+    
+    //! Initialises the entry of a new task, and publishes its ID
+    void InitTaskEntry(TaskEntry& entry)
+    {
+        const TaskID newTaskID = MakeTaskID(entry.index, entry.generation);
+        entry.task.Reset(newTaskID);
+        entry.releaseState = TaskEntry::ALIVE;
+        entry.priority = Priority::NORMAL;
+        entry.deadline = 0;
+        entry.node = constants::kAnyNode;
+        
+        //Tie the task to a worker thread while there are workers without one.
+        //Otherwise it will be queued once it has a lambda to run. It can be
+        //the worker creating it, which runs it if it waits for it
+        size_t workerIndex = m_numTiedWorkers.load();
+        while(workerIndex < m_numWorkerSlots)
+        {
+            if(m_numTiedWorkers.compare_exchange_weak(workerIndex, workerIndex + 1))
+            {
+                Worker& worker = *m_workers[workerIndex].load();
+                worker.tiedEntry = &entry;
+                entry.tiedWorker = &worker;
+                break;
+            }
+        }
+        
+        entry.id.store(newTaskID, std::memory_order_release);
+        TINYTASKS_TRACE(CREATED, newTaskID);
+    }
+    
+    //! Takes a slot from the list of free task slots (lock-free)
+    //! @return nullptr if there aren't free slots
+    TaskEntry* PopFreeTaskSlot()
+    {
+        uint64_t head = m_freeTaskSlots.load();
+        
+        while(static_cast<uint32_t>(head) != UINT32_MAX)
+        {
+            TaskEntry& entry = GetTaskEntry(static_cast<uint32_t>(head));
+            const uint64_t newHead = ((head >> 32) + 1) << 32 | entry.nextFreeIndex.load();
+            
+            if(m_freeTaskSlots.compare_exchange_weak(head, newHead)) return &entry;
+        }
+        
+        return nullptr;
+    }
+    
+    //! Returns a slot to the list of free task slots (lock-free)
+    void PushFreeTaskSlot(TaskEntry& entry)
+    {
+        uint64_t head = m_freeTaskSlots.load();
+        uint64_t newHead = 0;
+        
+        do
+        {
+            entry.nextFreeIndex = static_cast<uint32_t>(head);
+            newHead = ((head >> 32) + 1) << 32 | entry.index;
+        }
+        while(!m_freeTaskSlots.compare_exchange_weak(head, newHead));
+    }
+    
+    //! Recycles a released task, if nothing refers to it anymore.
+    //! Otherwise it's recycled when the last reference is dropped
+    void RecycleTask(TaskEntry& entry)
+    {
+        while(true)
+        {
+            if(entry.numActiveRefs != 0) return;
+            
+            //Either the releasing thread or the last reference recycles it, not both
+            uint8_t expectedState = TaskEntry::RELEASED;
+            if(!entry.releaseState.compare_exchange_strong(expectedState, TaskEntry::RECYCLED)) return;
+            
+            //A reference taken meanwhile (or dropped from a previous use of the
+            //slot) means the task isn't free yet, so let the reference recycle it
+            if(entry.numActiveRefs == 0) break;
+            entry.releaseState = TaskEntry::RELEASED;
+        }
+        
+        entry.id.store(constants::kInvalidTaskID, std::memory_order_release);
+        entry.generation++;
+        entry.task.Reset(constants::kInvalidTaskID);
+        
+        if(entry.tiedWorker)
+        {
+            entry.tiedWorker->tiedEntry = nullptr;
+            entry.tiedWorker = nullptr;
+        }
+        
+        PushFreeTaskSlot(entry);
+    }
+    
+    //! Drops a reference to a task entry, and recycles the task if it was
+    //! released meanwhile
+    void ReleaseActiveRef(TaskEntry& entry)
+    {
+        if(--entry.numActiveRefs == 0 && entry.releaseState == TaskEntry::RELEASED)
+        {
+            RecycleTask(entry);
+        }
+    }
+    
+    //! Initialises the worker threads for the pool
+    void InitThreads()
+    {
+        for(auto& worker : m_workers)
+        {
+            worker.store(nullptr, std::memory_order_relaxed);
+        }
+        
+        std::lock_guard<std::mutex> lock(m_resizeMutex);
+        
+        const uint8_t numThreads = m_numThreads;
+        m_numThreads = 0;
+        SetNumWorkers(numThreads);
+    }
+    
+    //! Clamps a number of threads to a range
+    static uint8_t Clamp(const unsigned int numThreads, const uint8_t minNumThreads, const uint8_t maxNumThreads)
+    {
+        return static_cast<uint8_t>(std::max<unsigned int>(minNumThreads, std::min<unsigned int>(numThreads, maxNumThreads)));
+    }
+    
+    //! Starts or retires workers, so there are a number of them running
+    //! @note The resize mutex has to be locked
+    void SetNumWorkers(const uint8_t numThreads)
+    {
+        //Workers are allocated once, and kept until the pool is destroyed, so
+        //any thread can steal from them without locking
+        for(uint8_t workerIndex = m_numThreads; workerIndex < numThreads; ++workerIndex)
+        {
+            Worker* worker = m_workers[workerIndex].load();
+            
+            if(worker == nullptr)
+            {
+                worker = NewWorker(workerIndex);
+                m_workers[workerIndex].store(worker);
+                m_numWorkerSlots = workerIndex + 1u;
+            }
+            else if(worker->tiedRunState != Worker::RETIRED)
+            {
+                //It was retiring, but it hasn't retired yet
+                continue;
+            }
+            else
+            {
+                worker->thread.join();
+                worker->tiedRunState = Worker::NO_RUN;
+            }
+            
+            worker->thread = std::thread(&TinyTasksPool::RunWorker, this, worker);
+        }
+        
+        const bool isShrinking = numThreads < m_numThreads;
+        m_numThreads = numThreads;
+        
+        //The extra workers retire once they're woken up
+        if(isShrinking) WakeUpAllWorkers();
+    }
+    
+    //! Allocates a worker, placed on the CPUs as set when the pool was created
+    Worker* NewWorker(const uint8_t workerIndex) const
+    {
+        const std::vector<std::vector<uint32_t>>& cpuSets = m_placement.cpuSets;
+        if(cpuSets.empty()) return new Worker(workerIndex, 0, std::vector<uint32_t>(), m_scratchArenaSize);
+        
+        const uint8_t setIndex = workerIndex % cpuSets.size();
+        return new Worker(workerIndex, m_placement.isPerNode ? setIndex : 0, cpuSets[setIndex], m_scratchArenaSize);
+    }
+    
+    //! Retires a worker if it's beyond the number of workers, and it doesn't
+    //! have a tied run or tasks in its queue
+    //! @return true if the worker has retired, so its thread has to finish
+    bool TryRetireWorker(Worker& worker, const bool isIdle)
+    {
+        std::lock_guard<std::mutex> lock(m_resizeMutex);
+        
+        //In elastic mode, only the last worker retires when it's idle, so the
+        //running workers are always the first ones
+        if(isIdle && m_isElastic && !m_stopWorkers && worker.index + 1u == m_numThreads && m_numThreads > m_minNumElasticThreads)
+        {
+            m_numThreads--;
+        }
+        
+        if(worker.index < m_numThreads || !worker.queue.IsEmpty()) return false;
+        
+        uint8_t noRun = Worker::NO_RUN;
+        if(!worker.tiedRunState.compare_exchange_strong(noRun, Worker::RETIRED)) return false;
+        
+        worker.runningTask = nullptr;
+        return true;
+    }
+    
+    //! Adds a worker in elastic mode, if tasks are queued and there are no
+    //! free workers to take them
+    void GrowElasticWorkers()
+    {
+        if(!m_isElastic || m_numParkedWorkers > 0 || m_numPendingTasks <= m_numThreads) return;
+        if(m_numThreads >= m_maxNumElasticThreads) return;
+        
+        //Another thread is resizing already
+        std::unique_lock<std::mutex> lock(m_resizeMutex, std::try_to_lock);
+        if(!lock.owns_lock() || m_stopWorkers || !m_isElastic) return;
+        
+        if(m_numThreads < m_maxNumElasticThreads) SetNumWorkers(m_numThreads + 1);
+    }
+    
+    //! Gets the worker context of the calling thread
+    static WorkerContext& CurrentWorkerContext()
+    {
+        static thread_local WorkerContext context = { nullptr, nullptr };
+        return context;
+    }
+    
+    //! Gets the worker of this pool running in the calling thread
+    //! @return nullptr if the calling thread isn't a worker of this pool
+    Worker* GetCurrentWorker() const
+    {
+        const WorkerContext& context = CurrentWorkerContext();
+        
+        return context.pool == this ? context.worker : nullptr;
+    }
+    
+    //! Finds the entry of a task in the pool (wait-free)
+    //! @return nullptr if the task doesn't exist or was released
+    TaskEntry* FindTaskEntry(const TaskID taskID) const
+    {
+        const uint32_t taskIndex = GetTaskIndex(taskID);
+        if(taskIndex >= constants::kMaxNumTasksInPool) return nullptr;
+        
+        TaskPage* page = m_taskPages[taskIndex / constants::kNumTasksPerPage].load(std::memory_order_acquire);
+        if(page == nullptr) return nullptr;
+        
+        TaskEntry& entry = page->entries[taskIndex % constants::kNumTasksPerPage];
+        if(entry.id.load(std::memory_order_acquire) != taskID) return nullptr;
+        
+        //A released task keeps its ID until the last reference recycles it
+        return entry.releaseState == TaskEntry::ALIVE ? &entry : nullptr;
+    }
+    
+    //! Finds the entry of a task, and holds a reference to it so it isn't
+    //! recycled while it's used
+    //! @return nullptr if the task doesn't exist or was released
+    TaskEntry* AcquireTaskEntry(const TaskID taskID)
+    {
+        TaskEntry* entry = FindTaskEntry(taskID);
+        if(entry == nullptr) return nullptr;
+        
+        entry->numActiveRefs++;
+        
+        if(entry->id != taskID)
+        {
+            ReleaseActiveRef(*entry);
+            return nullptr;
+        }
+        
+        return entry;
+    }
+    
+    //! Counts a new run of a task, before it can be taken by a worker.
+    //! A tied task could finish its run before being counted, but the
+    //! counts of the task are only compared once the scheduling call returns
+    //! (the count of the pool goes first, see ScheduleTiedTask())
+    void CountScheduledRun(TaskEntry& entry, const bool isCountedInPool = false)
+    {
+        entry.numScheduledRuns++;
+        if(!isCountedInPool) m_numUnfinishedTasks++;
+        m_numScheduledRuns.fetch_add(1, std::memory_order_relaxed);
+    }
+    
+    //! Counts a finished run of a task, and wakes up the waiting threads
+    void CountFinishedRun(TaskEntry& entry)
+    {
+        //Cleared before the run is counted, so the task can be scheduled
+        //again as soon as the run is waited for
+        entry.isScheduled = false;
+        entry.numFinishedRuns++;
+        m_numUnfinishedTasks--;
+        NotifyWaiters();
+    }
+    
+    //! Wakes up the threads waiting for runs to finish
+    void NotifyWaiters()
+    {
+        //Waiters are counted before checking the runs, so either they see
+        //the finished run or they are woken up here
+        if(m_numWaiters == 0) return;
+        
+        std::lock_guard<std::mutex> lock(m_waitMutex);
+        m_waitCondition.notify_all();
+    }
+    
+    //! Gets if the runs of a task, up to a number of scheduled runs, have
+    //! finished (the counters can wrap around)
+    static bool HasFinishedRuns(const TaskEntry& entry, const uint32_t numScheduledRuns)
+    {
+        return static_cast<int32_t>(entry.numFinishedRuns - numScheduledRuns) >= 0;
+    }
+    
+    //! Blocks the current thread until the predicate on the finished runs
+    //! is met
+    template<typename Predicate>
+    void WaitUntil(Predicate predicate)
+    {
+        if(predicate()) return;
+        
+        m_numWaiters++;
+        {
+            std::unique_lock<std::mutex> lock(m_waitMutex);
+            m_waitCondition.wait(lock, predicate);
+        }
+        m_numWaiters--;
+    }
+    
+    //! Blocks the current thread until the predicate on the finished runs
+    //! is met, or the timeout expires
+    //! @return false if the timeout expired
+    template<typename Predicate>
+    bool WaitUntil(Predicate predicate, const std::chrono::milliseconds timeout)
+    {
+        if(predicate()) return true;
+        
+        bool isMet = false;
+        m_numWaiters++;
+        {
+            std::unique_lock<std::mutex> lock(m_waitMutex);
+            isMet = m_waitCondition.wait_for(lock, timeout, predicate);
+        }
+        m_numWaiters--;
+        
+        return isMet;
+    }
+    
+    //! Marks the task tied to a worker as ready, and wakes up the worker
+    //! @return false if the worker has retired, so the task has to be queued
+    //! @note The previous run of the task has finished (see isScheduled),
+    //! so the worker has no tied run left, even if the previous run was
+    //! queued because the worker had retired and it restarted meanwhile
+    bool ScheduleTiedTask(TaskEntry& entry)
+    {
+        Worker& worker = *entry.tiedWorker;
+        assert(worker.tiedEntry == &entry);
+        
+        //The reference goes first, so the worker can't drop it before it's taken
+        entry.numActiveRefs++;
+        TINYTASKS_TRACE(SCHEDULED, entry.task.GetID());
+#if TINYTASKS_ENABLE_METRICS
+        entry.scheduledTime.store(GetTimeNow(), std::memory_order_relaxed);
+#endif
+        
+        //The run is counted in the pool before the worker can take it, so
+        //WaitAll() from other threads (e.g. while the timers thread submits)
+        //can't see it finished before it's counted
+        m_numUnfinishedTasks++;
+        
+        uint8_t tiedRunState = Worker::NO_RUN;
+        if(!worker.tiedRunState.compare_exchange_strong(tiedRunState, Worker::SCHEDULED_RUN))
+        {
+            assert(tiedRunState == Worker::RETIRED && "The previous run of the tied task hasn't finished");
+            m_numUnfinishedTasks--;
+            NotifyWaiters();
+            ReleaseActiveRef(entry);
+            return false;
+        }
+        
+        CountScheduledRun(entry, true);
+        
+        WakeUpAllWorkers();
+        return true;
+    }
+    
+    //! Sets a lambda function to a task, and starts running it or queues it
+    //! (see SetNewLambdaForTask())
+    //! @param whether the capacity of the queues applies
+    //! @param what to do if the queues are full
+    template<typename Function>
+    Result ScheduleLambda(const TaskID taskID, Function&& newLambda, const CancellationToken& token, const bool isBounded,
+                          const OverflowPolicy policy)
+    {
+        //Hold a reference, so the task can't be recycled meanwhile
+        TaskEntry* entry = AcquireTaskEntry(taskID);
+        if(entry == nullptr) return Result::TASK_NOT_FOUND;
+        
+        if(entry->releaseState != TaskEntry::ALIVE)
+        {
+            ReleaseActiveRef(*entry);
+            return Result::TASK_NOT_FOUND;
+        }
+        
+        if(!IsAcceptingTasks())
+        {
+            ReleaseActiveRef(*entry);
+            return Result::SHUT_DOWN;
+        }
+        
+        //The lambda can't be replaced while a run of the task is queued or
+        //running. Once the lambda of the run has returned (the task has
+        //completed or stopped), the run is only finishing, so wait for it
+        TinyTask& task = entry->task;
+        while(entry->isScheduled.exchange(true))
+        {
+            if(!task.HasCompleted() && !task.HasStopped())
+            {
+                ReleaseActiveRef(*entry);
+                return Result::ALREADY_SCHEDULED;
+            }
+            
+            std::this_thread::yield();
+        }
+        
+        //Paused while it's queued, so it doesn't look finished
+        task.SetStatus(TinyTask::Status::PAUSED);
+        SetTaskLambda(*entry, std::forward<Function>(newLambda), token);
+        
+        Result result = Result::SUCCEEDED;
+        
+        if(!entry->tiedWorker || !ScheduleTiedTask(*entry))
+        {
+            result = isBounded ? QueueBoundedTask(*entry, policy) : QueueTask(*entry);
+        }
+        
+        ReleaseActiveRef(*entry);
+        
+        return result;
+    }
+    
+    //! Gets if new runs of tasks are scheduled (the pool isn't shut down,
+    //! and a shutdown hasn't timed out)
+    bool IsAcceptingTasks() const { return !m_isShutDown && !m_isRejectingTasks; }
+    
+    //! Creates a task that runs a lambda of the library (e.g. a task of a
+    //! group, or the continuation of a graph), and releases it. The capacity
+    //! of the queues doesn't apply, as rejecting the lambda would leave the
+    //! threads waiting for it blocked
+    //! @return result of scheduling the lambda
+    template<typename Function>
+    Result SubmitInternal(Function&& lambda, const CancellationToken& token = CancellationToken())
+    {
+        const TaskID taskID = CreateTask();
+        const Result result = ScheduleLambda(taskID, std::forward<Function>(lambda), token, false, OverflowPolicy::BLOCK);
+        ReleaseTask(taskID);
+        
+        return result;
+    }
+    
+    //! Queues a task, whatever the capacity of the queues
+    Result QueueTask(TaskEntry& entry)
+    {
+        entry.numActiveRefs++;
+        CountScheduledRun(entry);
+        PushPendingTask(&entry);
+        
+        return Result::SUCCEEDED_AT_QUEUE;
+    }
+    
+    //! Queues a task if there's room in the queues, or else applies the
+    //! overflow policy
+    //! @return SUCCEEDED_AT_QUEUE, SUCCEEDED if the task ran in the current
+    //! thread, QUEUE_FULL, or SHUT_DOWN if the pool stopped while waiting
+    Result QueueBoundedTask(TaskEntry& entry, OverflowPolicy policy)
+    {
+        Worker* currentWorker = GetCurrentWorker();
+        if(policy == OverflowPolicy::BLOCK && currentWorker) policy = OverflowPolicy::RUN_IN_CALLER;
+        
+        if(ReserveQueueSlot() || (policy == OverflowPolicy::BLOCK && WaitForQueueSlot()))
+        {
+            entry.numActiveRefs++;
+            CountScheduledRun(entry);
+            TaskEntry* entryPointer = &entry;
+            PushPendingTasks(&entryPointer, 1, true);
+            return Result::SUCCEEDED_AT_QUEUE;
+        }
+        
+        if(policy == OverflowPolicy::RUN_IN_CALLER)
+        {
+            entry.numActiveRefs++;
+            CountScheduledRun(entry);
+            TINYTASKS_TRACE(SCHEDULED, entry.task.GetID());
+#if TINYTASKS_ENABLE_METRICS
+            entry.scheduledTime.store(GetTimeNow(), std::memory_order_relaxed);
+#endif
+            RunInCurrentThread(currentWorker, entry);
+            return Result::SUCCEEDED;
+        }
+        
+        entry.isScheduled = false;
+        m_numRejectedRuns.fetch_add(1, std::memory_order_relaxed);
+        return m_stopWorkers ? Result::SHUT_DOWN : Result::QUEUE_FULL;
+    }
+    
+    //! Counts a task in the pending ones, unless the queues are full
+    //! @return false if the queues are full
+    bool ReserveQueueSlot()
+    {
+        const uint32_t capacity = m_queueCapacity;
+        uint32_t numPendingTasks = m_numPendingTasks;
+        
+        do
+        {
+            if(capacity != 0 && numPendingTasks >= capacity) return false;
+        }
+        while(!m_numPendingTasks.compare_exchange_weak(numPendingTasks, numPendingTasks + 1));
+        
+        return true;
+    }
+    
+    //! Blocks the current thread until there's room in the queues
+    //! @return false if the pool stopped meanwhile
+    bool WaitForQueueSlot()
+    {
+        bool hasSlot = false;
+        
+        //Blocked submitters are counted before checking the queues, so either
+        //they see the room or they are woken up when a task is taken
+        m_numBlockedSubmitters++;
+        {
+            std::unique_lock<std::mutex> lock(m_queueSlotMutex);
+            m_queueSlotCondition.wait(lock, [this, &hasSlot]
+            {
+                hasSlot = ReserveQueueSlot();
+                return hasSlot || m_stopWorkers;
+            });
+        }
+        m_numBlockedSubmitters--;
+        
+        return hasSlot;
+    }
+    
+    //! Wakes up all the threads waiting for room in the queues
+    void WakeUpBlockedSubmitters()
+    {
+        std::lock_guard<std::mutex> lock(m_queueSlotMutex);
+        m_queueSlotCondition.notify_all();
+    }
+    
+    //! Queues a task to be run by the first free worker. If called from a
+    //! worker thread, the task goes to the queue of that worker
+    void PushPendingTask(TaskEntry* entry)
+    {
+        PushPendingTasks(&entry, 1);
+    }
+    
+    //! Queues tasks to be run by the free workers, locking the shared queue
+    //! once at most. If called from a worker thread, the tasks go to the
+    //! queue of that worker until it's full
+    //! @param whether the tasks are counted in the pending ones already
+    //! (see ReserveQueueSlot())
+    void PushPendingTasks(TaskEntry* const* entries, const size_t numEntries, const bool areCounted = false)
+    {
+        if(numEntries == 0) return;
+        
+        //The counter goes first, so it never underflows when the tasks are taken
+        if(!areCounted) m_numPendingTasks += static_cast<uint32_t>(numEntries);
+        
+        Worker* currentWorker = GetCurrentWorker();
+        const int64_t now = GetTimeNow();
+        std::unique_lock<std::mutex> lock(m_pendingTasksMutex, std::defer_lock);
+        bool hasNodeTasks = false;
+        
+        for(size_t entryIndex = 0; entryIndex < numEntries; ++entryIndex)
+        {
+            TaskEntry* entry = entries[entryIndex];
+            entry->scheduledTime.store(now, std::memory_order_relaxed);
+            TINYTASKS_TRACE(SCHEDULED, entry->task.GetID());
+            const uint8_t priority = entry->priority;
+            const int64_t deadline = entry->deadline;
+            
+            const uint8_t node = entry->node;
+            const bool isNodeTask = node < m_nodeTasks.size() && m_nodeTasks.size() > 1;
+            
+            //Only normal priority tasks go to the queue of the worker, which
+            //is dispatched in any order
+            if(priority == Priority::NORMAL && deadline == 0)
+            {
+                if(currentWorker && (!isNodeTask || currentWorker->node == node) && currentWorker->queue.Push(entry)) continue;
+                
+                if(isNodeTask)
+                {
+                    if(!lock.owns_lock()) lock.lock();
+                    
+                    m_nodeTasks[node].push_back(entry);
+                    m_numNodeTasks++;
+                    hasNodeTasks = true;
+                    continue;
+                }
+                
+                //The tasks of outside the workers (or of a worker with a full
+                //queue) go to the injection queue, which doesn't lock
+                if(m_injectedTasks.Push(entry)) continue;
+            }
+            
+            int64_t dueTime = now + m_priorityDelays[priority];
+            if(deadline != 0) dueTime = std::min(dueTime, deadline);
+            
+            const bool isUrgent = priority == Priority::HIGH || deadline != 0;
+            if(isUrgent) m_numUrgentTasks++;
+            
+            if(!lock.owns_lock()) lock.lock();
+            
+            PendingTask pendingTask = { entry, dueTime, m_numQueuedTasks++, isUrgent };
+            m_pendingTasks.push(pendingTask);
+            m_numSharedTasks++;
+        }
+        
+        if(lock.owns_lock()) lock.unlock();
+        
+        //Any worker can be woken up for a single task, which could be on another node
+        if(numEntries == 1 && !hasNodeTasks)
+        {
+            WakeUpWorker();
+        }
+        else if(m_numParkedWorkers > 0)
+        {
+            WakeUpAllWorkers();
+        }
+        
+        GrowElasticWorkers();
+    }
+    
+    //! Takes the next task to be run by a worker. The precedence is the
+    //! tied task, then the worker queue, the queue of its node, the shared
+    //! queue, the queues of the other workers and those of the other nodes
+    //! @return nullptr if there are no tasks to run
+    TaskEntry* PopTaskForWorker(Worker& worker)
+    {
+        uint8_t scheduledRun = Worker::SCHEDULED_RUN;
+        if(worker.tiedRunState.compare_exchange_strong(scheduledRun, Worker::NO_RUN)) return worker.tiedEntry;
+        
+        return PopQueuedTask(worker);
+    }
+    
+    //! Takes the next queued task to be run by a worker (see PopTaskForWorker())
+    //! @return nullptr if there are no tasks to run
+    TaskEntry* PopQueuedTask(Worker& worker)
+    {
+        //Pending tasks are left in the queues when the pool is stopped
+        if(m_stopWorkers || m_numPendingTasks == 0) return nullptr;
+        
+        //A retiring worker only empties its own queue
+        if(worker.index >= m_numThreads) return TakePendingTask(worker.queue.Pop());
+        
+        //High priority tasks and tasks with deadlines are only in the shared
+        //queue, so it goes first while there are any
+        TaskEntry* entry = m_numUrgentTasks > 0 ? PopSharedTask() : nullptr;
+        
+        if(entry == nullptr) entry = worker.queue.Pop();
+        if(entry == nullptr && m_numNodeTasks > 0) entry = PopNodeTask(worker.node);
+        if(entry == nullptr) entry = PopInjectedTask();
+        if(entry == nullptr) entry = PopSharedTask();
+        
+        const uint32_t numWorkerSlots = m_numWorkerSlots;
+        
+        for(uint32_t offset = 1; entry == nullptr && offset < numWorkerSlots; ++offset)
+        {
+            entry = m_workers[(worker.index + offset) % numWorkerSlots].load()->queue.Steal();
+        }
+        
+        //Tasks of the other nodes are taken last, so the workers aren't idle
+        for(size_t offset = 1; entry == nullptr && m_numNodeTasks > 0 && offset < m_nodeTasks.size(); ++offset)
+        {
+            entry = PopNodeTask(static_cast<uint8_t>((worker.node + offset) % m_nodeTasks.size()));
+        }
+        
+        return TakePendingTask(entry);
+    }
+    
+    //! Takes the next queued task to be run by a thread of outside the pool:
+    //! from the shared queue, the queues of the nodes and those of the workers
+    //! @return nullptr if there are no tasks to run
+    TaskEntry* PopQueuedTaskForExternalThread()
+    {
+        if(m_stopWorkers || m_numPendingTasks == 0) return nullptr;
+        
+        TaskEntry* entry = m_numUrgentTasks > 0 ? PopSharedTask() : nullptr;
+        
+        if(entry == nullptr) entry = PopInjectedTask();
+        if(entry == nullptr) entry = PopSharedTask();
+        
+        for(size_t node = 0; entry == nullptr && m_numNodeTasks > 0 && node < m_nodeTasks.size(); ++node)
+        {
+            entry = PopNodeTask(static_cast<uint8_t>(node));
+        }
+        
+        const uint32_t numWorkerSlots = m_numWorkerSlots;
+        
+        for(uint32_t workerIndex = 0; entry == nullptr && workerIndex < numWorkerSlots; ++workerIndex)
+        {
+            entry = m_workers[workerIndex].load()->queue.Steal();
+        }
+        
+        return TakePendingTask(entry);
+    }
+    
+    //! Runs a queued task in the current thread, while it waits for a task
+    //! @param worker of the current thread (nullptr if it's not a worker)
+    //! @return false if there were no tasks to run
+    bool HelpRunQueuedTask(Worker* worker)
+    {
+        //The tied task can't be the task that is waiting, as it isn't
+        //scheduled again until its run has finished (see isScheduled)
+        TaskEntry* entry = worker ? PopTaskForWorker(*worker) : PopQueuedTaskForExternalThread();
+        if(entry == nullptr) return false;
+        
+        RunInCurrentThread(worker, *entry);
+        return true;
+    }
+    
+    //! Runs a task that isn't queued anymore (or wasn't queued) in the
+    //! current thread, in the middle of another task if it's a worker
+    //! @param worker of the current thread (nullptr if it's not a worker)
+    void RunInCurrentThread(Worker* worker, TaskEntry& entry)
+    {
+        if(worker)
+        {
+            TinyTask* waitingTask = worker->runningTask;
+            RunTask(*worker, entry);
+            worker->runningTask = waitingTask;
+            return;
+        }
+        
+        TINYTASKS_TRACE(DEQUEUED, entry.task.GetID());
+        if(m_isCancellingTasks) entry.task.RequestStop();
+        
+        entry.task.Run();
+        
+        m_numExternalRuns.fetch_add(1, std::memory_order_relaxed);
+        if(entry.task.HasStopped()) m_numExternalStoppedRuns.fetch_add(1, std::memory_order_relaxed);
+        
+        CountFinishedRun(entry);
+        ReleaseActiveRef(entry);
+    }
+    
+    //! Gets the handle of a new task once its lambda is set. If its run
+    //! wasn't scheduled (the queues are full or the pool is shut down),
+    //! the task is released and the handle is empty, so the rejection
+    //! doesn't look like a finished run
+    TaskHandle GetSubmittedTaskHandle(const TaskID taskID, const Result result)
+    {
+        if(result == Result::SUCCEEDED || result == Result::SUCCEEDED_AT_QUEUE) return TaskHandle(this, taskID);
+        
+        ReleaseTask(taskID);
+        return TaskHandle();
+    }
+    
+    //! Gets if the current thread runs queued tasks while it waits: the
+    //! workers, and the other threads if SetExternalThreadsHelp() is set
+    bool IsHelpingThread() const { return GetCurrentWorker() != nullptr || m_externalThreadsHelp; }
+    
+    //! Runs queued tasks in the current thread until the predicate on the
+    //! finished runs is met. Without tasks to run, it waits for a run to
+    //! finish, checking the queues again every millisecond
+    template<typename Predicate>
+    void HelpUntil(Worker* worker, Predicate predicate)
+    {
+        while(!predicate())
+        {
+            if(!HelpRunQueuedTask(worker)) WaitUntil(predicate, std::chrono::milliseconds(1));
+        }
+    }
+    
+    //! Runs queued tasks in the current thread until the predicate on the
+    //! finished runs is met, or the timeout expires
+    //! @return false if the timeout expired
+    template<typename Predicate>
+    bool HelpUntil(Worker* worker, Predicate predicate, const std::chrono::milliseconds timeout)
+    {
+        const std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + timeout;
+        
+        while(!predicate())
+        {
+            const std::chrono::steady_clock::time_point timeNow = std::chrono::steady_clock::now();
+            if(timeNow >= deadline) return false;
+            
+            if(HelpRunQueuedTask(worker)) continue;
+            
+            const std::chrono::milliseconds timeLeft = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - timeNow);
+            WaitUntil(predicate, std::min(timeLeft, std::chrono::milliseconds(1)));
+        }
+        
+        return true;
+    }
+    
+    //! Updates the pending state of a task taken from a queue
+    //! @return the task entry (nullptr if no task was taken)
+    TaskEntry* TakePendingTask(TaskEntry* entry)
+    {
+        if(entry == nullptr) return nullptr;
+        
+        m_numPendingTasks--;
+        
+        if(m_numBlockedSubmitters > 0)
+        {
+            std::lock_guard<std::mutex> lock(m_queueSlotMutex);
+            m_queueSlotCondition.notify_one();
+        }
+        
+        return entry;
+    }
+    
+    //! Takes the task that is due first from the shared queue
+    //! @param only take the task if it's due by this time
+    //! @return nullptr if the shared queue is empty (or no task is due)
+    TaskEntry* PopSharedTask(const int64_t maxDueTime = INT64_MAX)
+    {
+        if(m_numSharedTasks == 0) return nullptr;
+        
+        std::lock_guard<std::mutex> lock(m_pendingTasksMutex);
+        if(m_pendingTasks.empty() || m_pendingTasks.top().dueTime > maxDueTime) return nullptr;
+        
+        const PendingTask pendingTask = m_pendingTasks.top();
+        m_pendingTasks.pop();
+        m_numSharedTasks--;
+        
+        if(pendingTask.isUrgent) m_numUrgentTasks--;
+        
+        return pendingTask.entry;
+    }
+    
+    //! Takes the oldest task of the injection queue. The tasks of the shared
+    //! queue that are due already go first, so the low priority tasks age
+    //! ahead of the injected ones as they would in the shared queue
+    //! @return nullptr if there are no injected tasks (or a shared task is
+    //! due, and another thread just took it)
+    TaskEntry* PopInjectedTask()
+    {
+        if(m_numSharedTasks > 0)
+        {
+            TaskEntry* entry = PopSharedTask(GetTimeNow());
+            if(entry) return entry;
+        }
+        
+        return m_injectedTasks.Pop();
+    }
+    
+    //! Takes the oldest task queued for a NUMA node
+    //! @return nullptr if the queue of the node is empty
+    TaskEntry* PopNodeTask(const uint8_t node)
+    {
+        std::lock_guard<std::mutex> lock(m_pendingTasksMutex);
+        std::deque<TaskEntry*>& nodeTasks = m_nodeTasks[node];
+        if(nodeTasks.empty()) return nullptr;
+        
+        TaskEntry* entry = nodeTasks.front();
+        nodeTasks.pop_front();
+        m_numNodeTasks--;
+        
+        return entry;
+    }
+    
+    //! Initialises the delays of the priority classes to the defaults
+    void InitPriorityDelays()
+    {
+        SetPriorityDelay(Priority::HIGH, std::chrono::milliseconds(0));
+        SetPriorityDelay(Priority::NORMAL, std::chrono::milliseconds(constants::kNormalPriorityDelay));
+        SetPriorityDelay(Priority::LOW, std::chrono::milliseconds(constants::kLowPriorityDelay));
+    }
+    
+    //! Sleeps the worker until there is a task for it, it has to retire, or
+    //! the pool stops. In elastic mode, it also wakes up after being idle
+    //! for a while
+    ParkResult ParkWorker(Worker& worker)
+    {
+        std::unique_lock<std::mutex> lock(m_parkingMutex);
+        
+        auto hasToWakeUp = [this, &worker]
+        {
+            return worker.tiedRunState == Worker::SCHEDULED_RUN || m_stopWorkers || m_numPendingTasks > 0 ||
+                   worker.index >= m_numThreads;
+        };
+        
+        bool isIdle = false;
+        m_numParkedWorkers++;
+        
+        if(m_isElastic)
+        {
+            isIdle = !m_workersCondition.wait_for(lock, std::chrono::milliseconds(m_elasticIdleTimeout), hasToWakeUp);
+        }
+        else
+        {
+            m_workersCondition.wait(lock, hasToWakeUp);
+        }
+        
+        m_numParkedWorkers--;
+        
+        //Scheduled runs are completed before stopping the worker
+        if(m_stopWorkers && worker.tiedRunState != Worker::SCHEDULED_RUN) return ParkResult::STOP;
+        
+        return isIdle ? ParkResult::IDLE_TIMEOUT : ParkResult::WAKE_UP;
+    }
+    
+    //! Wakes up a parked worker (if any) to run a pending task
+    void WakeUpWorker()
+    {
+        if(m_numParkedWorkers == 0) return;
+        
+        std::lock_guard<std::mutex> lock(m_parkingMutex);
+        m_workersCondition.notify_one();
+    }
+    
+    //! Wakes up all the parked workers
+    void WakeUpAllWorkers()
+    {
+        std::lock_guard<std::mutex> lock(m_parkingMutex);
+        m_workersCondition.notify_all();
+    }
+    
+    //! Gets if a lambda takes a TaskContext& parameter
+    template<typename Function>
+    struct TakesTaskContext
+    {
+        template<typename Callable>
+        static auto Test(int) -> decltype(std::declval<Callable&>()(std::declval<TaskContext&>()), std::true_type());
+        template<typename Callable>
+        static std::false_type Test(...);
+        
+        static const bool value = decltype(Test<typename std::decay<Function>::type>(0))::value;
+    };
+    
+    //! Runs a lambda that takes a TaskContext&, with the context of the run
+    template<typename Function>
+    class ContextLambda
+    {
+    public:
+        template<typename Lambda>
+        ContextLambda(Lambda&& lambda, TinyTask& task, TinyTasksPool& pool, const CancellationToken& token)
+                : m_lambda(std::forward<Lambda>(lambda)), m_task(&task), m_pool(&pool), m_token(token) {}
+        
+        void operator()();
+        
+    private:
+        Function            m_lambda;
+        TinyTask*           m_task;
+        TinyTasksPool*      m_pool;
+        CancellationToken   m_token;
+    };
+    
+    //! Sets the lambda of a task, wrapping it if it takes a TaskContext&
+    template<typename Function>
+    void SetTaskLambda(TaskEntry& entry, Function&& lambda, const CancellationToken& token)
+    {
+        SetTaskLambda(entry, std::forward<Function>(lambda), token, std::integral_constant<bool, TakesTaskContext<Function>::value>());
+    }
+    
+    template<typename Function>
+    void SetTaskLambda(TaskEntry& entry, Function&& lambda, const CancellationToken&, std::false_type)
+    {
+        entry.task.SetLambda(std::forward<Function>(lambda));
+    }
+    
+    template<typename Function>
+    void SetTaskLambda(TaskEntry& entry, Function&& lambda, const CancellationToken& token, std::true_type)
+    {
+        typedef ContextLambda<typename std::decay<Function>::type> Wrapper;
+        entry.task.SetLambda(Wrapper(std::forward<Function>(lambda), entry.task, *this, token));
+    }
+    
+    //! Gets the current time, in ticks of the steady clock
+    static int64_t GetTimeNow()
+    {
+        return std::chrono::steady_clock::now().time_since_epoch().count();
+    }
+    
+    //! Gets the nanoseconds of a number of ticks of the steady clock
+    static uint64_t TicksToNanoseconds(const int64_t ticks)
+    {
+        const std::chrono::steady_clock::duration duration(std::max<int64_t>(ticks, 0));
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count());
+    }
+    
+    //! Increments a counter that only the calling thread writes
+    static void IncrementCounter(std::atomic<uint64_t>& counter)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+    
+    //! Runs a task taken by a worker, and updates its metrics
+    void RunTask(Worker& worker, TaskEntry& entry)
+    {
+        worker.runningTask = &entry.task;
+        TINYTASKS_TRACE(DEQUEUED, entry.task.GetID());
+        
+#if TINYTASKS_ENABLE_METRICS
+        const int64_t startTime = GetTimeNow();
+        worker.queueWaitTimes.Record(TicksToNanoseconds(startTime - entry.scheduledTime.load(std::memory_order_relaxed)));
+#endif
+        
+        //Checked after publishing the running task, so either the task is
+        //stopped here or CancelAllTasks() sees it running
+        if(m_isCancellingTasks) entry.task.RequestStop();
+        
+        entry.task.Run();
+        
+#if TINYTASKS_ENABLE_METRICS
+        worker.runTimes.Record(TicksToNanoseconds(GetTimeNow() - startTime));
+#endif
+        
+        IncrementCounter(worker.numCompletedRuns);
+        if(entry.task.HasStopped()) IncrementCounter(worker.numStoppedRuns);
+        
+        //Cleared before the task can be recycled
+        worker.runningTask = nullptr;
+        CountFinishedRun(entry);
+        ReleaseActiveRef(entry);
+    }
+    
+    //! Main loop of a worker thread. Runs the tasks that are scheduled or
+    //! queued, and sleeps when there are none, until the pool stops the
+    //! workers
+    void RunWorker(Worker* worker)
+    {
+        WorkerContext& context = CurrentWorkerContext();
+        context.pool = this;
+        context.worker = worker;
+        
+        if(!worker->cpus.empty()) CpuTopology::PinCurrentThread(worker->cpus);
+        
+#if TINYTASKS_ENABLE_TRACING
+        TaskTracer::Get().SetThreadName("Worker " + std::to_string(worker->index));
+#endif
+        
+        while(true)
+        {
+            TaskEntry* entry = PopTaskForWorker(*worker);
+            
+            if(entry)
+            {
+                RunTask(*worker, *entry);
+                continue;
+            }
+            
+            if(worker->index >= m_numThreads && TryRetireWorker(*worker, false)) break;
+            
+            const ParkResult parkResult = ParkWorker(*worker);
+            if(parkResult == ParkResult::STOP) break;
+            if(parkResult == ParkResult::IDLE_TIMEOUT && TryRetireWorker(*worker, true)) break;
+        }
+        
+        //A pending task could have woken up this worker instead of another one
+        if(m_numPendingTasks > 0) WakeUpWorker();
+        
+        context.pool = nullptr;
+        context.worker = nullptr;
+    }
+    
+    //! Clears the pending tasks in the queue
+    void ClearPendingTasks()
+    {
+        SharedQueue empty;
+        std::swap(m_pendingTasks, empty);
+        while(m_injectedTasks.Pop()) {}
+        m_numSharedTasks = 0;
+        for(auto& nodeTasks : m_nodeTasks) nodeTasks.clear();
+        m_numNodeTasks = 0;
+        m_numUrgentTasks = 0;
+        m_numPendingTasks = 0;
+    }
+    
+    //! Deletes the pages of task entries in the pool
+    void DeleteTasksAllocations()
+    {
+        for(auto& pageSlot : m_taskPages)
+        {
+            delete pageSlot.exchange(nullptr);
+        }
+    }
+    
+#if TINYTASKS_ENABLE_COROUTINES
+    //! Task lambda that resumes a suspended coroutine
+    struct CoroutineResume
+    {
+        void operator()() { handle.resume(); }
+        
+        std::coroutine_handle<> handle;
+    };
+    
+#endif
+    //! Runs the function of a timer, unless it's been cancelled or the
+    //! previous run of a periodic timer is still going
+    struct TimerRun
+    {
+        void operator()()
+        {
+            if(timer->isCancelled || timer->isRunning.exchange(true)) return;
+            timer->function();
+            timer->isRunning = false;
+        }
+        
+        std::shared_ptr<TimerWheel::Timer> timer;
+    };
+    
+    //! Gets the current tick of the timers (in milliseconds since the pool was created)
+    uint64_t GetTimersTick() const
+    {
+        const auto elapsedTime = std::chrono::steady_clock::now() - m_timersStartTime;
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(elapsedTime).count());
+    }
+    
+    //! Adds a timer to the wheel, and starts the timers thread if needed
+    //! @param whether the function runs when the timers are stopped before
+    //! the timer expires (see TimerWheel::Timer::runsOnStop)
+    //! @return ID of the timer, or 0 if the timers are stopped
+    TimerID AddTimer(TaskFunction function, const std::chrono::milliseconds delay, const uint64_t periodTicks, const bool runsOnStop = false)
+    {
+        assert(function);
+        
+        std::lock_guard<std::mutex> lock(m_timersMutex);
+        if(m_stopTimers) return 0;
+        
+        if(!m_timersThread.joinable()) m_timersThread = std::thread(&TinyTasksPool::RunTimers, this);
+        
+        //Rounds up, so the lambda never runs before the delay
+        const uint64_t delayTicks = static_cast<uint64_t>(std::max<int64_t>(delay.count(), 0));
+        const TimerID timerID = ++m_lastTimerID;
+        std::shared_ptr<TimerWheel::Timer> timer =
+                std::make_shared<TimerWheel::Timer>(timerID, std::move(function), GetTimersTick() + delayTicks + 1, periodTicks, runsOnStop);
+        
+        m_timers[timerID] = timer;
+        m_timerWheel.Add(std::move(timer));
+        m_timersCondition.notify_one();
+        
+        return timerID;
+    }
+    
+    //! Function of the timers thread: advances the wheel, and queues the
+    //! lambdas of the timers as they expire
+    void RunTimers()
+    {
+        std::vector<std::shared_ptr<TimerWheel::Timer>> expiredTimers;
+        std::unique_lock<std::mutex> lock(m_timersMutex);
+        
+        while(!m_stopTimers)
+        {
+            const uint64_t tick = GetTimersTick();
+            m_timerWheel.Advance(tick, expiredTimers);
+            
+            if(expiredTimers.empty())
+            {
+                const uint64_t numTicks = m_timerWheel.GetTicksUntilNextCheck();
+                
+                if(numTicks == UINT64_MAX) m_timersCondition.wait(lock);
+                else m_timersCondition.wait_until(lock, m_timersStartTime + std::chrono::milliseconds(tick + numTicks));
+                continue;
+            }
+            
+            for(std::shared_ptr<TimerWheel::Timer>& timer : expiredTimers)
+            {
+                if(timer->periodTicks == 0)
+                {
+                    m_timers.erase(timer->id);
+                }
+                else
+                {
+                    //Fixed rate: the periods missed meanwhile are skipped
+                    const uint64_t numPeriods = (tick - timer->expiryTick) / timer->periodTicks + 1;
+                    timer->expiryTick += numPeriods * timer->periodTicks;
+                    m_timerWheel.Add(timer);
+                }
+            }
+            
+            //Queued with the lock held, so the one-shot timers are either
+            //counted by GetNumTimers() or queued already
+            for(std::shared_ptr<TimerWheel::Timer>& timer : expiredTimers)
+            {
+                //The capacity of the queues doesn't apply, so the thread never blocks
+                TimerRun timerRun;
+                timerRun.timer = std::move(timer);
+                SubmitInternal(std::move(timerRun));
+            }
+            
+            expiredTimers.clear();
+        }
+    }
+    
+    //! Cancels the timers and stops the timers thread (once). The functions
+    //! of the timers that run on stop (the coroutines waiting for a delay)
+    //! run in the current thread, once it's stopped
+    void StopTimers()
+    {
+        std::vector<std::shared_ptr<TimerWheel::Timer>> stoppedTimers;
+        
+        {
+            std::lock_guard<std::mutex> shutdownLock(m_shutdownMutex);
+            
+            {
+                std::lock_guard<std::mutex> lock(m_timersMutex);
+                m_stopTimers = true;
+                
+                for(auto& timer : m_timers)
+                {
+                    timer.second->isCancelled = true;
+                    if(timer.second->runsOnStop) stoppedTimers.push_back(timer.second);
+                }
+                
+                m_timers.clear();
+                m_timersCondition.notify_all();
+            }
+            
+            if(m_timersThread.joinable()) m_timersThread.join();
+        }
+        
+        //Without the locks, as they can add timers (that are refused) or tasks
+        for(std::shared_ptr<TimerWheel::Timer>& timer : stoppedTimers) timer->function();
+    }
+    
+    //! Stops the running tasks, and the queued ones once they start (the
+    //! lambdas still run, so the tasks waiting for them finish)
+    void CancelAllTasks()
+    {
+        m_isCancellingTasks = true;
+        
+        const uint32_t numWorkerSlots = m_numWorkerSlots;
+        
+        for(uint32_t workerIndex = 0; workerIndex < numWorkerSlots; ++workerIndex)
+        {
+            TinyTask* task = m_workers[workerIndex].load()->runningTask.load();
+            if(task && !task->HasCompleted() && !task->HasStopped()) task->RequestStop();
+        }
+    }
+    
+    //! Stops the threads in the pool (once)
+    void StopAllThreads()
+    {
+        std::lock_guard<std::mutex> shutdownLock(m_shutdownMutex);
+        if(m_isShutDown) return;
+        
+        {
+            std::lock_guard<std::mutex> lock(m_parkingMutex);
+            m_stopWorkers = true;
+            m_workersCondition.notify_all();
+        }
+        
+        WakeUpBlockedSubmitters();
+        
+        //Waits for any resize in progress. No more workers are started once
+        //the pool is stopping, and the workers can retire meanwhile, so the
+        //threads are joined without the lock
+        {
+            std::lock_guard<std::mutex> lock(m_resizeMutex);
+        }
+        
+        const uint32_t numWorkerSlots = m_numWorkerSlots;
+        
+        for(uint32_t workerIndex = 0; workerIndex < numWorkerSlots; ++workerIndex)
+        {
+            Worker* worker = m_workers[workerIndex].load();
+            if(worker->thread.joinable()) worker->thread.join();
+        }
+        
+        m_isShutDown = true;
+    }
+    
+    //! Deletes the workers, once their threads are stopped. The workers
+    //! steal from each other and the tied tasks point to them, so they're
+    //! kept until the pool is destroyed
+    void DeleteWorkers()
+    {
+        const uint32_t numWorkerSlots = m_numWorkerSlots;
+        
+        for(uint32_t workerIndex = 0; workerIndex < numWorkerSlots; ++workerIndex)
+        {
+            delete m_workers[workerIndex].exchange(nullptr);
+        }
+    }
+    
+    std::atomic<uint8_t>                    m_numThreads;
+    std::atomic<Worker*>                    m_workers[constants::kMaxNumThreadsInPool];
+    std::atomic<uint32_t>                   m_numWorkerSlots;
+    std::mutex                              m_resizeMutex;
+    std::atomic<size_t>                     m_numTiedWorkers;
+    std::atomic<TaskPage*>                  m_taskPages[constants::kNumTaskPages];
+    std::atomic<uint32_t>                   m_numTaskSlots;
+    std::atomic<uint64_t>                   m_freeTaskSlots;
+    SharedQueue                             m_pendingTasks;
+    std::atomic<uint32_t>                   m_numSharedTasks;
+    MPMCQueue<TaskEntry>                    m_injectedTasks;
+    std::mutex                              m_pendingTasksMutex;
+    std::atomic<uint32_t>                   m_numPendingTasks;
+    std::atomic<uint32_t>                   m_numParkedWorkers;
+    std::atomic<bool>                       m_stopWorkers;
+    std::mutex                              m_parkingMutex;
+    std::condition_variable                 m_workersCondition;
+    std::atomic<int32_t>                    m_numUnfinishedTasks;
+    std::atomic<uint32_t>                   m_numWaiters;
+    std::mutex                              m_waitMutex;
+    std::condition_variable                 m_waitCondition;
+    std::atomic<uint32_t>                   m_numUrgentTasks;
+    uint64_t                                m_numQueuedTasks;
+    std::atomic<int64_t>                    m_priorityDelays[Priority::NUM_PRIORITIES];
+    std::atomic<bool>                       m_isElastic;
+    std::atomic<uint8_t>                    m_minNumElasticThreads;
+    std::atomic<uint8_t>                    m_maxNumElasticThreads;
+    std::atomic<int64_t>                    m_elasticIdleTimeout;
+    const WorkerPlacement                   m_placement;
+    const std::size_t                       m_scratchArenaSize;
+    std::vector<std::deque<TaskEntry*>>     m_nodeTasks;
+    std::atomic<uint32_t>                   m_numNodeTasks;
+    std::atomic<uint64_t>                   m_numScheduledRuns;
+    std::atomic<bool>                       m_isCancellingTasks;
+    std::atomic<bool>                       m_isRejectingTasks;
+    std::atomic<bool>                       m_isShutDown;
+    std::mutex                              m_shutdownMutex;
+    std::atomic<bool>                       m_externalThreadsHelp;
+    std::atomic<uint64_t>                   m_numExternalRuns;
+    std::atomic<uint64_t>                   m_numExternalStoppedRuns;
+    TimerWheel                              m_timerWheel;
+    std::unordered_map<TimerID, std::shared_ptr<TimerWheel::Timer>> m_timers;
+    TimerID                                 m_lastTimerID;
+    bool                                    m_stopTimers;
+    const std::chrono::steady_clock::time_point m_timersStartTime;
+    std::thread                             m_timersThread;
+    std::mutex                              m_timersMutex;
+    std::condition_variable                 m_timersCondition;
+    std::atomic<uint32_t>                   m_queueCapacity;
+    std::atomic<OverflowPolicy>             m_overflowPolicy;
+    std::atomic<uint32_t>                   m_numBlockedSubmitters;
+    std::mutex                              m_queueSlotMutex;
+    std::condition_variable                 m_queueSlotCondition;
+    std::atomic<uint64_t>                   m_numRejectedRuns;
+};
+
+//! @brief Context passed to the task lambdas that take it, with the task
+//! and its cancellation token
+//!
+//! @details
+//! A lambda run in a TinyTasksPool can take a TaskContext& parameter, so it
+//! doesn't need to look up its task. The checks are inline and don't lock,
+//! so they can be done on every iteration of a loop.
+//!
+class TaskContext
+{
+public:
+    //! Initialize the context of a run of a task
+    TaskContext(TinyTask& task, TinyTasksPool& pool, const CancellationToken& token, ScratchArena& scratchArena)
+            : m_task(task), m_pool(pool), m_token(token), m_scratchArena(scratchArena) {}
+    
+    //! Gets if the task has been stopped, or its token has been cancelled
+    bool IsCancelled() const { return m_task.IsStopping() || m_token.IsCancelled(); }
+    
+    //! Blocks the task while it's paused (see TinyTask::PauseIfNeeded())
+    void PauseIfNeeded() { m_task.PauseIfNeeded(); }
+    
+    //! Sets the progress of the task
+    void SetProgress(const float progress) { m_task.SetProgress(progress); }
+    
+    //! Creates a child task in the pool, with the same cancellation token
+    //! @param lambda function to run (has to be valid)
+    //! @return handle to wait for the task
+    //! @note The task has to be released with TinyTasksPool::ReleaseTask()
+    //! once it's no longer needed
+    template<typename Function>
+    TinyTasksPool::TaskHandle Submit(Function&& lambda) { return m_pool.Submit(std::forward<Function>(lambda), m_token); }
+    
+    //! Gets the ID of the task
+    TaskID                      GetTaskID() const   { return m_task.GetID(); }
+    //! Gets the task
+    TinyTask&                   GetTask()           { return m_task; }
+    //! Gets the pool that runs the task
+    TinyTasksPool&              GetPool()           { return m_pool; }
+    //! Gets the cancellation token of the task
+    const CancellationToken&    GetToken()  const   { return m_token; }
+    //! Gets the scratch arena of the worker running the task, for temporary
+    //! buffers that are freed once the task finishes (see ScratchArena)
+    //! @note If the task runs in a thread of outside the pool (e.g. helping
+    //! in a wait), the arena has no block and allocates in the heap
+    ScratchArena&               GetScratchArena()   { return m_scratchArena; }
+    
+private:
+    TinyTask&                   m_task;
+    TinyTasksPool&              m_pool;
+    const CancellationToken&    m_token;
+    ScratchArena&               m_scratchArena;
+};
+
+template<typename Function>
+void TinyTasksPool::ContextLambda<Function>::operator()()
+{
+    Worker* worker = m_pool->GetCurrentWorker();
+    if(worker == nullptr)
+    {
+        ScratchArena externalArena(0);
+        TaskContext context(*m_task, *m_pool, m_token, externalArena);
+        m_lambda(context);
+        return;
+    }
+    
+    //The task may run nested in another one of the worker (e.g. helping in
+    //a wait), so it only frees what it allocated
+    ScratchArena& arena = worker->scratchArena;
+    const ScratchArena::Marker marker = arena.GetMarker();
+    
+    TaskContext context(*m_task, *m_pool, m_token, arena);
+    m_lambda(context);
+    
+    arena.Rewind(marker);
+}
+
+//! @brief Set of tasks of a pool that are waited for, stopped, paused and
+//! resumed together
+//!
+//! @details
+//! The group counts its unfinished tasks, so Wait() doesn't look at the
+//! tasks, and it links the running ones in a list, so that stopping,
+//! pausing or resuming it only goes through the tasks that are running.
+//! The tasks get the cancellation token of the group, which is cancelled
+//! by Stop(), and the queued tasks of a stopped group are skipped.
+//!
+class TaskGroup : public NonCopyableMovable
+{
+public:
+    //! Initialize the group
+    //! @param pool where the tasks run
+    explicit TaskGroup(TinyTasksPool& pool)
+            : m_pool(pool), m_firstMember(nullptr), m_numUnfinishedTasks(0), m_isPaused(false) {}
+    
+    //! Initialize the group, so it's stopped when a parent token is cancelled
+    //! @param pool where the tasks run
+    //! @param parent token
+    TaskGroup(TinyTasksPool& pool, const CancellationToken& parent)
+            : m_pool(pool), m_source(parent), m_firstMember(nullptr), m_numUnfinishedTasks(0), m_isPaused(false) {}
+    
+    //! Destroys the group, after its tasks finish
+    ~TaskGroup()
+    {
+        Wait();
+    }
+    
+    //! Creates a new task of the group and runs a lambda in it
+    //! @param lambda function to run (has to be valid). It can take a
+    //! TaskContext&, to check if the group is stopped
+    //! @note The task is released by the group. If the pool is shut down,
+    //! the lambda isn't run (nor waited for)
+    template<typename Function>
+    void Submit(Function&& lambda)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_numUnfinishedTasks++;
+        }
+        
+        GroupLambda<typename std::decay<Function>::type> groupLambda(this, std::forward<Function>(lambda));
+        if(m_pool.SubmitInternal(std::move(groupLambda), m_source.GetToken()) != TinyTasksPool::Result::SHUT_DOWN) return;
+        
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if(--m_numUnfinishedTasks == 0) m_completionCondition.notify_all();
+    }
+    
+    //! Blocks the current thread until all the tasks of the group finish.
+    //! Called from a task lambda, it runs queued tasks meanwhile (see
+    //! TinyTasksPool::Wait()), so nested groups can't starve the pool
+    void Wait()
+    {
+        if(m_pool.IsHelpingThread())
+        {
+            m_pool.HelpUntil(m_pool.GetCurrentWorker(), [this]
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                return m_numUnfinishedTasks == 0;
+            });
+            return;
+        }
+        
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_completionCondition.wait(lock, [this]{ return m_numUnfinishedTasks == 0; });
+    }
+    
+    //! Stops the tasks of the group, and skips the ones that haven't
+    //! started yet (including the ones submitted afterwards)
+    void Stop()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        
+        m_source.Cancel();
+        
+        for(Member* member = m_firstMember; member != nullptr; member = member->next)
+        {
+            TinyTask& task = member->task;
+            if((task.IsRunning() || task.IsPaused()) && !task.IsStopping()) task.Stop();
+        }
+    }
+    
+    //! Pauses the running tasks of the group, and the ones that start
+    //! while the group is paused
+    //! @note The tasks block in TinyTask::PauseIfNeeded()
+    void Pause()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        
+        m_isPaused = true;
+        
+        for(Member* member = m_firstMember; member != nullptr; member = member->next)
+        {
+            if(member->task.IsRunning()) member->task.Pause();
+        }
+    }
+    
+    //! Resumes the paused tasks of the group
+    void Resume()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        
+        m_isPaused = false;
+        
+        for(Member* member = m_firstMember; member != nullptr; member = member->next)
+        {
+            if(member->task.IsPaused()) member->task.Resume();
+        }
+    }
+    
+    //! Gets the number of tasks of the group that haven't finished
+    uint32_t GetNumUnfinishedTasks()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_numUnfinishedTasks;
+    }
+    
+    //! Gets if the group has been stopped
+    bool IsStopped() const          { return m_source.IsCancelled(); }
+    //! Gets if the group is paused
+    bool IsPaused()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_isPaused;
+    }
+    //! Gets the cancellation token of the tasks of the group
+    CancellationToken GetToken() const  { return m_source.GetToken(); }
+    
+private:
+    //! Running task of the group, linked while it runs
+    struct Member
+    {
+        explicit Member(TinyTask& runningTask) : task(runningTask), previous(nullptr), next(nullptr) {}
+        
+        TinyTask&   task;
+        Member*     previous;
+        Member*     next;
+    };
+    
+    //! Lambda of the tasks of the group, which tracks the run of the
+    //! lambda of the user
+    template<typename Function>
+    class GroupLambda
+    {
+    public:
+        template<typename Lambda>
+        GroupLambda(TaskGroup* group, Lambda&& lambda) : m_group(group), m_lambda(std::forward<Lambda>(lambda)) {}
+        
+        void operator()(TaskContext& context)
+        {
+            //The member lives in the stack of the run, so linking it doesn't allocate
+            Member member(context.GetTask());
+            
+            if(m_group->AddMember(member))
+            {
+                context.PauseIfNeeded();
+                Invoke(m_lambda, context, 0);
+            }
+            
+            //The group mustn't be accessed after this, as it can be destroyed
+            m_group->RemoveMember(member);
+        }
+        
+    private:
+        template<typename Callable>
+        static auto Invoke(Callable& lambda, TaskContext& context, int) -> decltype(lambda(context), void())
+        {
+            lambda(context);
+        }
+        
+        template<typename Callable>
+        static void Invoke(Callable& lambda, TaskContext&, long)
+        {
+            lambda();
+        }
+        
+        TaskGroup*  m_group;
+        Function    m_lambda;
+    };
+    
+    //! Links a task that starts running, and pauses it if the group is paused
+    //! @return false if the group is stopped, so the task is skipped
+    bool AddMember(Member& member)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        
+        if(m_source.IsCancelled()) return false;
+        
+        member.next = m_firstMember;
+        if(m_firstMember) m_firstMember->previous = &member;
+        m_firstMember = &member;
+        
+        if(m_isPaused) member.task.Pause();
+        
+        return true;
+    }
+    
+    //! Unlinks a task (if linked) once it finishes, and completes it
+    void RemoveMember(Member& member)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        
+        if(member.previous) member.previous->next = member.next;
+        else if(m_firstMember == &member) m_firstMember = member.next;
+        if(member.next) member.next->previous = member.previous;
+        
+        if(--m_numUnfinishedTasks == 0) m_completionCondition.notify_all();
+    }
+    
+    TinyTasksPool&              m_pool;
+    CancellationSource          m_source;
+    Member*                     m_firstMember;
+    uint32_t                    m_numUnfinishedTasks;
+    bool                        m_isPaused;
+    std::mutex                  m_mutex;
+    std::condition_variable     m_completionCondition;
+};
+
+template<typename T>
+class Future;
+
+//! @brief Value of a future, constructed once the future is ready
+template<typename T>
+class FutureValue
+{
+public:
+    //! Type returned by Future::Get()
+    typedef const T& Reference;
+    
+    FutureValue() : m_hasValue(false) {}
+    ~FutureValue() { if(m_hasValue) reinterpret_cast<T*>(&m_storage)->~T(); }
+    
+    //! Sets the result of a function (called with some arguments)
+    template<typename Function, typename... Args>
+    void SetResultOf(Function& function, Args&&... args)
+    {
+        new(&m_storage) T(function(std::forward<Args>(args)...));
+        m_hasValue = true;
+    }
+    
+    //! Gets the value (the future has to be ready)
+    Reference Get() const { return *reinterpret_cast<const T*>(&m_storage); }
+    
+private:
+    typename std::aligned_storage<sizeof(T), alignof(T)>::type  m_storage;
+    bool                                                        m_hasValue;
+};
+
+//! @brief Value of a future of void (there's no value, only the run)
+template<>
+class FutureValue<void>
+{
+public:
+    typedef void Reference;
+    
+    template<typename Function, typename... Args>
+    void SetResultOf(Function& function, Args&&... args) { function(std::forward<Args>(args)...); }
+    
+    void Get() const {}
+};
+
+//! @brief State shared by a future and the task or the continuation that
+//! makes it ready
+//!
+//! @details
+//! The continuations added before the future is ready are run by the
+//! thread that makes it ready, right after setting the value, and the ones
+//! added afterwards are run by the thread that adds them. Either way they
+//! don't need a thread of their own. The state keeps the pool that makes
+//! it ready (if any), so the workers that wait for it run queued tasks
+//! meanwhile.
+//!
+template<typename T>
+class FutureState : public NonCopyableMovable
+{
+public:
+    //! Initialize the state
+    //! @param pool that makes the future ready (nullptr if none does)
+    explicit FutureState(TinyTasksPool* pool = nullptr) : m_pool(pool), m_isReady(false) {}
+    
+    //! Makes the future ready with the result of a function, and runs the
+    //! continuations
+    template<typename Function, typename... Args>
+    void SetResultOf(Function& function, Args&&... args)
+    {
+        m_value.SetResultOf(function, std::forward<Args>(args)...);
+        
+        std::vector<TaskFunction> continuations;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_isReady = true;
+            continuations.swap(m_continuations);
+            m_readyCondition.notify_all();
+        }
+        
+        for(TaskFunction& continuation : continuations) continuation();
+    }
+    
+    //! Adds a function to run once the future is ready (it runs straight
+    //! away if it's ready already)
+    void AddContinuation(TaskFunction continuation)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            
+            if(!m_isReady)
+            {
+                m_continuations.push_back(std::move(continuation));
+                return;
+            }
+        }
+        
+        continuation();
+    }
+    
+    //! Blocks the current thread until the future is ready. Called from a
+    //! task lambda of its pool, it runs queued tasks meanwhile (see
+    //! TinyTasksPool::Wait())
+    void Wait()
+    {
+        if(m_isReady) return;
+        
+        if(m_pool && m_pool->IsHelpingThread())
+        {
+            m_pool->HelpUntil(m_pool->GetCurrentWorker(), [this]{ return m_isReady.load(); });
+            return;
+        }
+        
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_readyCondition.wait(lock, [this]{ return m_isReady.load(); });
+    }
+    
+    //! Blocks the current thread until the future is ready, or the timeout
+    //! expires
+    //! @return false if the timeout expired
+    bool WaitFor(const std::chrono::milliseconds timeout)
+    {
+        if(m_isReady) return true;
+        
+        if(m_pool && m_pool->IsHelpingThread())
+        {
+            return m_pool->HelpUntil(m_pool->GetCurrentWorker(), [this]{ return m_isReady.load(); }, timeout);
+        }
+        
+        std::unique_lock<std::mutex> lock(m_mutex);
+        return m_readyCondition.wait_for(lock, timeout, [this]{ return m_isReady.load(); });
+    }
+    
+    //! Gets if the future is ready
+    bool IsReady() const { return m_isReady; }
+    
+    //! Gets the value (the future has to be ready)
+    typename FutureValue<T>::Reference GetValue() const { return m_value.Get(); }
+    
+    //! Gets the pool that makes the future ready (nullptr if none does)
+    TinyTasksPool* GetPool() const { return m_pool; }
+    
+private:
+    TinyTasksPool*              m_pool;
+    FutureValue<T>              m_value;
+    std::atomic<bool>           m_isReady;
+    std::vector<TaskFunction>   m_continuations;
+    std::mutex                  m_mutex;
+    std::condition_variable     m_readyCondition;
+};
+
+//! @brief Gets the type returned by a continuation of a future of T
+template<typename T, typename Function>
+struct ContinuationResult
+{
+    typedef typename std::result_of<typename std::decay<Function>::type&(const T&)>::type type;
+};
+
+template<typename Function>
+struct ContinuationResult<void, Function>
+{
+    typedef typename std::result_of<typename std::decay<Function>::type&()>::type type;
+};
+
+#if TINYTASKS_ENABLE_COROUTINES
+template<typename T> class CoTask;
+#endif
+
+//! @brief Result of a task, or of a continuation of another future
+//!
+//! @details
+//! Futures are lightweight handles to a shared state, so they are copied
+//! cheaply. Then() chains a continuation, which runs inline on the thread
+//! that makes the future ready (e.g. the worker that completes the task),
+//! without another pool run. Continuations should be short: heavy work can
+//! be submitted from them with Async().
+//!
+//! @note Waiting for a future from a task of the pool that makes it
+//! ready (e.g. of Async()) runs queued tasks meanwhile, instead of
+//! blocking the worker (see TinyTasksPool::Wait())
+//!
+template<typename T>
+class Future
+{
+public:
+    //! Initialize an empty future (not tied to any result)
+    Future() {}
+    
+    //! Gets if the future is tied to a result
+    bool IsValid()  const { return m_state != nullptr; }
+    //! Gets if the result is ready
+    bool IsReady()  const { return m_state->IsReady(); }
+    
+    //! Blocks the current thread until the result is ready
+    void Wait()     const { m_state->Wait(); }
+    
+    //! Blocks the current thread until the result is ready, or the timeout
+    //! expires
+    //! @return false if the timeout expired
+    bool WaitFor(const std::chrono::milliseconds timeout) const { return m_state->WaitFor(timeout); }
+    
+    //! Gets the result, once it's ready
+    typename FutureValue<T>::Reference Get() const
+    {
+        m_state->Wait();
+        return m_state->GetValue();
+    }
+    
+    //! Chains a continuation, called with the result once it's ready
+    //! @param function called with the result (or without arguments, for
+    //! futures of void)
+    //! @return future of the result of the continuation
+    template<typename Function>
+    Future<typename ContinuationResult<T, Function>::type> Then(Function&& function) const
+    {
+        typedef typename ContinuationResult<T, Function>::type Result;
+        
+        std::shared_ptr<FutureState<Result>> nextState = std::make_shared<FutureState<Result>>(m_state->GetPool());
+        Continuation<typename std::decay<Function>::type, Result> continuation(std::forward<Function>(function), m_state.get(), nextState);
+        m_state->AddContinuation(std::move(continuation));
+        
+        return Future<Result>(nextState);
+    }
+    
+private:
+    template<typename> friend class Future;
+    template<typename Value> friend Future<std::vector<Value>> WhenAll(const std::vector<Future<Value>>&);
+    friend Future<void> WhenAll(const std::vector<Future<void>>&);
+    template<typename Value> friend Future<size_t> WhenAny(const std::vector<Future<Value>>&);
+    template<typename Function> friend Future<typename std::result_of<typename std::decay<Function>::type&()>::type> Async(TinyTasksPool&, Function&&);
+#if TINYTASKS_ENABLE_COROUTINES
+    template<typename Value> friend Future<Value> Spawn(TinyTasksPool&, CoTask<Value>);
+#endif
+    
+    explicit Future(std::shared_ptr<FutureState<T>> state) : m_state(std::move(state)) {}
+    
+    //! Gets the pool that makes one of the futures of a list ready
+    //! (nullptr if none does), for the future that joins them
+    static TinyTasksPool* GetPool(const std::vector<Future>& futures)
+    {
+        for(const Future& future : futures)
+        {
+            if(future.m_state->GetPool()) return future.m_state->GetPool();
+        }
+        
+        return nullptr;
+    }
+    
+    //! Runs a continuation with the result of the previous future. The
+    //! previous state is alive while its continuations run, so a raw
+    //! pointer is enough (and doesn't make a cycle)
+    template<typename Function, typename Result>
+    class Continuation
+    {
+    public:
+        template<typename Lambda>
+        Continuation(Lambda&& function, const FutureState<T>* previousState, std::shared_ptr<FutureState<Result>> nextState)
+                : m_function(std::forward<Lambda>(function)), m_previousState(previousState), m_nextState(std::move(nextState)) {}
+        
+        void operator()() { Run(std::is_void<T>()); }
+        
+    private:
+        void Run(std::false_type)   { m_nextState->SetResultOf(m_function, m_previousState->GetValue()); }
+        void Run(std::true_type)    { m_nextState->SetResultOf(m_function); }
+        
+        Function                                m_function;
+        const FutureState<T>*                   m_previousState;
+        std::shared_ptr<FutureState<Result>>    m_nextState;
+    };
+    
+    std::shared_ptr<FutureState<T>> m_state;
+};
+
+//! Runs a lambda in a task of the pool, and gets a future of its result
+//! @param pool where the task runs
+//! @param lambda function to run, which returns the result (has to be
+//! valid)
+//! @return future of the result
+//! @note The task is released once it's submitted. If the pool is shut
+//! down (or a shutdown has timed out), the future never gets ready
+template<typename Function>
+Future<typename std::result_of<typename std::decay<Function>::type&()>::type> Async(TinyTasksPool& pool, Function&& lambda)
+{
+    typedef typename std::result_of<typename std::decay<Function>::type&()>::type Result;
+    typedef typename std::decay<Function>::type Lambda;
+    
+    //! Task lambda that makes the future ready
+    struct AsyncTask
+    {
+        void operator()() { state->SetResultOf(lambda); }
+        
+        std::shared_ptr<FutureState<Result>>    state;
+        Lambda                                  lambda;
+    };
+    
+    std::shared_ptr<FutureState<Result>> state = std::make_shared<FutureState<Result>>(&pool);
+    AsyncTask task = { state, std::forward<Function>(lambda) };
+    pool.SubmitInternal(std::move(task));
+    
+    return Future<Result>(state);
+}
+
+//! Gets a future that is ready once all the futures of a list are, with
+//! their results
+//! @param futures to wait for (they have to be valid)
+//! @return future of the results, in the order of the list
+template<typename T>
+Future<std::vector<T>> WhenAll(const std::vector<Future<T>>& futures)
+{
+    //! Counter of the futures that aren't ready, shared by their continuations
+    struct AllState
+    {
+        std::vector<Future<T>>                          futures;
+        std::atomic<size_t>                             numPendingFutures;
+        std::shared_ptr<FutureState<std::vector<T>>>    state;
+    };
+    
+    //! Continuation of each future. The last one sets the results
+    struct AllContinuation
+    {
+        void operator()()
+        {
+            if(--all->numPendingFutures > 0) return;
+            
+            auto getResults = [this]
+            {
+                std::vector<T> results;
+                results.reserve(all->futures.size());
+                for(const Future<T>& future : all->futures) results.push_back(future.Get());
+                return results;
+            };
+            
+            all->state->SetResultOf(getResults);
+        }
+        
+        std::shared_ptr<AllState> all;
+    };
+    
+    std::shared_ptr<AllState> all = std::make_shared<AllState>();
+    all->futures = futures;
+    all->numPendingFutures = futures.size() + 1;
+    all->state = std::make_shared<FutureState<std::vector<T>>>(Future<T>::GetPool(futures));
+    
+    for(const Future<T>& future : futures)
+    {
+        AllContinuation continuation = { all };
+        future.m_state->AddContinuation(std::move(continuation));
+    }
+    
+    //Counted once more, so an empty list is ready too
+    AllContinuation continuation = { all };
+    continuation();
+    
+    return Future<std::vector<T>>(all->state);
+}
+
+//! Gets a future that is ready once all the futures of void of a list are
+//! @param futures to wait for (they have to be valid)
+inline Future<void> WhenAll(const std::vector<Future<void>>& futures)
+{
+    struct AllState
+    {
+        std::atomic<size_t>                 numPendingFutures;
+        std::shared_ptr<FutureState<void>>  state;
+    };
+    
+    struct AllContinuation
+    {
+        void operator()()
+        {
+            if(--all->numPendingFutures > 0) return;
+            
+            auto complete = []{};
+            all->state->SetResultOf(complete);
+        }
+        
+        std::shared_ptr<AllState> all;
+    };
+    
+    std::shared_ptr<AllState> all = std::make_shared<AllState>();
+    all->numPendingFutures = futures.size() + 1;
+    all->state = std::make_shared<FutureState<void>>(Future<void>::GetPool(futures));
+    
+    for(const Future<void>& future : futures)
+    {
+        AllContinuation continuation = { all };
+        future.m_state->AddContinuation(std::move(continuation));
+    }
+    
+    AllContinuation continuation = { all };
+    continuation();
+    
+    return Future<void>(all->state);
+}
+
+//! Gets a future that is ready once any of the futures of a list is
+//! @param futures to wait for (there has to be at least one, and they have
+//! to be valid)
+//! @return future of the index of the first future that was ready
+template<typename T>
+Future<size_t> WhenAny(const std::vector<Future<T>>& futures)
+{
+    assert(!futures.empty() && "WhenAny() requires at least one future");
+    
+    //! Flag of the first ready future, shared by the continuations
+    struct AnyState
+    {
+        std::atomic<bool>                   isReady;
+        std::shared_ptr<FutureState<size_t>> state;
+    };
+    
+    struct AnyContinuation
+    {
+        void operator()()
+        {
+            if(any->isReady.exchange(true)) return;
+            
+            size_t readyIndex = index;
+            auto getIndex = [readyIndex]{ return readyIndex; };
+            any->state->SetResultOf(getIndex);
+        }
+        
+        std::shared_ptr<AnyState>   any;
+        size_t                      index;
+    };
+    
+    std::shared_ptr<AnyState> any = std::make_shared<AnyState>();
+    any->isReady = false;
+    any->state = std::make_shared<FutureState<size_t>>(Future<T>::GetPool(futures));
+    
+    for(size_t index = 0; index < futures.size(); ++index)
+    {
+        AnyContinuation continuation = { any, index };
+        futures[index].m_state->AddContinuation(std::move(continuation));
+    }
+    
+    return Future<size_t>(any->state);
+}
+
+//! @brief Range of indices of a parallel loop, split in chunks that are
+//! claimed by the threads running the loop
+//!
+//! @details
+//! The chunks are sized adaptively (guided scheduling): each claim takes
+//! a share of the remaining indices, but not less than the grain, so the
+//! first chunks are big and the last ones balance the load between the
+//! threads. The thread that runs the loop blocks on a condition variable
+//! (instead of polling) until all the claimed indices are completed, or
+//! runs queued tasks meanwhile if it's a worker of the pool.
+//!
+//! @note This class is used by ParallelFor() and ParallelReduce()
+//!
+template<typename Index>
+class ParallelRange : public NonCopyableMovable
+{
+public:
+    //! Initialize the range
+    //! @param first index of the range
+    //! @param end of the range (one past the last index)
+    //! @param minimum number of indices in a chunk (0 is taken as 1)
+    //! @param number of threads that run the loop
+    ParallelRange(const Index begin, const Index end, const Index grain, const uint32_t numThreads)
+            : m_next(begin), m_end(end), m_grain(grain > 0 ? grain : 1), m_numThreads(numThreads),
+              m_numPendingIndices(end > begin ? static_cast<uint64_t>(end - begin) : 0),
+              m_hasCompleted(end <= begin)
+    {
+        static_assert(std::is_integral<Index>::value, "Parallel loops require an integral index");
+        assert(m_numThreads > 0);
+    }
+    
+    //! Claims the next chunk of the range (lock-free)
+    //! @param first index of the claimed chunk
+    //! @param end of the claimed chunk
+    //! @return false if there are no indices left to claim
+    bool Claim(Index& chunkBegin, Index& chunkEnd)
+    {
+        Index next = m_next.load(std::memory_order_relaxed);
+        
+        while(next < m_end)
+        {
+            const Index numRemaining = m_end - next;
+            const Index share = static_cast<Index>(numRemaining / (2 * m_numThreads));
+            const Index size = std::min(numRemaining, std::max(m_grain, share));
+            
+            if(m_next.compare_exchange_weak(next, static_cast<Index>(next + size)))
+            {
+                chunkBegin = next;
+                chunkEnd = static_cast<Index>(next + size);
+                return true;
+            }
+        }
+        
+        return false;
+    }
+    
+    //! Marks claimed indices as completed, and wakes up the waiting thread
+    //! once all the indices are
+    //! @param number of completed indices
+    //! @note Data of the loop mustn't be accessed after completing its last
+    //! indices, as the loop can return meanwhile
+    void Complete(const uint64_t numIndices)
+    {
+        if(numIndices == 0 || m_numPendingIndices.fetch_sub(numIndices) != numIndices) return;
+        
+        std::lock_guard<std::mutex> lock(m_completionMutex);
+        m_hasCompleted = true;
+        m_completionCondition.notify_all();
+    }
+    
+    //! Blocks the current thread until all the indices are completed.
+    //! Called from a task lambda, it runs queued tasks meanwhile (see
+    //! TinyTasksPool::Wait()), so nested loops can't starve the pool
+    //! @param pool where the helper tasks run
+    void Wait(TinyTasksPool& pool)
+    {
+        if(pool.IsHelpingThread())
+        {
+            pool.HelpUntil(pool.GetCurrentWorker(), [this]
+            {
+                std::lock_guard<std::mutex> lock(m_completionMutex);
+                return m_hasCompleted;
+            });
+            return;
+        }
+        
+        std::unique_lock<std::mutex> lock(m_completionMutex);
+        m_completionCondition.wait(lock, [this]{ return m_hasCompleted; });
+    }
+    
+    //! Runs a loop over a range in the pool: the calling thread claims
+    //! chunks too, so the loop makes progress even if the workers are busy
+    //! @param pool where the helper tasks run
+    //! @param range of the loop
+    //! @param body called by each thread with the range, to claim and
+    //! complete the chunks
+    template<typename Body>
+    static void Run(TinyTasksPool& pool, const std::shared_ptr<ParallelRange>& range, Body body)
+    {
+        if(range->m_hasCompleted) return;
+        
+        //Helpers that start after the loop ends find no chunks left, so they
+        //only access the range (that they keep alive)
+        const uint64_t numChunks = (range->m_numPendingIndices + range->m_grain - 1) / range->m_grain;
+        const uint32_t numHelpers = static_cast<uint32_t>(std::min<uint64_t>(range->m_numThreads - 1, numChunks - 1));
+        
+        auto helper = [range, body]() mutable { body(*range); };
+        std::vector<decltype(helper)> helpers(numHelpers, helper);
+        
+        for(const TinyTasksPool::TaskHandle& handle : pool.SubmitBatch(helpers.begin(), helpers.end()))
+        {
+            pool.ReleaseTask(handle.GetID());
+        }
+        
+        body(*range);
+        range->Wait(pool);
+    }
+
+private:
+    std::atomic<Index>      m_next;
+    const Index             m_end;
+    const Index             m_grain;
+    const uint32_t          m_numThreads;
+    std::atomic<uint64_t>   m_numPendingIndices;
+    bool                    m_hasCompleted;
+    std::mutex              m_completionMutex;
+    std::condition_variable m_completionCondition;
+};
+
+//! Runs a function for each index of a range, in parallel in the pool
+//! (the calling thread takes part in the loop too)
+//! @param pool where the loop runs
+//! @param first index of the range
+//! @param end of the range (one past the last index)
+//! @param minimum number of indices run by a task at once
+//! @param function called with each index
+//! @note It returns once the function has been called for all the indices
+template<typename Index, typename Function>
+void ParallelFor(TinyTasksPool& pool, const Index begin, const typename std::common_type<Index>::type end,
+                 const typename std::common_type<Index>::type grain, Function function)
+{
+    std::shared_ptr<ParallelRange<Index>> range = std::make_shared<ParallelRange<Index>>(begin, end, grain, pool.GetNumThreads() + 1);
+    Function* loopFunction = &function;
+    
+    ParallelRange<Index>::Run(pool, range, [loopFunction](ParallelRange<Index>& loopRange)
+    {
+        Index chunkBegin = 0;
+        Index chunkEnd = 0;
+        uint64_t numIndices = 0;
+        
+        while(loopRange.Claim(chunkBegin, chunkEnd))
+        {
+            for(Index index = chunkBegin; index < chunkEnd; ++index)
+            {
+                (*loopFunction)(index);
+            }
+            
+            numIndices += static_cast<uint64_t>(chunkEnd - chunkBegin);
+        }
+        
+        loopRange.Complete(numIndices);
+    });
+}
+
+//! Reduces the values of a range of indices, in parallel in the pool
+//! (the calling thread takes part in the loop too)
+//! @param pool where the loop runs
+//! @param first index of the range
+//! @param end of the range (one past the last index)
+//! @param minimum number of indices run by a task at once
+//! @param identity value of the reduction
+//! @param function that gets the value of an index
+//! @param function that combines two values (it has to be associative and
+//! commutative, as the values are combined in any order)
+//! @return the combined values of all the indices
+template<typename Index, typename Value, typename Transform, typename Combine>
+Value ParallelReduce(TinyTasksPool& pool, const Index begin, const typename std::common_type<Index>::type end,
+                     const typename std::common_type<Index>::type grain, const Value identity,
+                     Transform transform, Combine combine)
+{
+    std::shared_ptr<ParallelRange<Index>> range = std::make_shared<ParallelRange<Index>>(begin, end, grain, pool.GetNumThreads() + 1);
+    
+    Value result = identity;
+    std::mutex resultMutex;
+    
+    //The data of the loop is only accessed once a chunk is claimed, as the
+    //loop could have returned already
+    struct LoopData
+    {
+        const Value*    identity;
+        Transform*      transform;
+        Combine*        combine;
+        Value*          result;
+        std::mutex*     resultMutex;
+    };
+    
+    const LoopData loopData = { &identity, &transform, &combine, &result, &resultMutex };
+    
+    ParallelRange<Index>::Run(pool, range, [loopData](ParallelRange<Index>& loopRange)
+    {
+        Index chunkBegin = 0;
+        Index chunkEnd = 0;
+        if(!loopRange.Claim(chunkBegin, chunkEnd)) return;
+        
+        Value partialResult = *loopData.identity;
+        uint64_t numIndices = 0;
+        
+        do
+        {
+            for(Index index = chunkBegin; index < chunkEnd; ++index)
+            {
+                partialResult = (*loopData.combine)(partialResult, (*loopData.transform)(index));
+            }
+            
+            numIndices += static_cast<uint64_t>(chunkEnd - chunkBegin);
+        }
+        while(loopRange.Claim(chunkBegin, chunkEnd));
+        
+        {
+            std::lock_guard<std::mutex> lock(*loopData.resultMutex);
+            *loopData.result = (*loopData.combine)(*loopData.result, partialResult);
+        }
+        
+        loopRange.Complete(numIndices);
+    });
+    
+    return result;
+}
+
+//! @brief Graph of tasks with dependencies, run in a TinyTasksPool
+//!
+//! @details
+//! Add the nodes (each one with a lambda to run) and the edges between
+//! them, then call Run() to start the graph in the pool. The nodes without
+//! predecessors start straight away, and each node starts as soon as its
+//! last predecessor completes, from the worker thread that ran it (so
+//! there is no polling between stages). Wait() blocks until all the nodes
+//! have completed.
+//! The graph keeps its nodes and edges after it completes, so it can be
+//! run again without rebuilding it: only the dependency counters are
+//! reset for each run.
+//!
+//! @note Nodes and edges can't be added while the graph is running
+//!
+class TaskGraph : public NonCopyableMovable
+{
+public:
+    //! Node identifier, in the order the nodes are added
+    typedef uint32_t NodeID;
+    
+    //! Possible results for the graph operations
+    enum Result
+    {
+        SUCCEEDED,
+        ALREADY_RUNNING,
+        HAS_CYCLE,
+        SHUT_DOWN,
+    };
+    
+    //! Initialize the graph
+    //! @param pool where the graph runs
+    explicit TaskGraph(TinyTasksPool& pool) : m_pool(pool), m_isValidated(true), m_isRunning(false), m_numPendingNodes(0) {}
+    
+    //! Destroys the graph (it can't be running)
+    ~TaskGraph()
+    {
+        Wait();
+    }
+    
+    //! Adds a node to the graph
+    //! @param lambda function to run in the node (has to be valid)
+    //! @return ID of the new node
+    template<typename Function>
+    NodeID AddNode(Function&& function)
+    {
+        assert(!IsRunning() && "Can't add nodes to a running graph");
+        
+        m_nodes.push_back(std::unique_ptr<Node>(new Node()));
+        m_nodes.back()->function.Assign(std::forward<Function>(function));
+        assert(m_nodes.back()->function && "Node requires a valid (non-nullptr) lambda");
+        
+        return static_cast<NodeID>(m_nodes.size() - 1);
+    }
+    
+    //! Adds an edge to the graph, so a node runs after another one
+    //! @param ID of the node that runs first
+    //! @param ID of the node that runs after it
+    void AddEdge(const NodeID predecessor, const NodeID successor)
+    {
+        assert(!IsRunning() && "Can't add edges to a running graph");
+        assert(predecessor < m_nodes.size() && successor < m_nodes.size() && "Node not found!");
+        assert(predecessor != successor && "A node can't run after itself");
+        
+        m_nodes[predecessor]->successors.push_back(successor);
+        m_nodes[successor]->numPredecessors++;
+        m_isValidated = false;
+    }
+    
+    //! Starts running the graph in the pool
+    //! @return ALREADY_RUNNING if the previous run hasn't completed,
+    //! HAS_CYCLE if the edges make a cycle (so it can't complete), or
+    //! SHUT_DOWN if the pool is shut down (it mustn't be shut down meanwhile)
+    Result Run()
+    {
+        if(m_nodes.empty()) return Result::SUCCEEDED;
+        
+        if(!m_isValidated)
+        {
+            if(HasCycle()) return Result::HAS_CYCLE;
+            m_isValidated = true;
+        }
+        
+        {
+            std::lock_guard<std::mutex> lock(m_completionMutex);
+            if(m_isRunning) return Result::ALREADY_RUNNING;
+            if(!m_pool.IsAcceptingTasks()) return Result::SHUT_DOWN;
+            m_isRunning = true;
+        }
+        
+        std::vector<NodeRunner> rootRunners;
+        
+        for(NodeID nodeID = 0; nodeID < m_nodes.size(); ++nodeID)
+        {
+            Node& node = *m_nodes[nodeID];
+            node.numPendingPredecessors.store(node.numPredecessors, std::memory_order_relaxed);
+            
+            if(node.numPredecessors == 0)
+            {
+                NodeRunner runner = { this, nodeID };
+                rootRunners.push_back(runner);
+            }
+        }
+        
+        m_numPendingNodes = static_cast<uint32_t>(m_nodes.size());
+        
+        for(const TinyTasksPool::TaskHandle& handle : m_pool.SubmitBatch(rootRunners.begin(), rootRunners.end()))
+        {
+            m_pool.ReleaseTask(handle.GetID());
+        }
+        
+        return Result::SUCCEEDED;
+    }
+    
+    //! Blocks the current thread until the graph completes (if running).
+    //! Called from a task lambda, it runs queued tasks meanwhile (see
+    //! TinyTasksPool::Wait())
+    void Wait()
+    {
+        if(m_pool.IsHelpingThread())
+        {
+            m_pool.HelpUntil(m_pool.GetCurrentWorker(), [this]
+            {
+                std::lock_guard<std::mutex> lock(m_completionMutex);
+                return !m_isRunning;
+            });
+            return;
+        }
+        
+        std::unique_lock<std::mutex> lock(m_completionMutex);
+        m_completionCondition.wait(lock, [this]{ return !m_isRunning; });
+    }
+    
+    //! Gets if the graph is running
+    bool IsRunning()
+    {
+        std::lock_guard<std::mutex> lock(m_completionMutex);
+        return m_isRunning;
+    }
+    
+    //! Gets the number of nodes in the graph
+    size_t GetNumNodes() const { return m_nodes.size(); }
+
+private:
+    //! Node of the graph, and its dependencies
+    struct Node
+    {
+        Node() : numPredecessors(0), numPendingPredecessors(0) {}
+        
+        TaskFunction            function;
+        std::vector<NodeID>     successors;
+        uint32_t                numPredecessors;
+        std::atomic<uint32_t>   numPendingPredecessors;
+    };
+    
+    //! Lambda of the pool tasks that run the nodes (it fits inline)
+    struct NodeRunner
+    {
+        void operator()() { graph->RunNode(nodeID); }
+        
+        TaskGraph*  graph;
+        NodeID      nodeID;
+    };
+    
+    //! Runs a node, starts the successors that don't wait for other nodes,
+    //! and completes the graph after its last node
+    void RunNode(const NodeID nodeID)
+    {
+        Node& node = *m_nodes[nodeID];
+        node.function();
+        
+        for(NodeID successor : node.successors)
+        {
+            if(--m_nodes[successor]->numPendingPredecessors == 0)
+            {
+                //Once a shutdown has timed out, the graph finishes in this task
+                NodeRunner runner = { this, successor };
+                if(m_pool.SubmitInternal(runner) == TinyTasksPool::Result::SHUT_DOWN) RunNode(successor);
+            }
+        }
+        
+        //The successors are started before, so the graph can't complete early.
+        //The graph mustn't be accessed after completing, as it can be destroyed
+        if(--m_numPendingNodes > 0) return;
+        
+        std::lock_guard<std::mutex> lock(m_completionMutex);
+        m_isRunning = false;
+        m_completionCondition.notify_all();
+    }
+    
+    //! Gets if the edges make a cycle (Kahn's algorithm)
+    bool HasCycle() const
+    {
+        std::vector<uint32_t> numPendingPredecessors(m_nodes.size());
+        std::vector<NodeID> readyNodes;
+        
+        for(NodeID nodeID = 0; nodeID < m_nodes.size(); ++nodeID)
+        {
+            numPendingPredecessors[nodeID] = m_nodes[nodeID]->numPredecessors;
+            if(numPendingPredecessors[nodeID] == 0) readyNodes.push_back(nodeID);
+        }
+        
+        size_t numSortedNodes = 0;
+        
+        while(!readyNodes.empty())
+        {
+            const NodeID nodeID = readyNodes.back();
+            readyNodes.pop_back();
+            numSortedNodes++;
+            
+            for(NodeID successor : m_nodes[nodeID]->successors)
+            {
+                if(--numPendingPredecessors[successor] == 0) readyNodes.push_back(successor);
+            }
+        }
+        
+        return numSortedNodes != m_nodes.size();
+    }
+    
+    TinyTasksPool&                      m_pool;
+    std::vector<std::unique_ptr<Node>>  m_nodes;
+    bool                                m_isValidated;
+    bool                                m_isRunning;
+    std::atomic<uint32_t>               m_numPendingNodes;
+    std::mutex                          m_completionMutex;
+    std::condition_variable             m_completionCondition;
+};
+    
+//! @brief Output stage that writes files from its own I/O thread, so the
+//! tasks that produce the output don't block on the filesystem
+//!
+//! @details
+//! Each task opens a Stream and appends to it. The stream fills buffers
+//! of a fixed size, taken from a pool of pre-allocated buffers, so
+//! appending doesn't reallocate. Full buffers are handed to the I/O thread,
+//! which opens the files, coalesces the queued buffers of each file and
+//! writes them with one vectored write (writev), and puts the buffers back
+//! in the pool. If the pool runs out of buffers (the disk is slower than
+//! the producers), a new buffer is allocated instead of blocking, and it's
+//! counted in the stats. IsBackedUp() tells when the queued output goes
+//! over a limit, so the producers can slow down.
+//!
+//! @note Streams are used by one thread at a time, and have to be closed
+//! (or destroyed) before the writer. Errors of a file (e.g. it can't be
+//! opened) are reported by Stream::HasFailed() and in the stats
+//!
+class AsyncFileWriter : public NonCopyableMovable
+{
+private:
+    struct Buffer;
+    struct File;
+    
+public:
+    static const size_t     kDefaultBufferSize      = 64 * 1024;
+    static const uint32_t   kDefaultNumBuffers      = 32;
+    
+    //! @brief Snapshot of the counters of the writer (see GetStats())
+    struct Stats
+    {
+        uint64_t    numWrittenBytes;
+        //! Calls to write to the files (each one with several buffers)
+        uint64_t    numWrites;
+        uint64_t    numWrittenBuffers;
+        //! Bytes handed to the I/O thread that aren't written yet
+        uint64_t    numQueuedBytes;
+        //! Buffers allocated after the pool ran out of them
+        uint64_t    numExtraBuffers;
+        //! Files that couldn't be opened or written
+        uint64_t    numFailedFiles;
+    };
+    
+    //! @brief Output to one file of the writer
+    class Stream
+    {
+    public:
+        //! Initialize an empty stream (not tied to any file)
+        Stream() : m_writer(nullptr), m_buffer(nullptr) {}
+        
+        Stream(Stream&& other) : m_writer(other.m_writer), m_file(std::move(other.m_file)), m_buffer(other.m_buffer)
+        {
+            other.m_writer = nullptr;
+            other.m_buffer = nullptr;
+        }
+        
+        Stream& operator=(Stream&& other)
+        {
+            if(this != &other)
+            {
+                Close();
+                std::swap(m_writer, other.m_writer);
+                std::swap(m_file, other.m_file);
+                std::swap(m_buffer, other.m_buffer);
+            }
+            
+            return *this;
+        }
+        
+        Stream(const Stream&)            = delete;
+        Stream& operator=(const Stream&) = delete;
+        
+        ~Stream() { Close(); }
+        
+        //! Gets if the stream is tied to a file
+        bool IsOpen()       const { return m_writer != nullptr; }
+        //! Gets if the file couldn't be opened or written (also once the
+        //! stream is closed, after Flush())
+        bool HasFailed()    const { return m_file && m_file->hasFailed; }
+        
+        //! Appends data to the file. It's copied to the buffer of the
+        //! stream, and the full buffers are queued to be written
+        void Append(const char* data, size_t size)
+        {
+            assert(IsOpen() && "Can't append to a stream that isn't open");
+            
+            while(size > 0)
+            {
+                if(m_buffer == nullptr) m_buffer = m_writer->AcquireBuffer();
+                
+                const size_t numCopiedBytes = std::min(size, m_buffer->capacity - m_buffer->size);
+                memcpy(m_buffer->data.get() + m_buffer->size, data, numCopiedBytes);
+                m_buffer->size += numCopiedBytes;
+                data += numCopiedBytes;
+                size -= numCopiedBytes;
+                
+                if(m_buffer->size == m_buffer->capacity) Flush();
+            }
+        }
+        
+        void Append(const std::string& text) { Append(text.data(), text.size()); }
+        
+        //! Queues the buffer of the stream to be written, even if it isn't full
+        void Flush()
+        {
+            if(m_buffer == nullptr) return;
+            
+            m_writer->QueueRequest(m_file, m_buffer, false);
+            m_buffer = nullptr;
+        }
+        
+        //! Queues the rest of the output, and the file is closed once it's
+        //! written. The stream isn't tied to the file anymore
+        void Close()
+        {
+            if(!IsOpen()) return;
+            
+            m_writer->QueueRequest(m_file, m_buffer, true);
+            m_writer->m_numOpenStreams--;
+            m_writer = nullptr;
+            m_buffer = nullptr;
+        }
+        
+    private:
+        friend class AsyncFileWriter;
+        
+        Stream(AsyncFileWriter* writer, std::shared_ptr<File> file) : m_writer(writer), m_file(std::move(file)), m_buffer(nullptr) {}
+        
+        AsyncFileWriter*        m_writer;
+        std::shared_ptr<File>   m_file;
+        Buffer*                 m_buffer;
+    };
+    
+    //! Initialize the writer, and start its I/O thread
+    //! @param size in bytes of each buffer
+    //! @param number of buffers allocated up front
+    //! @param queued bytes from which the writer is backed up (0 to use the
+    //! size of all the buffers allocated up front)
+    explicit AsyncFileWriter(const size_t bufferSize = kDefaultBufferSize, const uint32_t numBuffers = kDefaultNumBuffers,
+                             const size_t maxNumQueuedBytes = 0)
+            : m_bufferSize(bufferSize), m_maxNumQueuedBytes(maxNumQueuedBytes ? maxNumQueuedBytes : bufferSize * numBuffers),
+              m_numOpenStreams(0), m_stop(false), m_numPendingRequests(0), m_numWrittenBytes(0), m_numWrites(0),
+              m_numWrittenBuffers(0), m_numQueuedBytes(0), m_numExtraBuffers(0), m_numFailedFiles(0)
+    {
+        assert(bufferSize > 0);
+        
+        for(uint32_t bufferIndex = 0; bufferIndex < numBuffers; ++bufferIndex)
+        {
+            m_buffers.emplace_back(new Buffer(bufferSize));
+            m_freeBuffers.push_back(m_buffers.back().get());
+        }
+        
+        m_thread = std::thread(&AsyncFileWriter::Run, this);
+    }
+    
+    //! Writes the queued output, closes the files and stops the I/O thread
+    ~AsyncFileWriter()
+    {
+        assert(m_numOpenStreams == 0 && "There are streams still open. They must be closed before the writer is destroyed");
+        
+        {
+            std::lock_guard<std::mutex> lock(m_requestsMutex);
+            m_stop = true;
+            m_requestsCondition.notify_one();
+        }
+        
+        m_thread.join();
+    }
+    
+    //! Opens a stream to write a file. The file is created (or truncated)
+    //! by the I/O thread, before its first write
+    //! @param path of the file
+    Stream Open(const std::string& path)
+    {
+        std::shared_ptr<File> file = std::make_shared<File>(path);
+        m_numOpenStreams++;
+        
+        return Stream(this, std::move(file));
+    }
+    
+    //! Blocks the current thread until the output queued so far is written
+    //! (the buffers that the streams are still filling aren't queued yet)
+    void Flush()
+    {
+        std::unique_lock<std::mutex> lock(m_requestsMutex);
+        m_flushedCondition.wait(lock, [this]{ return m_numPendingRequests == 0; });
+    }
+    
+    //! Gets if the output queued for the I/O thread has gone over the limit
+    bool IsBackedUp() const { return m_numQueuedBytes >= m_maxNumQueuedBytes; }
+    
+    //! Gets a snapshot of the counters of the writer
+    Stats GetStats() const
+    {
+        Stats stats;
+        stats.numWrittenBytes   = m_numWrittenBytes;
+        stats.numWrites         = m_numWrites;
+        stats.numWrittenBuffers = m_numWrittenBuffers;
+        stats.numQueuedBytes    = m_numQueuedBytes;
+        stats.numExtraBuffers   = m_numExtraBuffers;
+        stats.numFailedFiles    = m_numFailedFiles;
+        
+        return stats;
+    }
+    
+private:
+    //! Pre-sized buffer of output
+    struct Buffer
+    {
+        explicit Buffer(const size_t bufferCapacity) : data(new char[bufferCapacity]), capacity(bufferCapacity), size(0) {}
+        
+        std::unique_ptr<char[]> data;
+        size_t                  capacity;
+        size_t                  size;
+    };
+    
+    //! File written by a stream (only the I/O thread opens and writes it)
+    struct File
+    {
+        explicit File(const std::string& filePath) : path(filePath), handle(nullptr), hasFailed(false) {}
+        
+        std::string         path;
+        std::FILE*          handle;
+        std::atomic<bool>   hasFailed;
+    };
+    
+    //! Buffer to write to a file, and whether to close the file afterwards
+    struct Request
+    {
+        std::shared_ptr<File>   file;
+        Buffer*                 buffer;
+        bool                    isClosing;
+    };
+    
+    //! Requests of a file, coalesced by the I/O thread
+    struct FileBatch
+    {
+        std::shared_ptr<File>   file;
+        std::vector<Buffer*>    buffers;
+        bool                    isClosing;
+    };
+    
+#if defined(IOV_MAX) && IOV_MAX < 1024
+    static const int kMaxNumBuffersPerWrite = IOV_MAX;
+#else
+    static const int kMaxNumBuffersPerWrite = 1024;
+#endif
+    
+    //! Takes a buffer from the pool, or allocates a new one if it's empty
+    Buffer* AcquireBuffer()
+    {
+        std::lock_guard<std::mutex> lock(m_buffersMutex);
+        
+        if(m_freeBuffers.empty())
+        {
+            m_numExtraBuffers++;
+            m_buffers.emplace_back(new Buffer(m_bufferSize));
+            return m_buffers.back().get();
+        }
+        
+        Buffer* buffer = m_freeBuffers.back();
+        m_freeBuffers.pop_back();
+        
+        return buffer;
+    }
+    
+    void ReleaseBuffer(Buffer* buffer)
+    {
+        buffer->size = 0;
+        
+        std::lock_guard<std::mutex> lock(m_buffersMutex);
+        m_freeBuffers.push_back(buffer);
+    }
+    
+    void QueueRequest(const std::shared_ptr<File>& file, Buffer* buffer, const bool isClosing)
+    {
+        if(buffer) m_numQueuedBytes += buffer->size;
+        
+        Request request = { file, buffer, isClosing };
+        
+        std::lock_guard<std::mutex> lock(m_requestsMutex);
+        m_requests.push_back(std::move(request));
+        m_numPendingRequests++;
+        m_requestsCondition.notify_one();
+    }
+    
+    //! Function of the I/O thread: takes all the queued requests at once,
+    //! and writes the buffers of each file together
+    void Run()
+    {
+        std::vector<Request> requests;
+        std::vector<FileBatch> batches;
+        std::unique_lock<std::mutex> lock(m_requestsMutex);
+        
+        while(true)
+        {
+            m_requestsCondition.wait(lock, [this]{ return m_stop || !m_requests.empty(); });
+            if(m_requests.empty()) break;
+            
+            requests.swap(m_requests);
+            lock.unlock();
+            
+            //A stream queues its buffers in order, and the close last
+            for(Request& request : requests)
+            {
+                auto batchIt = std::find_if(batches.begin(), batches.end(), [&request](const FileBatch& batch)
+                {
+                    return batch.file == request.file;
+                });
+                
+                if(batchIt == batches.end())
+                {
+                    FileBatch batch;
+                    batch.file = std::move(request.file);
+                    batch.isClosing = false;
+                    batches.push_back(std::move(batch));
+                    batchIt = batches.end() - 1;
+                }
+                
+                if(request.buffer && request.buffer->size > 0) batchIt->buffers.push_back(request.buffer);
+                else if(request.buffer) ReleaseBuffer(request.buffer);
+                batchIt->isClosing |= request.isClosing;
+            }
+            
+            for(FileBatch& batch : batches) WriteBatch(batch);
+            
+            const size_t numRequests = requests.size();
+            requests.clear();
+            batches.clear();
+            
+            lock.lock();
+            m_numPendingRequests -= numRequests;
+            if(m_numPendingRequests == 0) m_flushedCondition.notify_all();
+        }
+    }
+    
+    //! Writes the buffers of a file, and closes it if it's requested
+    void WriteBatch(FileBatch& batch)
+    {
+        File& file = *batch.file;
+        
+        if(file.handle == nullptr && !file.hasFailed)
+        {
+            file.handle = std::fopen(file.path.c_str(), "wb");
+            if(file.handle == nullptr) SetFileFailed(file);
+        }
+        
+        size_t numBatchBytes = 0;
+        for(Buffer* buffer : batch.buffers) numBatchBytes += buffer->size;
+        
+        if(file.handle && !batch.buffers.empty())
+        {
+            if(!WriteBuffers(file.handle, batch.buffers)) SetFileFailed(file);
+        }
+        
+        m_numQueuedBytes -= numBatchBytes;
+        for(Buffer* buffer : batch.buffers) ReleaseBuffer(buffer);
+        
+        if(batch.isClosing && file.handle)
+        {
+            if(std::fclose(file.handle) != 0) SetFileFailed(file);
+            file.handle = nullptr;
+        }
+    }
+    
+    //! Writes a list of buffers to a file, as few calls as possible
+    //! @return false if the file couldn't be written
+    bool WriteBuffers(std::FILE* handle, const std::vector<Buffer*>& buffers)
+    {
+#if defined(TINYTASKS_HAS_WRITEV)
+        const int fileDescriptor = fileno(handle);
+        
+        for(size_t firstBuffer = 0; firstBuffer < buffers.size(); firstBuffer += kMaxNumBuffersPerWrite)
+        {
+            iovec vectors[kMaxNumBuffersPerWrite];
+            const int numVectors = static_cast<int>(std::min<size_t>(buffers.size() - firstBuffer, kMaxNumBuffersPerWrite));
+            
+            for(int vectorIndex = 0; vectorIndex < numVectors; ++vectorIndex)
+            {
+                vectors[vectorIndex].iov_base = buffers[firstBuffer + vectorIndex]->data.get();
+                vectors[vectorIndex].iov_len = buffers[firstBuffer + vectorIndex]->size;
+            }
+            
+            //Partial writes go on from the first vector that isn't written
+            iovec* nextVector = vectors;
+            int numPendingVectors = numVectors;
+            
+            while(numPendingVectors > 0)
+            {
+                const ssize_t numBytes = writev(fileDescriptor, nextVector, numPendingVectors);
+                
+                if(numBytes < 0)
+                {
+                    if(errno == EINTR) continue;
+                    return false;
+                }
+                
+                m_numWrites++;
+                m_numWrittenBytes += static_cast<uint64_t>(numBytes);
+                
+                size_t numRemainingBytes = static_cast<size_t>(numBytes);
+                while(numPendingVectors > 0 && numRemainingBytes >= nextVector->iov_len)
+                {
+                    numRemainingBytes -= nextVector->iov_len;
+                    nextVector++;
+                    numPendingVectors--;
+                }
+                
+                if(numPendingVectors > 0)
+                {
+                    nextVector->iov_base = static_cast<char*>(nextVector->iov_base) + numRemainingBytes;
+                    nextVector->iov_len -= numRemainingBytes;
+                }
+            }
+        }
+#else
+        for(Buffer* buffer : buffers)
+        {
+            if(std::fwrite(buffer->data.get(), 1, buffer->size, handle) != buffer->size) return false;
+            m_numWrites++;
+            m_numWrittenBytes += buffer->size;
+        }
+#endif
+        
+        m_numWrittenBuffers += buffers.size();
+        
+        return true;
+    }
+    
+    void SetFileFailed(File& file)
+    {
+        if(!file.hasFailed.exchange(true)) m_numFailedFiles++;
+    }
+    
+    const size_t                            m_bufferSize;
+    const size_t                            m_maxNumQueuedBytes;
+    std::vector<std::unique_ptr<Buffer>>    m_buffers;
+    std::vector<Buffer*>                    m_freeBuffers;
+    std::mutex                              m_buffersMutex;
+    std::atomic<uint32_t>                   m_numOpenStreams;
+    std::vector<Request>                    m_requests;
+    bool                                    m_stop;
+    size_t                                  m_numPendingRequests;
+    std::mutex                              m_requestsMutex;
+    std::condition_variable                 m_requestsCondition;
+    std::condition_variable                 m_flushedCondition;
+    std::thread                             m_thread;
+    std::atomic<uint64_t>                   m_numWrittenBytes;
+    std::atomic<uint64_t>                   m_numWrites;
+    std::atomic<uint64_t>                   m_numWrittenBuffers;
+    std::atomic<uint64_t>                   m_numQueuedBytes;
+    std::atomic<uint64_t>                   m_numExtraBuffers;
+    std::atomic<uint64_t>                   m_numFailedFiles;
+};
+
+#if TINYTASKS_ENABLE_COROUTINES
+//! @brief Part of the promise of a CoTask that doesn't depend on its result
+//!
+//! @details
+//! Coroutine tasks start suspended, and run once they're awaited. When
+//! they finish, the awaiting coroutine is resumed straight away on the same
+//! thread (by symmetric transfer, so long chains don't grow the stack).
+//!
+class CoTaskPromiseBase
+{
+public:
+    //! Awaiter of the end of the coroutine, which resumes the awaiting one
+    struct FinalAwaiter
+    {
+        bool await_ready() const noexcept { return false; }
+        
+        template<typename Promise>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept
+        {
+            const std::coroutine_handle<> continuation = handle.promise().m_continuation;
+            return continuation ? continuation : std::noop_coroutine();
+        }
+        
+        void await_resume() const noexcept {}
+    };
+    
+    std::suspend_always initial_suspend()   const noexcept { return {}; }
+    FinalAwaiter        final_suspend()     const noexcept { return {}; }
+    //! The library doesn't use exceptions, so they can't leave a coroutine
+    void                unhandled_exception() const { std::terminate(); }
+    
+    //! Sets the coroutine to resume once this one finishes
+    void SetContinuation(const std::coroutine_handle<> continuation) { m_continuation = continuation; }
+    
+private:
+    std::coroutine_handle<> m_continuation;
+};
+
+//! @brief Promise of a CoTask, which keeps its result
+template<typename T>
+class CoTaskPromise : public CoTaskPromiseBase
+{
+public:
+    CoTask<T> get_return_object();
+    
+    template<typename Value>
+    void return_value(Value&& value) { m_value.emplace(std::forward<Value>(value)); }
+    
+    //! Moves the result out (the coroutine has to be finished)
+    T TakeValue() { return std::move(*m_value); }
+    
+private:
+    std::optional<T> m_value;
+};
+
+//! @brief Promise of a CoTask of void (there's no result)
+template<>
+class CoTaskPromise<void> : public CoTaskPromiseBase
+{
+public:
+    CoTask<void> get_return_object();
+    
+    void return_void() {}
+    void TakeValue() {}
+};
+
+//! @brief Coroutine that returns a result, and can be awaited from other
+//! coroutines
+//!
+//! @details
+//! A CoTask owns its coroutine, and starts it when it's awaited, on the
+//! thread that awaits it. A coroutine that does co_await pool.Schedule()
+//! or co_await pool.Delay() is resumed in a task of the pool, and doesn't
+//! hold a worker while it's suspended, so a few workers can multiplex many
+//! coroutines. Spawn() runs a coroutine task in the pool, and gets a future
+//! of its result for code that isn't a coroutine.
+//!
+//! @note A CoTask can only be awaited once
+//!
+template<typename T>
+class CoTask
+{
+public:
+    typedef CoTaskPromise<T> promise_type;
+    
+    //! Initialize an empty task (not tied to any coroutine)
+    CoTask() {}
+    
+    CoTask(CoTask&& other) noexcept : m_handle(std::exchange(other.m_handle, nullptr)) {}
+    
+    CoTask& operator=(CoTask&& other) noexcept
+    {
+        if(this != &other)
+        {
+            Destroy();
+            m_handle = std::exchange(other.m_handle, nullptr);
+        }
+        
+        return *this;
+    }
+    
+    CoTask(const CoTask&)            = delete;
+    CoTask& operator=(const CoTask&) = delete;
+    
+    ~CoTask() { Destroy(); }
+    
+    //! Gets if the task is tied to a coroutine
+    bool IsValid()  const { return static_cast<bool>(m_handle); }
+    //! Gets if the coroutine has finished
+    bool IsDone()   const { return m_handle && m_handle.done(); }
+    
+    //! @brief Awaiter that starts the coroutine of a task, and gets its result
+    class Awaiter
+    {
+    public:
+        explicit Awaiter(const std::coroutine_handle<promise_type> handle) : m_handle(handle) {}
+        
+        bool await_ready() const { return m_handle.done(); }
+        
+        std::coroutine_handle<> await_suspend(const std::coroutine_handle<> continuation)
+        {
+            m_handle.promise().SetContinuation(continuation);
+            return m_handle;
+        }
+        
+        T await_resume() { return m_handle.promise().TakeValue(); }
+        
+    private:
+        std::coroutine_handle<promise_type> m_handle;
+    };
+    
+    Awaiter operator co_await() const
+    {
+        assert(m_handle && "Can't await an empty coroutine task");
+        return Awaiter(m_handle);
+    }
+    
+private:
+    friend class CoTaskPromise<T>;
+    
+    explicit CoTask(const std::coroutine_handle<promise_type> handle) : m_handle(handle) {}
+    
+    void Destroy()
+    {
+        if(m_handle) m_handle.destroy();
+        m_handle = nullptr;
+    }
+    
+    std::coroutine_handle<promise_type> m_handle;
+};
+
+template<typename T>
+CoTask<T> CoTaskPromise<T>::get_return_object()
+{
+    return CoTask<T>(std::coroutine_handle<CoTaskPromise<T>>::from_promise(*this));
+}
+
+inline CoTask<void> CoTaskPromise<void>::get_return_object()
+{
+    return CoTask<void>(std::coroutine_handle<CoTaskPromise<void>>::from_promise(*this));
+}
+
+//! @brief Awaiter of a future, which resumes the coroutine on the thread
+//! that makes the future ready
+template<typename T>
+class FutureAwaiter
+{
+public:
+    explicit FutureAwaiter(Future<T> future) : m_future(std::move(future)) {}
+    
+    bool await_ready() const { return m_future.IsReady(); }
+    
+    void await_suspend(const std::coroutine_handle<> handle)
+    {
+        //The continuation can resume the coroutine before Then() returns,
+        //and destroy the awaiter, so the state is kept alive meanwhile
+        Future<T> future = m_future;
+        future.Then(Resume{ handle });
+    }
+    
+    typename FutureValue<T>::Reference await_resume() const { return m_future.Get(); }
+    
+private:
+    //! Continuation of the future that resumes the coroutine
+    struct Resume
+    {
+        void operator()() const { handle.resume(); }
+        template<typename Value>
+        void operator()(const Value&) const { handle.resume(); }
+        
+        std::coroutine_handle<> handle;
+    };
+    
+    Future<T> m_future;
+};
+
+//! Awaits a future from a coroutine, without blocking the thread
+template<typename T>
+FutureAwaiter<T> operator co_await(const Future<T>& future)
+{
+    return FutureAwaiter<T>(future);
+}
+
+//! @brief Coroutine that isn't owned, and frees itself when it finishes
+//! (only used by Spawn())
+struct DetachedCoroutine
+{
+    struct promise_type
+    {
+        DetachedCoroutine   get_return_object()     const { return {}; }
+        std::suspend_never  initial_suspend()       const noexcept { return {}; }
+        std::suspend_never  final_suspend()         const noexcept { return {}; }
+        void                return_void()           const {}
+        void                unhandled_exception()   const { std::terminate(); }
+    };
+};
+
+//! Runs a coroutine task in a task of the pool, and makes a future ready with its result
+template<typename T>
+DetachedCoroutine RunSpawnedCoTask(TinyTasksPool& pool, CoTask<T> task, std::shared_ptr<FutureState<T>> state)
+{
+    co_await pool.Schedule();
+    
+    if constexpr(std::is_void<T>::value)
+    {
+        co_await task;
+        auto setResult = []{};
+        state->SetResultOf(setResult);
+    }
+    else
+    {
+        T result = co_await task;
+        auto setResult = [&result]() -> T { return std::move(result); };
+        state->SetResultOf(setResult);
+    }
+}
+
+//! Runs a coroutine task in the pool, and gets a future of its result
+//! @param pool where the coroutine starts
+//! @param task coroutine to run (has to be valid)
+//! @return future of the result
+//! @note If the pool is shut down, the coroutine runs in the current
+//! thread instead, so the future gets ready unless the coroutine waits for
+//! the pool otherwise (e.g. for a future of Async())
+template<typename T>
+Future<T> Spawn(TinyTasksPool& pool, CoTask<T> task)
+{
+    assert(task.IsValid());
+    
+    std::shared_ptr<FutureState<T>> state = std::make_shared<FutureState<T>>(&pool);
+    RunSpawnedCoTask(pool, std::move(task), state);
+    
+    return Future<T>(state);
+}
+#endif
+
 } // namespace tinytasks
 
 #endif
@@ -143,26 +143,14 @@ int main(int argc, char* argv[])
     
     std::cout << "\nTinyTasks v" << std::string(tinytasks_lib_version()) << " example\n\n";
     
-    //Setup
+    //Setup. The file writer is destroyed after the pool, once the tasks have closed their streams
+    AsyncFileWriter fileWriter;
     TinyTasksPool tasksPool(8);
-    std::vector<uint16_t> taskIDs;
+    std::vector<TaskID> taskIDs;
     std::vector<uint8_t> taskTypeIDs;
     taskIDs.reserve(UINT16_MAX);
     taskTypeIDs.reserve(UINT16_MAX);
     
-    bool abortBackgroundThread = false;
-    std::thread queuedTasksThread([&tasksPool, &abortBackgroundThread]
-    {
-        while(!abortBackgroundThread)
-        {
-            if(tasksPool.GetNumPendingTasks() > 0)
-            {
-                tasksPool.RunPendingTasks();
-                std::this_thread::sleep_for(std::chrono::milliseconds(200));
-            }
-        }
-    });
-    
     const unsigned int inputLength = 64;
     char input[inputLength];
     
@@ -173,7 +161,6 @@ int main(int argc, char* argv[])
         
         if(strcmp(input, "quit") == 0)
         {
-            abortBackgroundThread = true;
             break;
         }
         
@@ -214,7 +201,7 @@ int main(int argc, char* argv[])
                     break;
                 }
 
-                uint16_t taskID = tasksPool.CreateTask();
+                TaskID taskID = tasksPool.CreateTask();
                 taskIDs.push_back(taskID);
                 taskTypeIDs.push_back(2);
 
@@ -230,7 +217,7 @@ int main(int argc, char* argv[])
                         (void)randomNumber;
                         currentTask->SetProgress(static_cast<float>(value + 1) / static_cast<float>(maxIterations) * 100.0f);
                         std::this_thread::sleep_for(std::chrono::milliseconds(200));
-                        currentTask->PauseIfNeeded(100);
+                        currentTask->PauseIfNeeded();
                     }
                 });
                 
@@ -247,7 +234,7 @@ int main(int argc, char* argv[])
                     break;
                 }
                 
-                uint16_t taskID = tasksPool.CreateTask();
+                TaskID taskID = tasksPool.CreateTask();
                 taskIDs.push_back(taskID);
                 TinyTask* currentTask = tasksPool.GetTask(taskID);
                 TinyTasksPool::Result lambdaResult = TinyTasksPool::Result::TASK_NOT_FOUND;
@@ -256,28 +243,24 @@ int main(int argc, char* argv[])
                 {
                     taskTypeIDs.push_back(1);
                     
-                    lambdaResult = tasksPool.SetNewLambdaForTask(taskID, [currentTask]
+                    //The numbers are appended to a pooled buffer, and written by the I/O thread of the writer
+                    lambdaResult = tasksPool.SetNewLambdaForTask(taskID, [currentTask, &fileWriter]
                     {
-                        std::string filename;
                         clock_t timeNow = clock();
-                        filename.append(std::to_string(timeNow) + ".txt");
-                                        
-                        std::FILE* fileToWrite = fopen(filename.c_str(), "w");
+                        AsyncFileWriter::Stream stream = fileWriter.Open(std::to_string(timeNow) + ".txt");
                         
                         const unsigned int maxIterations = 300;
                         for(unsigned int value = 0; value < maxIterations; ++value)
                         {
                             if(currentTask->IsStopping() || currentTask->HasStopped()) break;
                             const float randomNumber = static_cast<float>(rand()) / static_cast<float>(RAND_MAX);
-                            std::string stringToWrite;
-                            stringToWrite.append(std::to_string(randomNumber) + " ");
-                            fwrite(stringToWrite.c_str(), sizeof(char), stringToWrite.size(), fileToWrite);
+                            char text[32];
+                            const int length = snprintf(text, sizeof(text), "%f ", randomNumber);
+                            stream.Append(text, static_cast<size_t>(length));
                             currentTask->SetProgress(static_cast<float>(value + 1) / static_cast<float>(maxIterations) * 100.0f);
                             std::this_thread::sleep_for(std::chrono::milliseconds(200));
-                            currentTask->PauseIfNeeded(100);
+                            currentTask->PauseIfNeeded();
                         }
-                        
-                        fclose(fileToWrite);
                     });
                 }
                 else if(command.value == 2)
@@ -294,7 +277,7 @@ int main(int argc, char* argv[])
                             (void)randomNumber;
                             currentTask->SetProgress(static_cast<float>(value + 1) / static_cast<float>(maxIterations) * 100.0f);
                             std::this_thread::sleep_for(std::chrono::milliseconds(200));
-                            currentTask->PauseIfNeeded(100);
+                            currentTask->PauseIfNeeded();
                         }
                     });
                 }
@@ -306,7 +289,10 @@ int main(int argc, char* argv[])
                 assert(lambdaResult == TinyTasksPool::Result::SUCCEEDED || lambdaResult == TinyTasksPool::Result::SUCCEEDED_AT_QUEUE);
                 
                 //Wait until task starts running (if it's not queued)
-                while(!currentTask->IsRunning() && lambdaResult != TinyTasksPool::Result::SUCCEEDED_AT_QUEUE) {}
+                if(lambdaResult == TinyTasksPool::Result::SUCCEEDED)
+                {
+                    tasksPool.WaitForStatus(taskID, TinyTask::Status::RUNNING);
+                }
                 
                 std::cout << "Created task of type " << std::to_string(command.value) << " and ID " << std::to_string(taskID) << "\n\n";
                 break;
@@ -321,7 +307,7 @@ int main(int argc, char* argv[])
                 }
                 
                 task->Pause();
-                while(!task->IsPaused()) {}
+                task->WaitForStatus(TinyTask::Status::PAUSED);
                 std::cout << "Task ID " << std::to_string(task->GetID()) << " has paused\n\n";
                 break;
             }
@@ -337,7 +323,7 @@ int main(int argc, char* argv[])
                 if(task->GetProgress() > 0.0f)
                 {
                     task->Resume();
-                    while(!task->IsRunning()) {}
+                    task->WaitForStatus(TinyTask::Status::RUNNING);
                     std::cout << "Task ID " << std::to_string(task->GetID()) << " has resumed\n\n";
                 }
                 else
@@ -359,9 +345,9 @@ int main(int argc, char* argv[])
                 if(task->GetProgress() > 0.0f)
                 {
                     if(task->IsPaused()) task->Resume();
-                    while(!task->IsRunning()) {}
+                    task->WaitForStatus(TinyTask::Status::RUNNING);
                     task->Stop();
-                    while(task->IsStopping() || !task->HasStopped()) {}
+                    task->WaitForStatus(TinyTask::Status::STOPPED);
                     std::cout << "Task ID " << std::to_string(task->GetID()) << " has stopped\n\n";
                 }
                 else
@@ -433,30 +419,34 @@ int main(int argc, char* argv[])
         }
     }
     
-    //Stop tasks that are running before closing
-    for(unsigned int taskIndex = 0; taskIndex < taskIDs.size(); ++taskIndex)
+    //Stop tasks that are running before closing. Pending tasks start as soon as
+    //a worker is free, so keep stopping them until the queue is empty
+    do
     {
-        TinyTask* currentTask = tasksPool.GetTask(taskIDs[taskIndex]);
-        assert(currentTask);
-        
-        if(currentTask->IsRunning())
+        for(unsigned int taskIndex = 0; taskIndex < taskIDs.size(); ++taskIndex)
         {
-            currentTask->Stop();
-            while(currentTask->IsStopping() && !currentTask->HasStopped()) {}
-        }
-        
-        if(currentTask->IsPaused() && currentTask->GetProgress() > 0.0f)
-        {
-            currentTask->Resume();
-            while(!currentTask->IsRunning()) {}
-            currentTask->Stop();
-            while(currentTask->IsStopping() && !currentTask->HasStopped()) {}
+            TinyTask* currentTask = tasksPool.GetTask(taskIDs[taskIndex]);
+            assert(currentTask);
+            
+            if(currentTask->IsRunning())
+            {
+                currentTask->Stop();
+                currentTask->WaitForStatus(TinyTask::Status::STOPPED);
+            }
+            
+            if(currentTask->IsPaused() && currentTask->GetProgress() > 0.0f)
+            {
+                currentTask->Resume();
+                currentTask->WaitForStatus(TinyTask::Status::RUNNING);
+                currentTask->Stop();
+                currentTask->WaitForStatus(TinyTask::Status::STOPPED);
+            }
         }
     }
+    while(tasksPool.GetNumPendingTasks() > 0 || tasksPool.GetNumRunningTasks() > 0);
     
     //Cleanup
     taskIDs.clear();
-    queuedTasksThread.join();
 
     return 0;
 }
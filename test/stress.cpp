@@ -0,0 +1,305 @@
+#include "gtest/gtest.h"
+#include "../include/tinytasks.h"
+
+#include <cstdlib>
+#include <random>
+
+using namespace tinytasks;
+
+//! Multiplies the number of tasks and rounds of the stress tests, with the
+//! environment variable TINYTASKS_STRESS_SCALE (e.g. 0.05 for the sanitizer
+//! builds, which run 5-20 times slower)
+uint32_t GetScaled(const uint32_t count)
+{
+    const char* scale = std::getenv("TINYTASKS_STRESS_SCALE");
+    const double factor = scale ? std::atof(scale) : 1.0;
+
+    return std::max<uint32_t>(1, static_cast<uint32_t>(count * factor));
+}
+
+TEST(TinyTasksStressTest, TestSubmitMillionsOfTasksWhileQueryingThePool)
+{
+    const uint32_t numProducers = 8;
+    const uint32_t numTasksPerProducer = GetScaled(1000000) / numProducers;
+    const uint32_t batchSize = 64;
+
+    TinyTasksPool pool(4);
+    //Bound the queues, so the producers can't run out of task IDs
+    pool.SetQueueCapacity(16384, TinyTasksPool::OverflowPolicy::BLOCK);
+
+    std::atomic<uint32_t> numRuns(0);
+    std::atomic<TaskID> lastTaskID(constants::kInvalidTaskID);
+    std::atomic<bool> areProducersDone(false);
+
+    //Queries the pool while the tasks are submitted, run and released
+    std::thread queryThread([&]
+    {
+        uint64_t numQueries = 0;
+        while(!areProducersDone)
+        {
+            TinyTask* task = pool.GetTask(lastTaskID);
+            if(task) task->GetStatus();
+
+            pool.GetNumPendingTasks();
+            pool.GetNumRunningTasks();
+            if(++numQueries % 1024 == 0) pool.GetMetrics();
+        }
+    });
+
+    std::vector<std::thread> producers;
+    for(uint32_t producerIndex = 0; producerIndex < numProducers; ++producerIndex)
+    {
+        producers.emplace_back([&, producerIndex]
+        {
+            uint32_t numSubmittedTasks = 0;
+            while(numSubmittedTasks < numTasksPerProducer)
+            {
+                //Every eighth round is a batch, the others single tasks with every priority
+                if(numSubmittedTasks % (8 * batchSize) == 0 && numSubmittedTasks + batchSize <= numTasksPerProducer)
+                {
+                    std::vector<std::function<void()>> lambdas(batchSize, [&numRuns]{ numRuns++; });
+                    for(const TinyTasksPool::TaskHandle& handle : pool.SubmitBatch(lambdas.begin(), lambdas.end()))
+                    {
+                        pool.ReleaseTask(handle.GetID());
+                    }
+                    numSubmittedTasks += batchSize;
+                    continue;
+                }
+
+                const TinyTasksPool::Priority priority = static_cast<TinyTasksPool::Priority>((producerIndex + numSubmittedTasks) % TinyTasksPool::Priority::NUM_PRIORITIES);
+                const TaskID taskID = pool.Submit([&numRuns]{ numRuns++; }, priority).GetID();
+                lastTaskID = taskID;
+                pool.ReleaseTask(taskID);
+                numSubmittedTasks++;
+            }
+        });
+    }
+
+    for(std::thread& producer : producers) producer.join();
+    pool.WaitAll();
+    areProducersDone = true;
+    queryThread.join();
+
+    const TinyTasksPool::Metrics metrics = pool.GetMetrics();
+
+    ASSERT_EQ(numRuns, numProducers * numTasksPerProducer);
+    ASSERT_EQ(metrics.numCompletedRuns, numProducers * numTasksPerProducer);
+    ASSERT_EQ(pool.GetNumPendingTasks(), 0);
+}
+
+TEST(TinyTasksStressTest, TestPauseResumeAndStopTasksFromManyThreads)
+{
+    const uint32_t numTasks = 16;
+    const uint32_t numRoundTrips = GetScaled(2000);
+
+    TinyTasksPool pool(4);
+
+    //Each controller owns a task, so only the controller changes its status
+    //once it runs (the lambda only finishes after it's stopped)
+    std::vector<std::thread> controllers;
+    for(uint32_t taskIndex = 0; taskIndex < numTasks; ++taskIndex)
+    {
+        controllers.emplace_back([&pool, numRoundTrips]
+        {
+            const TinyTasksPool::TaskHandle handle = pool.Submit([](TaskContext& context)
+            {
+                while(!context.IsCancelled())
+                {
+                    context.PauseIfNeeded();
+                    std::this_thread::yield();
+                }
+            });
+
+            TinyTask* task = handle.GetTask();
+            task->WaitForStatus(TinyTask::Status::RUNNING);
+
+            for(uint32_t roundTrip = 0; roundTrip < numRoundTrips; ++roundTrip)
+            {
+                task->Pause();
+                if(roundTrip % 2 == 0) std::this_thread::yield();
+                task->Resume();
+            }
+
+            //Stop it while it's paused every other time
+            if(task->GetID() % 2 == 0) task->Pause();
+            task->Stop();
+
+            ASSERT_EQ(handle.Wait(), TinyTasksPool::Result::SUCCEEDED);
+            ASSERT_TRUE(task->HasStopped());
+            pool.ReleaseTask(handle.GetID());
+        });
+    }
+
+    for(std::thread& controller : controllers) controller.join();
+    pool.WaitAll();
+
+    ASSERT_EQ(pool.GetMetrics().numStoppedRuns, numTasks);
+}
+
+TEST(TinyTasksStressTest, TestPauseResumeAndStopTaskGroupsFromManyThreads)
+{
+    const uint32_t numRounds = GetScaled(50);
+    const uint32_t numTasks = 64;
+    const uint32_t numControllers = 4;
+
+    TinyTasksPool pool(4);
+
+    for(uint32_t round = 0; round < numRounds; ++round)
+    {
+        TaskGroup group(pool);
+        std::atomic<uint32_t> numStartedTasks(0);
+
+        for(uint32_t taskIndex = 0; taskIndex < numTasks; ++taskIndex)
+        {
+            group.Submit([&numStartedTasks](TaskContext& context)
+            {
+                numStartedTasks++;
+                while(!context.IsCancelled())
+                {
+                    context.PauseIfNeeded();
+                    std::this_thread::yield();
+                }
+            });
+        }
+
+        //The controllers pause and resume the group at random, while the
+        //queued tasks start
+        std::vector<std::thread> controllers;
+        for(uint32_t controllerIndex = 0; controllerIndex < numControllers; ++controllerIndex)
+        {
+            controllers.emplace_back([&group, round, controllerIndex]
+            {
+                std::mt19937 generator(round * numControllers + controllerIndex);
+                for(uint32_t operation = 0; operation < 200; ++operation)
+                {
+                    switch(generator() % 3)
+                    {
+                        case 0: group.Pause(); break;
+                        case 1: group.Resume(); break;
+                        default: group.GetNumUnfinishedTasks(); break;
+                    }
+                }
+            });
+        }
+
+        for(std::thread& controller : controllers) controller.join();
+
+        group.Resume();
+        group.Stop();
+        group.Wait();
+
+        ASSERT_EQ(group.GetNumUnfinishedTasks(), 0u);
+        ASSERT_LE(numStartedTasks, numTasks);
+    }
+
+    pool.WaitAll();
+}
+
+TEST(TinyTasksStressTest, TestShutDownPoolsUnderLoad)
+{
+    const uint32_t numRounds = GetScaled(100);
+    const uint32_t numProducers = 4;
+
+    for(uint32_t round = 0; round < numRounds; ++round)
+    {
+        TinyTasksPool pool(4);
+        //Rejecting the tasks once the queues are full, so the producers
+        //don't run out of task IDs nor block after the shutdown
+        pool.SetQueueCapacity(4096, TinyTasksPool::OverflowPolicy::REJECT);
+        std::atomic<bool> stopProducers(false);
+        std::atomic<uint32_t> numRuns(0);
+
+        std::vector<std::thread> producers;
+        for(uint32_t producerIndex = 0; producerIndex < numProducers; ++producerIndex)
+        {
+            producers.emplace_back([&, producerIndex]
+            {
+                uint32_t numSubmittedTasks = 0;
+                while(!stopProducers)
+                {
+                    //Some tasks are long, so they are cancelled while running
+                    const uint32_t numIterations = (numSubmittedTasks % 16 == 0) ? 1000 : 1;
+                    auto lambda = [&numRuns, numIterations](TaskContext& context)
+                    {
+                        for(uint32_t iteration = 0; iteration < numIterations && !context.IsCancelled(); ++iteration)
+                        {
+                            std::this_thread::yield();
+                        }
+                        numRuns++;
+                    };
+
+                    //The timers aren't limited by the capacity, so they are rarer
+                    TinyTasksPool::TaskHandle handle;
+                    if((producerIndex + numSubmittedTasks) % 64 == 0)
+                    {
+                        pool.ScheduleAfter(std::chrono::milliseconds(1), [&numRuns]{ numRuns++; });
+                    }
+                    else if(numSubmittedTasks % 2 == 0)
+                    {
+                        handle = pool.TrySubmit(lambda);
+                    }
+                    else
+                    {
+                        handle = pool.Submit(lambda);
+                    }
+
+                    if(handle.GetID() != constants::kInvalidTaskID) pool.ReleaseTask(handle.GetID());
+                    numSubmittedTasks++;
+                }
+            });
+        }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(1 + round % 5));
+
+        //The producers keep submitting, so the pool may not drain in time.
+        //Then the tasks are cancelled, and it's shut down once they stop
+        const TinyTasksPool::ShutdownMode mode = (round % 2 == 0) ? TinyTasksPool::ShutdownMode::CANCEL : TinyTasksPool::ShutdownMode::DRAIN;
+        const TinyTasksPool::Result result = pool.Shutdown(mode, std::chrono::milliseconds(5));
+        ASSERT_TRUE(result == TinyTasksPool::Result::SUCCEEDED || result == TinyTasksPool::Result::TIMED_OUT);
+
+        stopProducers = true;
+        for(std::thread& producer : producers) producer.join();
+
+        if(result == TinyTasksPool::Result::TIMED_OUT)
+        {
+            ASSERT_EQ(pool.Shutdown(TinyTasksPool::ShutdownMode::CANCEL), TinyTasksPool::Result::SUCCEEDED);
+        }
+
+        ASSERT_TRUE(pool.IsShutDown());
+        ASSERT_EQ(pool.GetNumTimers(), 0u);
+    }
+}
+
+TEST(TinyTasksStressTest, TestCreateAndReleaseTasksFromManyThreads)
+{
+    const uint32_t numThreads = 8;
+    const uint32_t numTasksPerThread = GetScaled(200000) / numThreads;
+
+    TinyTasksPool pool(2);
+
+    //Recycling the task IDs while other threads look them up
+    std::vector<std::thread> threads;
+    for(uint32_t threadIndex = 0; threadIndex < numThreads; ++threadIndex)
+    {
+        threads.emplace_back([&pool, numTasksPerThread]
+        {
+            TaskID previousTaskID = constants::kInvalidTaskID;
+            for(uint32_t taskIndex = 0; taskIndex < numTasksPerThread; ++taskIndex)
+            {
+                const TaskID taskID = pool.CreateTask();
+                ASSERT_NE(taskID, constants::kInvalidTaskID);
+                ASSERT_NE(pool.GetTask(taskID), nullptr);
+
+                //The previous task may have been recycled by another thread by now
+                pool.GetTask(previousTaskID);
+
+                ASSERT_EQ(pool.ReleaseTask(taskID), TinyTasksPool::Result::SUCCEEDED);
+                previousTaskID = taskID;
+            }
+        });
+    }
+
+    for(std::thread& thread : threads) thread.join();
+
+    pool.WaitAll();
+}
@@ -108,6 +108,40 @@ TEST(TinyTasksTest, TestCreateAndCancelTinyTaskInThread)
     ASSERT_TRUE(task.HasStopped());
 }
 
+TEST(TinyTasksTest, TestResumeAndStopBlockedTinyTaskInThread)
+{
+    TinyTask task(UINT16_MAX);
+    std::atomic<uint32_t> numPauses(0);
+    
+    task.SetLambda([&task, &numPauses]
+    {
+        while(!task.IsStopping())
+        {
+            task.Pause();
+            numPauses++;
+            task.PauseIfNeeded();
+        }
+    });
+    
+    std::thread taskThread(&TinyTask::Run, &task);
+    
+    //The task stays blocked until it's resumed
+    while(numPauses < 1) {}
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    ASSERT_TRUE(task.IsPaused());
+    ASSERT_EQ(numPauses, 1u);
+    
+    task.Resume();
+    while(numPauses < 2) {}
+    ASSERT_TRUE(task.IsPaused());
+    
+    //Stopping it wakes it up too
+    task.Stop();
+    taskThread.join();
+    ASSERT_TRUE(task.HasStopped());
+    ASSERT_EQ(numPauses, 2u);
+}
+
 TEST(TinyTasksTest, TestCreateAndCancelWhileTinyTaskPausedInThread)
 {
     TinyTask task(UINT16_MAX);
@@ -171,11 +205,100 @@ TEST(TinyTasksTest, TestCreateAndQueryTinyTaskProgressInThread)
     ASSERT_TRUE(task.HasCompleted());
 }
 
+TEST(TinyTasksTest, TestWaitForStatusOfTinyTaskInThread)
+{
+    TinyTask task(UINT16_MAX);
+    std::atomic<bool> canComplete(false);
+    
+    task.SetLambda([&canComplete]
+    {
+        while(!canComplete) { std::this_thread::sleep_for(std::chrono::milliseconds(10)); }
+    });
+    
+    std::thread taskThread(&TinyTask::Run, &task);
+    
+    task.WaitForStatus(TinyTask::Status::RUNNING);
+    ASSERT_TRUE(task.IsRunning());
+    ASSERT_FALSE(task.WaitForStatus(TinyTask::Status::COMPLETED, std::chrono::milliseconds(50)));
+    
+    canComplete = true;
+    ASSERT_TRUE(task.WaitForStatus(TinyTask::Status::COMPLETED, std::chrono::seconds(10)));
+    ASSERT_TRUE(task.HasCompleted());
+    
+    //A finished task doesn't block, even if it can't reach the status anymore
+    task.WaitForStatus(TinyTask::Status::PAUSED);
+    
+    taskThread.join();
+}
+
+//! Callable that can only be moved, as lambdas can't capture by move in C++11
+struct MoveOnlyCallable
+{
+    void operator()() { *result += *value; }
+    
+    std::unique_ptr<int>    value;
+    std::atomic<int>*       result;
+};
+
+//! Callable that doesn't fit in the inline storage of the task functions
+struct BigCallable
+{
+    void operator()() { *result += static_cast<int>(sizeof(padding)); }
+    
+    char                padding[TINYTASKS_TASK_FUNCTION_CAPACITY * 2];
+    std::atomic<int>*   result;
+};
+
+TEST(TinyTasksTest, TestRunMoveOnlyAndBigCallablesInTinyTask)
+{
+    ASSERT_TRUE(TaskFunction::IsStoredInline<MoveOnlyCallable>());
+    ASSERT_FALSE(TaskFunction::IsStoredInline<BigCallable>());
+    
+    std::atomic<int> result(0);
+    
+    MoveOnlyCallable moveOnlyCallable = { std::unique_ptr<int>(new int(3)), &result };
+    TinyTask task(std::move(moveOnlyCallable), UINT16_MAX);
+    task.Run();
+    ASSERT_TRUE(task.HasCompleted());
+    ASSERT_EQ(result, 3);
+    
+    BigCallable bigCallable;
+    bigCallable.result = &result;
+    task.SetLambda(bigCallable);
+    task.Run();
+    ASSERT_EQ(result, 3 + TINYTASKS_TASK_FUNCTION_CAPACITY * 2);
+    
+    //Moving a function takes its callable, wherever it's stored
+    TaskFunction function(std::move(bigCallable));
+    TaskFunction movedFunction(std::move(function));
+    ASSERT_FALSE(function);
+    ASSERT_TRUE(movedFunction);
+    
+    function = nullptr;
+    ASSERT_FALSE(function);
+    ASSERT_FALSE(TaskFunction(std::function<void()>()));
+}
+
+TEST(TinyTasksTest, TestAlignTinyTasksToCacheLines)
+{
+    ASSERT_EQ(alignof(TinyTask), static_cast<size_t>(TINYTASKS_CACHE_LINE_SIZE));
+    ASSERT_EQ(sizeof(TinyTask) % TINYTASKS_CACHE_LINE_SIZE, 0u);
+    
+    //Aligned also when allocated in the heap
+    std::vector<std::unique_ptr<TinyTask>> tasks;
+    for(uint32_t taskIndex = 0; taskIndex < 16; ++taskIndex)
+    {
+        tasks.push_back(std::unique_ptr<TinyTask>(new TinyTask(taskIndex)));
+        ASSERT_EQ(reinterpret_cast<std::uintptr_t>(tasks.back().get()) % TINYTASKS_CACHE_LINE_SIZE, 0u);
+    }
+}
+
 TEST(TinyTasksTest, TestCreateTinyTasksPoolDefault)
 {
     TinyTasksPool tinyTasksPool;
     
-    ASSERT_EQ(tinyTasksPool.GetNumThreads(), tinytasks::constants::kMinNumThreadsInPool);
+    ASSERT_EQ(tinyTasksPool.GetNumThreads(), TinyTasksPool::GetDefaultNumThreads());
+    ASSERT_GE(tinyTasksPool.GetNumThreads(), tinytasks::constants::kMinNumThreadsInPool);
 }
 
 TEST(TinyTasksTest, TestCreateTinyTasksPoolNonDefault)
@@ -194,6 +317,69 @@ TEST(TinyTasksTest, TestCreateTinyTasksPoolNonDefaultMax)
     ASSERT_EQ(tinyTasksPool.GetNumThreads(), numThreads);
 }
 
+TEST(TinyTasksTest, TestDispatchTasksByPriorityInTinyTasksPool)
+{
+    //The first task is tied to the only worker, so blocking it queues the rest
+    TinyTasksPool tinyTasksPool(1);
+    std::atomic<bool> canStart(false);
+    std::vector<int> runOrder;
+    
+    TinyTasksPool::TaskHandle blockingHandle = tinyTasksPool.Submit([&canStart]
+    {
+        while(!canStart) { std::this_thread::sleep_for(std::chrono::milliseconds(1)); }
+    });
+    
+    for(int taskIndex = 0; taskIndex < 10; ++taskIndex)
+    {
+        tinyTasksPool.Submit([&runOrder, taskIndex]{ runOrder.push_back(100 + taskIndex); }, TinyTasksPool::Priority::LOW);
+        tinyTasksPool.Submit([&runOrder, taskIndex]{ runOrder.push_back(200 + taskIndex); }, TinyTasksPool::Priority::NORMAL);
+    }
+    
+    const TaskID deadlineTaskID = tinyTasksPool.CreateTask();
+    ASSERT_EQ(tinyTasksPool.SetTaskDeadline(deadlineTaskID, std::chrono::steady_clock::now()), TinyTasksPool::Result::SUCCEEDED);
+    
+    for(int taskIndex = 0; taskIndex < 10; ++taskIndex)
+    {
+        tinyTasksPool.Submit([&runOrder, taskIndex]{ runOrder.push_back(300 + taskIndex); }, TinyTasksPool::Priority::HIGH);
+    }
+    
+    ASSERT_EQ(tinyTasksPool.SetNewLambdaForTask(deadlineTaskID, [&runOrder]{ runOrder.push_back(400); }),
+              TinyTasksPool::Result::SUCCEEDED_AT_QUEUE);
+    ASSERT_EQ(tinyTasksPool.GetNumPendingTasks(), 31);
+    
+    canStart = true;
+    tinyTasksPool.WaitAll();
+    
+    //The task with a deadline goes first, then the high, normal and low
+    //priority tasks (each class in the order they were queued)
+    std::vector<int> expectedRunOrder(1, 400);
+    for(int base = 300; base >= 100; base -= 100)
+    {
+        for(int taskIndex = 0; taskIndex < 10; ++taskIndex) expectedRunOrder.push_back(base + taskIndex);
+    }
+    
+    ASSERT_EQ(runOrder, expectedRunOrder);
+    
+    //A low priority task that has waited longer than its delay isn't
+    //starved by the high priority tasks queued after it
+    runOrder.clear();
+    canStart = false;
+    tinyTasksPool.SetPriorityDelay(TinyTasksPool::Priority::LOW, std::chrono::milliseconds(50));
+    
+    ASSERT_EQ(tinyTasksPool.SetNewLambdaForTask(blockingHandle.GetID(), [&canStart]
+    {
+        while(!canStart) { std::this_thread::sleep_for(std::chrono::milliseconds(1)); }
+    }), TinyTasksPool::Result::SUCCEEDED);
+    
+    tinyTasksPool.Submit([&runOrder]{ runOrder.push_back(100); }, TinyTasksPool::Priority::LOW);
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    tinyTasksPool.Submit([&runOrder]{ runOrder.push_back(300); }, TinyTasksPool::Priority::HIGH);
+    
+    canStart = true;
+    tinyTasksPool.WaitAll();
+    ASSERT_EQ(runOrder, std::vector<int>({ 100, 300 }));
+}
+
 class TinyTasksPoolTest : public testing::Test
 {
 public:
@@ -253,6 +439,15 @@ TEST_F(TinyTasksPoolTest, TestCreateManyTasksInTinyTasksPool)
         else
             ASSERT_EQ(result, TinyTasksPool::Result::SUCCEEDED);
     }
+    
+    //Queued tasks are dispatched automatically, so wait for them before destroying the pool
+    for(uint16_t currentTaskID = 0; currentTaskID < constants::kMaxNumTasksInPool; ++currentTaskID)
+    {
+        TinyTask* task = m_tinyTasksPool.GetTask(currentTaskID);
+        ASSERT_TRUE(task);
+        
+        while(!task->HasCompleted()) {}
+    }
 }
 
 TEST_F(TinyTasksPoolTest, TestCreateNewStopTaskInTinyTasksPool)
@@ -339,7 +534,8 @@ TEST_F(TinyTasksPoolTest, TestRunPendingTasksInTinyTasksPool)
             ASSERT_EQ(result, TinyTasksPool::Result::SUCCEEDED);
     }
     
-    ASSERT_EQ(m_tinyTasksPool.GetNumPendingTasks(), numQueuedTasks);
+    //Pending tasks are dispatched automatically, so some may have started already
+    ASSERT_LE(m_tinyTasksPool.GetNumPendingTasks(), numQueuedTasks);
     
     while(m_tinyTasksPool.GetNumPendingTasks() > 0)
     {
@@ -358,6 +554,44 @@ TEST_F(TinyTasksPoolTest, TestRunPendingTasksInTinyTasksPool)
     }
 }
 
+TEST_F(TinyTasksPoolTest, TestDispatchPendingTasksAutomaticallyInTinyTasksPool)
+{
+    ASSERT_EQ(m_tinyTasksPool.GetNumThreads(), 8);
+    
+    const uint16_t numQueuedTasks = 64;
+    const uint16_t numTasksInPool = numQueuedTasks + m_tinyTasksPool.GetNumThreads();
+    std::atomic<uint16_t> numCompletedTasks(0);
+    
+    for(uint16_t currentTaskID = 0; currentTaskID < numTasksInPool; ++currentTaskID)
+    {
+        uint16_t taskID = m_tinyTasksPool.CreateTask();
+        ASSERT_EQ(taskID, currentTaskID);
+        
+        TinyTasksPool::Result result = m_tinyTasksPool.SetNewLambdaForTask(taskID, [&numCompletedTasks]
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            numCompletedTasks++;
+        });
+        
+        if(currentTaskID >= m_tinyTasksPool.GetNumThreads())
+            ASSERT_EQ(result, TinyTasksPool::Result::SUCCEEDED_AT_QUEUE);
+        else
+            ASSERT_EQ(result, TinyTasksPool::Result::SUCCEEDED);
+    }
+    
+    //No calls to RunPendingTasks() are needed for the queued tasks to run
+    for(uint16_t currentTaskID = 0; currentTaskID < numTasksInPool; ++currentTaskID)
+    {
+        TinyTask* task = m_tinyTasksPool.GetTask(currentTaskID);
+        ASSERT_TRUE(task);
+        
+        while(!task->HasCompleted()) {}
+    }
+    
+    ASSERT_EQ(numCompletedTasks, numTasksInPool);
+    ASSERT_EQ(m_tinyTasksPool.GetNumPendingTasks(), 0);
+}
+
 TEST_F(TinyTasksPoolTest, TestGetNumRunningTasksInTinyTasksPool)
 {
     ASSERT_EQ(m_tinyTasksPool.GetNumThreads(), 8);
@@ -403,3 +637,1955 @@ TEST_F(TinyTasksPoolTest, TestGetNumRunningTasksInTinyTasksPool)
     
     ASSERT_EQ(m_tinyTasksPool.GetNumRunningTasks(), 0);
 }
+
+TEST_F(TinyTasksPoolTest, TestTaskRunsOnPersistentWorkerInTinyTasksPool)
+{
+    ASSERT_EQ(m_tinyTasksPool.GetNumThreads(), 8);
+    
+    uint16_t taskID = m_tinyTasksPool.CreateTask();
+    
+    std::atomic<int> numRuns(0);
+    std::thread::id firstRunThreadID;
+    std::thread::id secondRunThreadID;
+    
+    TinyTasksPool::Result result1 = m_tinyTasksPool.SetNewLambdaForTask(taskID, [&numRuns, &firstRunThreadID]
+    {
+        firstRunThreadID = std::this_thread::get_id();
+        numRuns++;
+    });
+    ASSERT_EQ(result1, TinyTasksPool::Result::SUCCEEDED);
+    while(numRuns < 1) {}
+    
+    TinyTask* task = m_tinyTasksPool.GetTask(taskID);
+    ASSERT_TRUE(task);
+    while(!task->HasCompleted()) {}
+    
+    TinyTasksPool::Result result2 = m_tinyTasksPool.SetNewLambdaForTask(taskID, [&numRuns, &secondRunThreadID]
+    {
+        secondRunThreadID = std::this_thread::get_id();
+        numRuns++;
+    });
+    ASSERT_EQ(result2, TinyTasksPool::Result::SUCCEEDED);
+    while(numRuns < 2) {}
+    while(!task->HasCompleted()) {}
+    
+    //The same worker thread runs the task again, instead of a new thread
+    ASSERT_EQ(firstRunThreadID, secondRunThreadID);
+    ASSERT_NE(firstRunThreadID, std::this_thread::get_id());
+}
+
+TEST_F(TinyTasksPoolTest, TestStealTasksQueuedFromTaskInTinyTasksPool)
+{
+    ASSERT_EQ(m_tinyTasksPool.GetNumThreads(), 8);
+    
+    //Tie a task to each worker thread, so the subtasks are queued
+    std::vector<uint16_t> tiedTaskIDs;
+    for(uint8_t threadIndex = 0; threadIndex < m_tinyTasksPool.GetNumThreads(); ++threadIndex)
+    {
+        tiedTaskIDs.push_back(m_tinyTasksPool.CreateTask());
+    }
+    
+    const uint16_t numSubtasks = 256;
+    std::atomic<uint16_t> numCompletedSubtasks(0);
+    std::atomic<uint16_t> numSubtasksRunInParentThread(0);
+    TinyTasksPool& pool = m_tinyTasksPool;
+    
+    TinyTasksPool::Result result = m_tinyTasksPool.SetNewLambdaForTask(tiedTaskIDs[0],
+                                   [&pool, &numCompletedSubtasks, &numSubtasksRunInParentThread]
+    {
+        const std::thread::id parentThreadID = std::this_thread::get_id();
+        
+        for(uint16_t subtaskIndex = 0; subtaskIndex < numSubtasks; ++subtaskIndex)
+        {
+            uint16_t subtaskID = pool.CreateTask();
+            TinyTasksPool::Result subtaskResult = pool.SetNewLambdaForTask(subtaskID,
+                                                  [parentThreadID, &numCompletedSubtasks, &numSubtasksRunInParentThread]
+            {
+                if(std::this_thread::get_id() == parentThreadID) numSubtasksRunInParentThread++;
+                numCompletedSubtasks++;
+            });
+            assert(subtaskResult == TinyTasksPool::Result::SUCCEEDED_AT_QUEUE);
+            (void)subtaskResult;
+        }
+        
+        //Keep this worker busy, so the subtasks have to be stolen by the other workers
+        while(numCompletedSubtasks < numSubtasks) {}
+    });
+    ASSERT_EQ(result, TinyTasksPool::Result::SUCCEEDED);
+    
+    TinyTask* parentTask = m_tinyTasksPool.GetTask(tiedTaskIDs[0]);
+    ASSERT_TRUE(parentTask);
+    while(!parentTask->HasCompleted()) {}
+    
+    ASSERT_EQ(numCompletedSubtasks, numSubtasks);
+    ASSERT_EQ(numSubtasksRunInParentThread, 0);
+    ASSERT_EQ(m_tinyTasksPool.GetNumPendingTasks(), 0);
+}
+
+TEST_F(TinyTasksPoolTest, TestQueryTasksWhileCreatingTasksInTinyTasksPool)
+{
+    ASSERT_EQ(m_tinyTasksPool.GetNumThreads(), 8);
+    
+    const uint16_t numTasksInPool = 4096;
+    std::atomic<uint16_t> numCreatedTasks(0);
+    std::atomic<bool> stopQueries(false);
+    TinyTasksPool& pool = m_tinyTasksPool;
+    
+    //Poll the status of the tasks created so far, like a monitoring thread would do
+    std::vector<std::thread> queryThreads;
+    for(uint8_t threadIndex = 0; threadIndex < 4; ++threadIndex)
+    {
+        queryThreads.push_back(std::thread([&pool, &numCreatedTasks, &stopQueries]
+        {
+            while(!stopQueries)
+            {
+                const uint16_t numTasks = numCreatedTasks;
+                for(uint16_t taskID = 0; taskID < numTasks; ++taskID)
+                {
+                    TinyTask* task = pool.GetTask(taskID);
+                    assert(task && task->GetID() == taskID);
+                    (void)task;
+                    (void)pool.GetTaskStatus(taskID);
+                }
+            }
+        }));
+    }
+    
+    for(uint16_t currentTaskID = 0; currentTaskID < numTasksInPool; ++currentTaskID)
+    {
+        uint16_t taskID = m_tinyTasksPool.CreateTask();
+        ASSERT_EQ(taskID, currentTaskID);
+        numCreatedTasks++;
+        
+        TinyTasksPool::Result result = m_tinyTasksPool.SetNewLambdaForTask(taskID, []{});
+        ASSERT_NE(result, TinyTasksPool::Result::TASK_NOT_FOUND);
+    }
+    
+    ASSERT_EQ(m_tinyTasksPool.GetTask(numTasksInPool), nullptr);
+    
+    for(uint16_t currentTaskID = 0; currentTaskID < numTasksInPool; ++currentTaskID)
+    {
+        while(m_tinyTasksPool.GetTaskStatus(currentTaskID) != TinyTask::Status::COMPLETED) {}
+    }
+    
+    stopQueries = true;
+    for(auto& queryThread : queryThreads)
+    {
+        queryThread.join();
+    }
+}
+
+TEST_F(TinyTasksPoolTest, TestReleaseAndRecycleTasksInTinyTasksPool)
+{
+    ASSERT_EQ(m_tinyTasksPool.GetNumThreads(), 8);
+    
+    TaskID taskID = m_tinyTasksPool.CreateTask();
+    ASSERT_EQ(TinyTasksPool::GetTaskIndex(taskID), 0);
+    ASSERT_EQ(TinyTasksPool::GetTaskGeneration(taskID), 0);
+    
+    TinyTasksPool::Result result = m_tinyTasksPool.SetNewLambdaForTask(taskID, []{});
+    ASSERT_EQ(result, TinyTasksPool::Result::SUCCEEDED);
+    while(m_tinyTasksPool.GetTaskStatus(taskID) != TinyTask::Status::COMPLETED) {}
+    
+    ASSERT_EQ(m_tinyTasksPool.ReleaseTask(taskID), TinyTasksPool::Result::SUCCEEDED);
+    ASSERT_EQ(m_tinyTasksPool.ReleaseTask(taskID), TinyTasksPool::Result::TASK_NOT_FOUND);
+    ASSERT_EQ(m_tinyTasksPool.GetTask(taskID), nullptr);
+    ASSERT_EQ(m_tinyTasksPool.SetNewLambdaForTask(taskID, []{}), TinyTasksPool::Result::TASK_NOT_FOUND);
+    
+    //The index is reused with a new generation, so the old ID stays invalid
+    TaskID recycledTaskID = m_tinyTasksPool.CreateTask();
+    ASSERT_EQ(TinyTasksPool::GetTaskIndex(recycledTaskID), 0);
+    ASSERT_EQ(TinyTasksPool::GetTaskGeneration(recycledTaskID), 1);
+    ASSERT_NE(recycledTaskID, taskID);
+    ASSERT_EQ(m_tinyTasksPool.GetTask(taskID), nullptr);
+    
+    TinyTask* recycledTask = m_tinyTasksPool.GetTask(recycledTaskID);
+    ASSERT_TRUE(recycledTask);
+    ASSERT_EQ(recycledTask->GetID(), recycledTaskID);
+    ASSERT_TRUE(recycledTask->IsPaused());
+    ASSERT_EQ(recycledTask->GetProgress(), 0.0f);
+    ASSERT_EQ(m_tinyTasksPool.ReleaseTask(recycledTaskID), TinyTasksPool::Result::SUCCEEDED);
+}
+
+TEST_F(TinyTasksPoolTest, TestCreateMoreTasksThanIDsWithReleaseInTinyTasksPool)
+{
+    ASSERT_EQ(m_tinyTasksPool.GetNumThreads(), 8);
+    
+    //Releasing queued tasks recycles them once they finish, so the IDs never run out
+    const uint32_t numTasks = 4 * constants::kMaxNumTasksInPool;
+    std::atomic<uint32_t> numCompletedTasks(0);
+    uint32_t maxTaskIndex = 0;
+    
+    for(uint32_t taskIndex = 0; taskIndex < numTasks; ++taskIndex)
+    {
+        TaskID taskID = m_tinyTasksPool.CreateTask();
+        maxTaskIndex = std::max(maxTaskIndex, TinyTasksPool::GetTaskIndex(taskID));
+        
+        TinyTasksPool::Result result = m_tinyTasksPool.SetNewLambdaForTask(taskID, [&numCompletedTasks]{ numCompletedTasks++; });
+        ASSERT_NE(result, TinyTasksPool::Result::TASK_NOT_FOUND);
+        ASSERT_EQ(m_tinyTasksPool.ReleaseTask(taskID), TinyTasksPool::Result::SUCCEEDED);
+        
+        //Don't let the queue outgrow the IDs
+        while(taskIndex > numCompletedTasks + constants::kMaxNumTasksInPool / 2) {}
+    }
+    
+    while(numCompletedTasks < numTasks) {}
+    ASSERT_LT(maxTaskIndex, constants::kMaxNumTasksInPool);
+}
+
+TEST_F(TinyTasksPoolTest, TestWaitForTasksInTinyTasksPool)
+{
+    ASSERT_EQ(m_tinyTasksPool.GetNumThreads(), 8);
+    
+    const uint32_t numTasks = 100;
+    std::atomic<bool> canComplete(false);
+    std::atomic<uint32_t> numCompletedTasks(0);
+    std::vector<TinyTasksPool::TaskHandle> handles;
+    
+    for(uint32_t taskIndex = 0; taskIndex < numTasks; ++taskIndex)
+    {
+        handles.push_back(m_tinyTasksPool.Submit([&canComplete, &numCompletedTasks]
+        {
+            while(!canComplete) { std::this_thread::sleep_for(std::chrono::milliseconds(1)); }
+            numCompletedTasks++;
+        }));
+        ASSERT_TRUE(handles.back().IsValid());
+    }
+    
+    ASSERT_EQ(handles.front().WaitFor(std::chrono::milliseconds(50)), TinyTasksPool::Result::TIMED_OUT);
+    ASSERT_EQ(m_tinyTasksPool.WaitFor(handles.back().GetID(), std::chrono::milliseconds(0)), TinyTasksPool::Result::TIMED_OUT);
+    
+    canComplete = true;
+    ASSERT_EQ(handles.back().Wait(), TinyTasksPool::Result::SUCCEEDED);
+    ASSERT_TRUE(handles.back().GetTask()->HasCompleted());
+    
+    m_tinyTasksPool.WaitAll();
+    ASSERT_EQ(numCompletedTasks, numTasks);
+    ASSERT_EQ(m_tinyTasksPool.GetNumPendingTasks(), 0);
+    
+    //Waiting again returns straight away, until the task is run again
+    for(auto& handle : handles)
+    {
+        ASSERT_EQ(handle.WaitFor(std::chrono::milliseconds(0)), TinyTasksPool::Result::SUCCEEDED);
+        ASSERT_TRUE(handle.GetTask()->HasCompleted());
+    }
+    
+    ASSERT_EQ(m_tinyTasksPool.SetNewLambdaForTask(handles.front().GetID(), [&numCompletedTasks]{ numCompletedTasks++; }),
+              TinyTasksPool::Result::SUCCEEDED);
+    ASSERT_EQ(handles.front().Wait(), TinyTasksPool::Result::SUCCEEDED);
+    ASSERT_EQ(numCompletedTasks, numTasks + 1);
+    
+    for(auto& handle : handles)
+    {
+        ASSERT_EQ(m_tinyTasksPool.ReleaseTask(handle.GetID()), TinyTasksPool::Result::SUCCEEDED);
+        ASSERT_FALSE(handle.IsValid());
+        ASSERT_EQ(handle.Wait(), TinyTasksPool::Result::TASK_NOT_FOUND);
+    }
+}
+
+TEST_F(TinyTasksPoolTest, TestSubmitMoveOnlyCallablesInTinyTasksPool)
+{
+    ASSERT_EQ(m_tinyTasksPool.GetNumThreads(), 8);
+    
+    const int numTasks = 100;
+    std::atomic<int> result(0);
+    std::vector<TinyTasksPool::TaskHandle> handles;
+    
+    for(int taskIndex = 0; taskIndex < numTasks; ++taskIndex)
+    {
+        MoveOnlyCallable callable = { std::unique_ptr<int>(new int(taskIndex)), &result };
+        handles.push_back(m_tinyTasksPool.Submit(std::move(callable)));
+    }
+    
+    m_tinyTasksPool.WaitAll();
+    ASSERT_EQ(result, numTasks * (numTasks - 1) / 2);
+    
+    for(auto& handle : handles)
+    {
+        ASSERT_EQ(m_tinyTasksPool.ReleaseTask(handle.GetID()), TinyTasksPool::Result::SUCCEEDED);
+    }
+}
+
+TEST_F(TinyTasksPoolTest, TestSubmitBatchOfTasksInTinyTasksPool)
+{
+    ASSERT_EQ(m_tinyTasksPool.GetNumThreads(), 8);
+    
+    const int numTasks = 10000;
+    std::atomic<int> result(0);
+    std::vector<MoveOnlyCallable> callables;
+    
+    for(int taskIndex = 0; taskIndex < numTasks; ++taskIndex)
+    {
+        MoveOnlyCallable callable = { std::unique_ptr<int>(new int(1)), &result };
+        callables.push_back(std::move(callable));
+    }
+    
+    std::vector<TinyTasksPool::TaskHandle> handles = m_tinyTasksPool.SubmitBatch(std::make_move_iterator(callables.begin()),
+                                                                                 std::make_move_iterator(callables.end()));
+    ASSERT_EQ(handles.size(), static_cast<size_t>(numTasks));
+    
+    m_tinyTasksPool.WaitAll();
+    ASSERT_EQ(result, numTasks);
+    
+    for(auto& handle : handles)
+    {
+        ASSERT_TRUE(handle.GetTask()->HasCompleted());
+        ASSERT_EQ(m_tinyTasksPool.ReleaseTask(handle.GetID()), TinyTasksPool::Result::SUCCEEDED);
+    }
+    
+    //The released slots are reused by the next batch, which is bigger than
+    //the queue of the worker that submits it
+    std::vector<TinyTasksPool::TaskHandle> nestedHandles;
+    const int numNestedTasks = 2 * constants::kWorkerQueueCapacity;
+    
+    TinyTasksPool::TaskHandle parentHandle = m_tinyTasksPool.Submit([this, &result, &nestedHandles, numNestedTasks]
+    {
+        std::vector<std::function<void()>> lambdas(numNestedTasks, [&result]{ result++; });
+        nestedHandles = m_tinyTasksPool.SubmitBatch(lambdas.begin(), lambdas.end());
+    });
+    
+    ASSERT_EQ(parentHandle.Wait(), TinyTasksPool::Result::SUCCEEDED);
+    m_tinyTasksPool.WaitAll();
+    ASSERT_EQ(result, numTasks + numNestedTasks);
+    ASSERT_EQ(m_tinyTasksPool.GetNumPendingTasks(), 0);
+    
+    for(auto& handle : nestedHandles)
+    {
+        ASSERT_LT(TinyTasksPool::GetTaskIndex(handle.GetID()), static_cast<uint32_t>(numTasks + 1));
+        ASSERT_EQ(m_tinyTasksPool.ReleaseTask(handle.GetID()), TinyTasksPool::Result::SUCCEEDED);
+    }
+    
+    ASSERT_EQ(m_tinyTasksPool.ReleaseTask(parentHandle.GetID()), TinyTasksPool::Result::SUCCEEDED);
+    
+    std::vector<TaskID> taskIDs = m_tinyTasksPool.CreateTasks(100);
+    ASSERT_EQ(taskIDs.size(), 100u);
+    
+    for(TaskID taskID : taskIDs)
+    {
+        ASSERT_TRUE(m_tinyTasksPool.GetTask(taskID));
+        ASSERT_TRUE(m_tinyTasksPool.GetTask(taskID)->IsPaused());
+        ASSERT_EQ(m_tinyTasksPool.ReleaseTask(taskID), TinyTasksPool::Result::SUCCEEDED);
+    }
+}
+
+TEST_F(TinyTasksPoolTest, TestParallelForAndReduceInTinyTasksPool)
+{
+    ASSERT_EQ(m_tinyTasksPool.GetNumThreads(), 8);
+    
+    const uint32_t numValues = 1000000;
+    std::vector<uint32_t> values(numValues, 0);
+    
+    ParallelFor(m_tinyTasksPool, 0u, numValues, 1024u, [&values](uint32_t index) { values[index] += index % 7; });
+    
+    uint64_t expectedSum = 0;
+    for(uint32_t index = 0; index < numValues; ++index)
+    {
+        ASSERT_EQ(values[index], index % 7);
+        expectedSum += values[index];
+    }
+    
+    const uint64_t sum = ParallelReduce(m_tinyTasksPool, 0u, numValues, 1024u, static_cast<uint64_t>(0),
+                                        [&values](uint32_t index) { return static_cast<uint64_t>(values[index]); },
+                                        [](uint64_t left, uint64_t right) { return left + right; });
+    ASSERT_EQ(sum, expectedSum);
+    
+    //Empty ranges and ranges smaller than the grain
+    std::atomic<int> numCalls(0);
+    ParallelFor(m_tinyTasksPool, 5, 5, 1, [&numCalls](int) { numCalls++; });
+    ASSERT_EQ(numCalls, 0);
+    ParallelFor(m_tinyTasksPool, -10, 10, 100, [&numCalls](int) { numCalls++; });
+    ASSERT_EQ(numCalls, 20);
+    ASSERT_EQ(ParallelReduce(m_tinyTasksPool, 0, 0, 1, 42, [](int) { return 0; }, [](int left, int right) { return left + right; }), 42);
+    
+    //Nested loops, run from the tasks of the pool
+    std::atomic<uint64_t> nestedSum(0);
+    ParallelFor(m_tinyTasksPool, 0, 64, 1, [this, &nestedSum](int)
+    {
+        nestedSum += ParallelReduce(m_tinyTasksPool, 0, 1000, 10, static_cast<uint64_t>(0),
+                                    [](int index) { return static_cast<uint64_t>(index); },
+                                    [](uint64_t left, uint64_t right) { return left + right; });
+    });
+    ASSERT_EQ(nestedSum, 64u * 999u * 1000u / 2u);
+    
+    m_tinyTasksPool.WaitAll();
+    ASSERT_EQ(m_tinyTasksPool.GetNumPendingTasks(), 0);
+}
+
+TEST_F(TinyTasksPoolTest, TestRunTaskGraphInTinyTasksPool)
+{
+    ASSERT_EQ(m_tinyTasksPool.GetNumThreads(), 8);
+    
+    //Diamond: B and C run after A, and D runs after B and C
+    std::atomic<uint32_t> numRunNodes(0);
+    uint32_t runOrder[4] = { 0, 0, 0, 0 };
+    
+    TaskGraph graph(m_tinyTasksPool);
+    TaskGraph::NodeID nodeA = graph.AddNode([&]{ runOrder[0] = numRunNodes++; });
+    TaskGraph::NodeID nodeB = graph.AddNode([&]{ runOrder[1] = numRunNodes++; });
+    TaskGraph::NodeID nodeC = graph.AddNode([&]{ runOrder[2] = numRunNodes++; });
+    TaskGraph::NodeID nodeD = graph.AddNode([&]{ runOrder[3] = numRunNodes++; });
+    graph.AddEdge(nodeA, nodeB);
+    graph.AddEdge(nodeA, nodeC);
+    graph.AddEdge(nodeB, nodeD);
+    graph.AddEdge(nodeC, nodeD);
+    ASSERT_EQ(graph.GetNumNodes(), 4u);
+    
+    //The graph is run again without rebuilding it
+    for(uint32_t runIndex = 0; runIndex < 100; ++runIndex)
+    {
+        numRunNodes = 0;
+        ASSERT_EQ(graph.Run(), TaskGraph::Result::SUCCEEDED);
+        graph.Wait();
+        
+        ASSERT_FALSE(graph.IsRunning());
+        ASSERT_EQ(numRunNodes, 4u);
+        ASSERT_EQ(runOrder[nodeA], 0u);
+        ASSERT_EQ(runOrder[nodeD], 3u);
+    }
+    
+    //Long chain, with a node that blocks the first run
+    std::atomic<bool> canComplete(false);
+    std::vector<uint32_t> chainValues;
+    
+    TaskGraph chainGraph(m_tinyTasksPool);
+    TaskGraph::NodeID previousNode = chainGraph.AddNode([&canComplete]
+    {
+        while(!canComplete) { std::this_thread::sleep_for(std::chrono::milliseconds(1)); }
+    });
+    
+    for(uint32_t nodeIndex = 0; nodeIndex < 1000; ++nodeIndex)
+    {
+        TaskGraph::NodeID node = chainGraph.AddNode([&chainValues, nodeIndex]{ chainValues.push_back(nodeIndex); });
+        chainGraph.AddEdge(previousNode, node);
+        previousNode = node;
+    }
+    
+    ASSERT_EQ(chainGraph.Run(), TaskGraph::Result::SUCCEEDED);
+    ASSERT_TRUE(chainGraph.IsRunning());
+    ASSERT_EQ(chainGraph.Run(), TaskGraph::Result::ALREADY_RUNNING);
+    
+    canComplete = true;
+    chainGraph.Wait();
+    ASSERT_EQ(chainValues.size(), 1000u);
+    
+    for(uint32_t nodeIndex = 0; nodeIndex < 1000; ++nodeIndex)
+    {
+        ASSERT_EQ(chainValues[nodeIndex], nodeIndex);
+    }
+    
+    //Cycles are rejected
+    TaskGraph cycleGraph(m_tinyTasksPool);
+    TaskGraph::NodeID firstNode = cycleGraph.AddNode([]{});
+    TaskGraph::NodeID secondNode = cycleGraph.AddNode([]{});
+    cycleGraph.AddEdge(firstNode, secondNode);
+    cycleGraph.AddEdge(secondNode, firstNode);
+    ASSERT_EQ(cycleGraph.Run(), TaskGraph::Result::HAS_CYCLE);
+    ASSERT_FALSE(cycleGraph.IsRunning());
+    
+    m_tinyTasksPool.WaitAll();
+}
+
+TEST_F(TinyTasksPoolTest, TestWaitStopAndPauseTaskGroup)
+{
+    //Lambdas that don't take a context
+    std::atomic<uint32_t> sum(0);
+    {
+        TaskGroup group(m_tinyTasksPool);
+        for(uint32_t taskIndex = 0; taskIndex < 100; ++taskIndex) group.Submit([&sum]{ sum++; });
+        
+        group.Wait();
+        ASSERT_EQ(sum, 100u);
+        ASSERT_EQ(group.GetNumUnfinishedTasks(), 0u);
+    }
+    
+    //Paused and resumed together, also the tasks that start while paused
+    std::atomic<uint32_t> numStartedTasks(0);
+    std::atomic<uint32_t> numPausedTasks(0);
+    std::atomic<bool> isDone(false);
+    
+    auto loopUntilDone = [&numStartedTasks, &numPausedTasks, &isDone](TaskContext& context)
+    {
+        numStartedTasks++;
+        while(!isDone)
+        {
+            if(context.GetTask().IsPaused())
+            {
+                numPausedTasks++;
+                context.PauseIfNeeded();
+                numPausedTasks--;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    };
+    
+    auto waitUntil = [](const std::atomic<uint32_t>& value, const uint32_t expected)
+    {
+        while(value != expected) { std::this_thread::sleep_for(std::chrono::milliseconds(1)); }
+    };
+    
+    TaskGroup pausedGroup(m_tinyTasksPool);
+    for(uint32_t taskIndex = 0; taskIndex < 4; ++taskIndex) pausedGroup.Submit(loopUntilDone);
+    
+    waitUntil(numStartedTasks, 4);
+    pausedGroup.Pause();
+    ASSERT_TRUE(pausedGroup.IsPaused());
+    waitUntil(numPausedTasks, 4);
+    
+    pausedGroup.Submit(loopUntilDone);
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    ASSERT_EQ(numStartedTasks, 4u);
+    
+    pausedGroup.Resume();
+    waitUntil(numPausedTasks, 0);
+    waitUntil(numStartedTasks, 5);
+    ASSERT_EQ(pausedGroup.GetNumUnfinishedTasks(), 5u);
+    
+    isDone = true;
+    pausedGroup.Wait();
+    
+    //Stopped together, and the queued tasks are skipped
+    std::atomic<uint32_t> numStoppedTasks(0);
+    numStartedTasks = 0;
+    
+    TaskGroup stoppedGroup(m_tinyTasksPool);
+    for(uint32_t taskIndex = 0; taskIndex < 50; ++taskIndex)
+    {
+        stoppedGroup.Submit([&numStartedTasks, &numStoppedTasks](TaskContext& context)
+        {
+            numStartedTasks++;
+            while(!context.IsCancelled()) { std::this_thread::sleep_for(std::chrono::milliseconds(1)); }
+            numStoppedTasks++;
+        });
+    }
+    
+    while(numStartedTasks == 0) { std::this_thread::sleep_for(std::chrono::milliseconds(1)); }
+    stoppedGroup.Stop();
+    stoppedGroup.Wait();
+    
+    ASSERT_TRUE(stoppedGroup.IsStopped());
+    ASSERT_EQ(numStoppedTasks, numStartedTasks);
+    ASSERT_LT(numStartedTasks, 50u);
+    
+    stoppedGroup.Submit([&numStartedTasks]{ numStartedTasks += 100; });
+    stoppedGroup.Wait();
+    ASSERT_LT(numStartedTasks, 50u);
+    
+    //Stopped with a parent token
+    CancellationSource source;
+    TaskGroup childGroup(m_tinyTasksPool, source.GetToken());
+    ASSERT_FALSE(childGroup.IsStopped());
+    source.Cancel();
+    ASSERT_TRUE(childGroup.IsStopped());
+    
+    m_tinyTasksPool.WaitAll();
+}
+
+TEST_F(TinyTasksPoolTest, TestChainFuturesInTinyTasksPool)
+{
+    std::atomic<bool> canComplete(false);
+    std::thread::id taskThreadID;
+    std::thread::id continuationThreadID;
+    
+    Future<int> value = Async(m_tinyTasksPool, [&canComplete, &taskThreadID]
+    {
+        while(!canComplete) { std::this_thread::sleep_for(std::chrono::milliseconds(1)); }
+        taskThreadID = std::this_thread::get_id();
+        return 21;
+    });
+    
+    //Runs on the worker that completes the task
+    Future<std::string> text = value.Then([&continuationThreadID](const int& result)
+    {
+        continuationThreadID = std::this_thread::get_id();
+        return std::to_string(result * 2);
+    });
+    
+    ASSERT_TRUE(value.IsValid());
+    ASSERT_FALSE(text.IsReady());
+    ASSERT_FALSE(text.WaitFor(std::chrono::milliseconds(10)));
+    
+    canComplete = true;
+    ASSERT_EQ(text.Get(), "42");
+    ASSERT_EQ(value.Get(), 21);
+    ASSERT_EQ(continuationThreadID, taskThreadID);
+    
+    //Runs straight away if the future is ready already
+    Future<void> printed = text.Then([&continuationThreadID](const std::string&)
+    {
+        continuationThreadID = std::this_thread::get_id();
+    });
+    ASSERT_TRUE(printed.IsReady());
+    ASSERT_EQ(continuationThreadID, std::this_thread::get_id());
+    ASSERT_EQ(printed.Then([]{ return 3; }).Get(), 3);
+    
+    //Results of all the futures, in order
+    std::vector<Future<int>> values;
+    for(int index = 0; index < 50; ++index)
+    {
+        values.push_back(Async(m_tinyTasksPool, [index]{ return index * index; }));
+    }
+    
+    const std::vector<int> results = WhenAll(values).Get();
+    ASSERT_EQ(results.size(), 50u);
+    for(int index = 0; index < 50; ++index) ASSERT_EQ(results[index], index * index);
+    
+    ASSERT_TRUE(WhenAll(std::vector<Future<int>>()).IsReady());
+    
+    std::vector<Future<void>> voidFutures(1, printed);
+    voidFutures.push_back(Async(m_tinyTasksPool, []{}));
+    WhenAll(voidFutures).Wait();
+    
+    //Index of the first ready future
+    canComplete = false;
+    std::vector<Future<int>> blockedAndReady;
+    blockedAndReady.push_back(Async(m_tinyTasksPool, [&canComplete]
+    {
+        while(!canComplete) { std::this_thread::sleep_for(std::chrono::milliseconds(1)); }
+        return 0;
+    }));
+    blockedAndReady.push_back(Async(m_tinyTasksPool, []{ return 1; }));
+    
+    ASSERT_EQ(WhenAny(blockedAndReady).Get(), 1u);
+    canComplete = true;
+    
+    m_tinyTasksPool.WaitAll();
+}
+
+TEST_F(TinyTasksPoolTest, TestSubmitFromExternalThreadsToTinyTasksPool)
+{
+    std::atomic<uint32_t> numRuns(0);
+    
+    //More tasks than the injection queue holds, so some go to the shared queue
+    const uint32_t numProducers = 4;
+    const uint32_t numTasksPerProducer = 5000;
+    std::vector<std::thread> producers;
+    
+    for(uint32_t producerIndex = 0; producerIndex < numProducers; ++producerIndex)
+    {
+        producers.emplace_back([this, &numRuns]
+        {
+            for(uint32_t taskIndex = 0; taskIndex < numTasksPerProducer; ++taskIndex)
+            {
+                m_tinyTasksPool.ReleaseTask(m_tinyTasksPool.Submit([&numRuns]{ numRuns++; }).GetID());
+            }
+        });
+    }
+    
+    for(std::thread& producer : producers) producer.join();
+    
+    m_tinyTasksPool.WaitAll();
+    ASSERT_EQ(numRuns.load(), numProducers * numTasksPerProducer);
+    ASSERT_EQ(m_tinyTasksPool.GetNumPendingTasks(), 0u);
+}
+
+TEST(TinyTasksTest, TestResizeTinyTasksPool)
+{
+    TinyTasksPool tinyTasksPool(4);
+    
+    //Tied to the first four workers
+    std::atomic<uint32_t> numTiedRuns(0);
+    std::vector<TaskID> tiedTaskIDs;
+    for(uint32_t taskIndex = 0; taskIndex < 4; ++taskIndex)
+    {
+        tiedTaskIDs.push_back(tinyTasksPool.CreateTask());
+    }
+    
+    std::atomic<uint32_t> numRuns(0);
+    auto submitTasks = [&tinyTasksPool, &numRuns]
+    {
+        for(uint32_t taskIndex = 0; taskIndex < 200; ++taskIndex)
+        {
+            TinyTasksPool::TaskHandle handle = tinyTasksPool.Submit([&numRuns]
+            {
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+                numRuns++;
+            });
+            tinyTasksPool.ReleaseTask(handle.GetID());
+        }
+    };
+    
+    submitTasks();
+    tinyTasksPool.Resize(12);
+    ASSERT_EQ(tinyTasksPool.GetNumThreads(), 12);
+    submitTasks();
+    tinyTasksPool.Resize(2);
+    ASSERT_EQ(tinyTasksPool.GetNumThreads(), 2);
+    submitTasks();
+    tinyTasksPool.WaitAll();
+    ASSERT_EQ(numRuns, 600u);
+    
+    //The workers of the last two tied tasks have retired, so they're queued
+    for(auto taskID : tiedTaskIDs)
+    {
+        tinyTasksPool.SetNewLambdaForTask(taskID, [&numTiedRuns]{ numTiedRuns++; });
+    }
+    
+    tinyTasksPool.WaitAll();
+    ASSERT_EQ(numTiedRuns, 4u);
+    
+    //Growing again restarts the retired workers
+    tinyTasksPool.Resize(6);
+    ASSERT_EQ(tinyTasksPool.GetNumThreads(), 6);
+    for(auto taskID : tiedTaskIDs)
+    {
+        ASSERT_EQ(tinyTasksPool.SetNewLambdaForTask(taskID, [&numTiedRuns]{ numTiedRuns++; }),
+                  TinyTasksPool::Result::SUCCEEDED);
+    }
+    
+    submitTasks();
+    tinyTasksPool.WaitAll();
+    ASSERT_EQ(numTiedRuns, 8u);
+    ASSERT_EQ(numRuns, 800u);
+}
+
+TEST(TinyTasksTest, TestScheduleTiedTaskOfRestartedWorker)
+{
+    TinyTasksPool tinyTasksPool(2);
+    
+    //Tied to both workers
+    const TaskID firstTaskID = tinyTasksPool.CreateTask();
+    const TaskID tiedTaskID = tinyTasksPool.CreateTask();
+    
+    //The worker of the tied task retires once it's woken up, then its runs are queued
+    tinyTasksPool.Resize(1);
+    while(tinyTasksPool.SetNewLambdaForTask(tiedTaskID, []{}) != TinyTasksPool::Result::SUCCEEDED_AT_QUEUE)
+    {
+        tinyTasksPool.Wait(tiedTaskID);
+    }
+    tinyTasksPool.Wait(tiedTaskID);
+    
+    std::atomic<bool> canComplete(false);
+    std::atomic<uint32_t> numRuns(0);
+    ASSERT_EQ(tinyTasksPool.SetNewLambdaForTask(tiedTaskID, [&canComplete, &numRuns]
+    {
+        while(!canComplete) { std::this_thread::sleep_for(std::chrono::milliseconds(1)); }
+        numRuns++;
+    }), TinyTasksPool::Result::SUCCEEDED_AT_QUEUE);
+    ASSERT_EQ(tinyTasksPool.WaitForStatus(tiedTaskID, TinyTask::Status::RUNNING), TinyTasksPool::Result::SUCCEEDED);
+    
+    //The restarted worker doesn't run it again while the queued run hasn't finished
+    tinyTasksPool.Resize(2);
+    ASSERT_EQ(tinyTasksPool.SetNewLambdaForTask(tiedTaskID, [&numRuns]{ numRuns += 100; }), TinyTasksPool::Result::ALREADY_SCHEDULED);
+    
+    canComplete = true;
+    tinyTasksPool.Wait(tiedTaskID);
+    ASSERT_EQ(numRuns.load(), 1u);
+    
+    //Then it's run by the restarted worker again
+    ASSERT_EQ(tinyTasksPool.SetNewLambdaForTask(tiedTaskID, [&numRuns]{ numRuns++; }), TinyTasksPool::Result::SUCCEEDED);
+    tinyTasksPool.WaitAll();
+    ASSERT_EQ(numRuns.load(), 2u);
+    
+    tinyTasksPool.ReleaseTask(firstTaskID);
+    tinyTasksPool.ReleaseTask(tiedTaskID);
+}
+
+TEST(TinyTasksTest, TestWaitForTaskTiedToWaitingWorker)
+{
+    TinyTasksPool tinyTasksPool(1);
+    const TaskID blockingTaskID = tinyTasksPool.CreateTask();
+    const TaskID parentTaskID = tinyTasksPool.CreateTask();
+    
+    //The first worker is blocked, so the parent runs in the new worker
+    tinyTasksPool.Resize(2);
+    std::atomic<bool> canComplete(false);
+    tinyTasksPool.SetNewLambdaForTask(blockingTaskID, [&canComplete]
+    {
+        while(!canComplete) { std::this_thread::sleep_for(std::chrono::milliseconds(1)); }
+    });
+    ASSERT_EQ(tinyTasksPool.WaitForStatus(blockingTaskID, TinyTask::Status::RUNNING), TinyTasksPool::Result::SUCCEEDED);
+    
+    //The new worker has no tied task yet, so the child is tied to it
+    std::atomic<bool> hasRunChild(false);
+    tinyTasksPool.SetNewLambdaForTask(parentTaskID, [&tinyTasksPool, &hasRunChild]
+    {
+        TinyTasksPool::TaskHandle child = tinyTasksPool.Submit([&hasRunChild]{ hasRunChild = true; });
+        child.Wait();
+        tinyTasksPool.ReleaseTask(child.GetID());
+    });
+    
+    ASSERT_EQ(tinyTasksPool.WaitFor(parentTaskID, std::chrono::milliseconds(10000)), TinyTasksPool::Result::SUCCEEDED);
+    ASSERT_TRUE(hasRunChild);
+    
+    canComplete = true;
+    tinyTasksPool.WaitAll();
+    tinyTasksPool.ReleaseTask(blockingTaskID);
+    tinyTasksPool.ReleaseTask(parentTaskID);
+}
+
+TEST(TinyTasksTest, TestElasticTinyTasksPool)
+{
+    TinyTasksPool tinyTasksPool(2);
+    tinyTasksPool.EnableElasticMode(2, 8, std::chrono::milliseconds(20));
+    ASSERT_TRUE(tinyTasksPool.IsElastic());
+    ASSERT_EQ(tinyTasksPool.GetNumThreads(), 2);
+    
+    //Blocked tasks keep the workers busy, so the pool grows
+    std::atomic<bool> canComplete(false);
+    std::atomic<uint32_t> numRuns(0);
+    for(uint32_t taskIndex = 0; taskIndex < 32; ++taskIndex)
+    {
+        TinyTasksPool::TaskHandle handle = tinyTasksPool.Submit([&canComplete, &numRuns]
+        {
+            while(!canComplete) { std::this_thread::sleep_for(std::chrono::milliseconds(1)); }
+            numRuns++;
+        });
+        tinyTasksPool.ReleaseTask(handle.GetID());
+    }
+    
+    ASSERT_EQ(tinyTasksPool.GetNumThreads(), 8);
+    
+    canComplete = true;
+    tinyTasksPool.WaitAll();
+    ASSERT_EQ(numRuns, 32u);
+    
+    //Idle workers retire down to the minimum
+    const auto timeout = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while(tinyTasksPool.GetNumThreads() > 2 && std::chrono::steady_clock::now() < timeout)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    
+    ASSERT_EQ(tinyTasksPool.GetNumThreads(), 2);
+    
+    tinyTasksPool.DisableElasticMode();
+    ASSERT_FALSE(tinyTasksPool.IsElastic());
+}
+
+TEST(TinyTasksTest, TestDetectCpuTopology)
+{
+    const std::vector<uint32_t> cpus = CpuTopology::ParseCPUList("0-3,8,10-11\n");
+    const std::vector<uint32_t> expectedCPUs = { 0, 1, 2, 3, 8, 10, 11 };
+    ASSERT_EQ(cpus, expectedCPUs);
+    ASSERT_TRUE(CpuTopology::ParseCPUList("3-1").empty());
+    
+    //There is always a node with CPUs
+    CpuTopology topology = CpuTopology::Detect();
+    ASSERT_GE(topology.GetNumNodes(), 1u);
+    
+    for(size_t node = 0; node < topology.GetNumNodes(); ++node)
+    {
+        ASSERT_FALSE(topology.GetNodeCPUs(node).empty());
+    }
+}
+
+TEST(TinyTasksTest, TestPlaceWorkersOnCPUsInTinyTasksPool)
+{
+    //Pinned to the first CPU of the machine
+    const uint32_t firstCPU = CpuTopology::Detect().GetNodeCPUs(0)[0];
+    
+    {
+        TinyTasksPool tinyTasksPool(4, WorkerPlacement::PinToCPUs(std::vector<uint32_t>(1, firstCPU)));
+        ASSERT_EQ(tinyTasksPool.GetNumNodes(), 1);
+        
+        std::atomic<uint32_t> numRunsOnOtherCPUs(0);
+        for(uint32_t taskIndex = 0; taskIndex < 100; ++taskIndex)
+        {
+            TinyTasksPool::TaskHandle handle = tinyTasksPool.Submit([&numRunsOnOtherCPUs, firstCPU]
+            {
+#if defined(TINYTASKS_HAS_THREAD_AFFINITY)
+                if(sched_getcpu() != static_cast<int>(firstCPU)) numRunsOnOtherCPUs++;
+#endif
+            });
+            tinyTasksPool.ReleaseTask(handle.GetID());
+        }
+        
+        tinyTasksPool.WaitAll();
+        ASSERT_EQ(numRunsOnOtherCPUs, 0u);
+    }
+    
+    //Two nodes with the same CPU, so it works on any machine
+    CpuTopology topology({ { firstCPU }, { firstCPU } });
+    TinyTasksPool tinyTasksPool(4, WorkerPlacement::PerNumaNode(topology));
+    ASSERT_EQ(tinyTasksPool.GetNumNodes(), 2);
+    ASSERT_EQ(tinyTasksPool.GetCurrentNode(), constants::kAnyNode);
+    
+    //The workers are on nodes 0, 1, 0 and 1. The tasks tied to the workers
+    //of node 0 block them, so only the workers of node 1 can run tasks
+    std::vector<TaskID> tiedTaskIDs;
+    for(uint32_t taskIndex = 0; taskIndex < 4; ++taskIndex)
+    {
+        tiedTaskIDs.push_back(tinyTasksPool.CreateTask());
+    }
+    
+    std::atomic<bool> canComplete(false);
+    for(uint32_t taskIndex = 0; taskIndex < 4; taskIndex += 2)
+    {
+        tinyTasksPool.SetNewLambdaForTask(tiedTaskIDs[taskIndex], [&canComplete]
+        {
+            while(!canComplete) { std::this_thread::sleep_for(std::chrono::milliseconds(1)); }
+        });
+    }
+    
+    std::atomic<uint32_t> numRunsOnNodes[2];
+    numRunsOnNodes[0] = 0;
+    numRunsOnNodes[1] = 0;
+    
+    for(uint32_t taskIndex = 0; taskIndex < 200; ++taskIndex)
+    {
+        TinyTasksPool::TaskHandle handle = tinyTasksPool.SubmitOnNode([&tinyTasksPool, &numRunsOnNodes]
+        {
+            numRunsOnNodes[tinyTasksPool.GetCurrentNode()]++;
+        }, 1);
+        tinyTasksPool.ReleaseTask(handle.GetID());
+    }
+    
+    while(numRunsOnNodes[1] < 200) { std::this_thread::sleep_for(std::chrono::milliseconds(1)); }
+    
+    canComplete = true;
+    tinyTasksPool.WaitAll();
+    ASSERT_EQ(numRunsOnNodes[0], 0u);
+    
+    //Hints of nodes that the pool doesn't have are ignored
+    TinyTasksPool::TaskHandle handle = tinyTasksPool.SubmitOnNode([]{}, 7);
+    ASSERT_EQ(handle.Wait(), TinyTasksPool::Result::SUCCEEDED);
+}
+
+TEST(TinyTasksTest, TestRecordLatencyHistogram)
+{
+    LatencyHistogram histogram;
+    
+    //Values are kept with a relative error below 1 / kNumSubBuckets
+    for(uint64_t value = 1; value < (1ull << 40); value = value * 3 + 1)
+    {
+        const uint64_t upperBound = LatencyHistogram::GetBucketUpperBound(LatencyHistogram::GetBucket(value));
+        ASSERT_GE(upperBound, value);
+        ASSERT_LE(upperBound - value, value / LatencyHistogram::kNumSubBuckets);
+    }
+    
+    ASSERT_EQ(LatencyHistogram::GetBucket(UINT64_MAX), LatencyHistogram::kNumBuckets - 1);
+    
+    for(uint64_t value = 1; value <= 1000; ++value) histogram.Record(value * 1000);
+    
+    LatencyHistogram::Snapshot snapshot = histogram.GetSnapshot();
+    ASSERT_EQ(snapshot.GetCount(), 1000u);
+    ASSERT_EQ(snapshot.GetMax(), 1000000u);
+    ASSERT_NEAR(snapshot.GetMean(), 500500.0, 1.0);
+    ASSERT_NEAR(static_cast<double>(snapshot.GetPercentile(50.0)), 500000.0, 500000.0 / LatencyHistogram::kNumSubBuckets);
+    ASSERT_NEAR(static_cast<double>(snapshot.GetPercentile(99.0)), 990000.0, 990000.0 / LatencyHistogram::kNumSubBuckets);
+    ASSERT_EQ(snapshot.GetPercentile(100.0), 1000000u);
+    
+    snapshot.Merge(histogram.GetSnapshot());
+    ASSERT_EQ(snapshot.GetCount(), 2000u);
+    ASSERT_EQ(LatencyHistogram::Snapshot().GetPercentile(99.0), 0u);
+}
+
+TEST(TinyTasksTest, TestGetMetricsOfTinyTasksPool)
+{
+    TinyTasksPool tinyTasksPool(4);
+    
+    TinyTasksPool::Metrics metrics = tinyTasksPool.GetMetrics();
+    ASSERT_EQ(metrics.numScheduledRuns, 0u);
+    ASSERT_EQ(metrics.workers.size(), 4u);
+    
+    const uint32_t numTasks = 200;
+    for(uint32_t taskIndex = 0; taskIndex < numTasks; ++taskIndex)
+    {
+        TinyTasksPool::TaskHandle handle = tinyTasksPool.Submit([]
+        {
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        });
+        tinyTasksPool.ReleaseTask(handle.GetID());
+    }
+    
+    //Runs until it's stopped, so the run is counted as stopped
+    const TaskID stoppedTaskID = tinyTasksPool.CreateTask();
+    TinyTask* stoppedTask = tinyTasksPool.GetTask(stoppedTaskID);
+    tinyTasksPool.SetNewLambdaForTask(stoppedTaskID, [stoppedTask]
+    {
+        while(!stoppedTask->IsStopping()) { std::this_thread::sleep_for(std::chrono::milliseconds(1)); }
+    });
+    
+    ASSERT_EQ(tinyTasksPool.WaitForStatus(stoppedTaskID, TinyTask::Status::RUNNING), TinyTasksPool::Result::SUCCEEDED);
+    stoppedTask->Stop();
+    tinyTasksPool.Wait(stoppedTaskID);
+    
+    tinyTasksPool.WaitAll();
+    metrics = tinyTasksPool.GetMetrics();
+    
+    ASSERT_EQ(metrics.numScheduledRuns, numTasks + 1);
+    ASSERT_EQ(metrics.numCompletedRuns, numTasks + 1);
+    ASSERT_EQ(metrics.numStoppedRuns, 1u);
+    ASSERT_EQ(metrics.numPendingTasks, 0u);
+    ASSERT_EQ(metrics.numThreads, 4);
+    
+    uint64_t numWorkerRuns = 0;
+    for(const auto& workerMetrics : metrics.workers)
+    {
+        ASSERT_TRUE(workerMetrics.isActive);
+        ASSERT_EQ(workerMetrics.queueLength, 0u);
+        numWorkerRuns += workerMetrics.numCompletedRuns;
+    }
+    
+    ASSERT_EQ(numWorkerRuns, metrics.numCompletedRuns);
+    
+#if TINYTASKS_ENABLE_METRICS
+    ASSERT_EQ(metrics.runTimes.GetCount(), numTasks + 1);
+    ASSERT_EQ(metrics.queueWaitTimes.GetCount(), numTasks + 1);
+    ASSERT_GE(metrics.runTimes.GetPercentile(50.0), 200000u);
+#endif
+}
+
+TEST(TinyTasksTest, TestCancellationSources)
+{
+    CancellationToken defaultToken;
+    ASSERT_FALSE(defaultToken.CanBeCancelled());
+    ASSERT_FALSE(defaultToken.IsCancelled());
+    
+    CancellationSource source;
+    CancellationToken token = source.GetToken();
+    ASSERT_TRUE(token.CanBeCancelled());
+    ASSERT_FALSE(token.IsCancelled());
+    
+    //Children are cancelled with the parent, but not the other way around
+    CancellationSource childSource(token);
+    CancellationSource grandchildSource(childSource.GetToken());
+    CancellationSource otherChildSource(token);
+    
+    otherChildSource.Cancel();
+    ASSERT_TRUE(otherChildSource.IsCancelled());
+    ASSERT_FALSE(token.IsCancelled());
+    
+    source.Cancel();
+    ASSERT_TRUE(token.IsCancelled());
+    ASSERT_TRUE(childSource.IsCancelled());
+    ASSERT_TRUE(grandchildSource.GetToken().IsCancelled());
+    
+    //Created once the parent is cancelled
+    CancellationSource lateChildSource(token);
+    ASSERT_TRUE(lateChildSource.IsCancelled());
+}
+
+TEST(TinyTasksTest, TestCancelTasksWithTaskContext)
+{
+    TinyTasksPool tinyTasksPool(4);
+    CancellationSource source;
+    std::atomic<uint32_t> numCancelledTasks(0);
+    
+    auto loopUntilCancelled = [&numCancelledTasks](TaskContext& context)
+    {
+        while(!context.IsCancelled()) { std::this_thread::sleep_for(std::chrono::milliseconds(1)); }
+        numCancelledTasks++;
+    };
+    
+    TinyTasksPool::TaskHandle handle = tinyTasksPool.Submit([&loopUntilCancelled](TaskContext& context)
+    {
+        //The child gets the token of its parent
+        TinyTasksPool::TaskHandle childHandle = context.Submit(loopUntilCancelled);
+        loopUntilCancelled(context);
+        
+        childHandle.Wait();
+        context.GetPool().ReleaseTask(childHandle.GetID());
+    }, source.GetToken());
+    
+    ASSERT_EQ(tinyTasksPool.WaitForStatus(handle.GetID(), TinyTask::Status::RUNNING), TinyTasksPool::Result::SUCCEEDED);
+    ASSERT_EQ(numCancelledTasks, 0u);
+    
+    source.Cancel();
+    handle.Wait();
+    ASSERT_EQ(numCancelledTasks, 2u);
+    tinyTasksPool.ReleaseTask(handle.GetID());
+    
+    //Stopping the task cancels its context too
+    const TaskID taskID = tinyTasksPool.CreateTask();
+    tinyTasksPool.SetNewLambdaForTask(taskID, loopUntilCancelled);
+    
+    ASSERT_EQ(tinyTasksPool.WaitForStatus(taskID, TinyTask::Status::RUNNING), TinyTasksPool::Result::SUCCEEDED);
+    tinyTasksPool.GetTask(taskID)->Stop();
+    tinyTasksPool.Wait(taskID);
+    ASSERT_EQ(numCancelledTasks, 3u);
+    
+    //The context knows its task
+    TaskID contextTaskID = 0;
+    handle = tinyTasksPool.Submit([&contextTaskID](TaskContext& context)
+    {
+        contextTaskID = context.GetTaskID();
+        context.SetProgress(1.0f);
+    });
+    
+    handle.Wait();
+    ASSERT_EQ(contextTaskID, handle.GetID());
+    ASSERT_EQ(tinyTasksPool.GetTask(handle.GetID())->GetProgress(), 1.0f);
+    tinyTasksPool.ReleaseTask(handle.GetID());
+}
+
+TEST(TinyTasksTest, TestRunQueuedTasksWhileWaiting)
+{
+    TinyTasksPool tinyTasksPool(2);
+    std::atomic<uint32_t> numChildTasks(0);
+    
+    //Both workers wait for their children, which can only run in the waiting workers
+    std::vector<TinyTasksPool::TaskHandle> parentHandles;
+    for(uint32_t parentIndex = 0; parentIndex < 2; ++parentIndex)
+    {
+        parentHandles.push_back(tinyTasksPool.Submit([&tinyTasksPool, &numChildTasks]
+        {
+            std::vector<TinyTasksPool::TaskHandle> childHandles;
+            for(uint32_t childIndex = 0; childIndex < 8; ++childIndex)
+            {
+                childHandles.push_back(tinyTasksPool.Submit([&numChildTasks]{ numChildTasks++; }));
+            }
+            
+            for(const TinyTasksPool::TaskHandle& childHandle : childHandles)
+            {
+                childHandle.Wait();
+                tinyTasksPool.ReleaseTask(childHandle.GetID());
+            }
+        }));
+    }
+    
+    for(const TinyTasksPool::TaskHandle& parentHandle : parentHandles)
+    {
+        ASSERT_EQ(parentHandle.WaitFor(std::chrono::milliseconds(10000)), TinyTasksPool::Result::SUCCEEDED);
+        tinyTasksPool.ReleaseTask(parentHandle.GetID());
+    }
+    
+    ASSERT_EQ(numChildTasks, 16u);
+    ASSERT_EQ(tinyTasksPool.GetMetrics().numExternalRuns, 0u);
+    
+    //Threads of outside the pool help once enabled
+    std::atomic<bool> canComplete(false);
+    std::vector<TinyTasksPool::TaskHandle> blockingHandles;
+    for(uint32_t workerIndex = 0; workerIndex < 2; ++workerIndex)
+    {
+        blockingHandles.push_back(tinyTasksPool.Submit([&canComplete]
+        {
+            while(!canComplete) { std::this_thread::sleep_for(std::chrono::milliseconds(1)); }
+        }));
+    }
+    
+    for(const TinyTasksPool::TaskHandle& blockingHandle : blockingHandles)
+    {
+        ASSERT_EQ(tinyTasksPool.WaitForStatus(blockingHandle.GetID(), TinyTask::Status::RUNNING), TinyTasksPool::Result::SUCCEEDED);
+    }
+    
+    tinyTasksPool.SetExternalThreadsHelp(true);
+    
+    std::thread::id runThreadID;
+    TinyTasksPool::TaskHandle handle = tinyTasksPool.Submit([&runThreadID]{ runThreadID = std::this_thread::get_id(); });
+    ASSERT_EQ(handle.Wait(), TinyTasksPool::Result::SUCCEEDED);
+    ASSERT_EQ(runThreadID, std::this_thread::get_id());
+    ASSERT_EQ(tinyTasksPool.GetMetrics().numExternalRuns, 1u);
+    
+    ASSERT_EQ(blockingHandles.front().WaitFor(std::chrono::milliseconds(10)), TinyTasksPool::Result::TIMED_OUT);
+    
+    canComplete = true;
+    tinyTasksPool.WaitAll();
+    
+    tinyTasksPool.ReleaseTask(handle.GetID());
+    for(const TinyTasksPool::TaskHandle& blockingHandle : blockingHandles) tinyTasksPool.ReleaseTask(blockingHandle.GetID());
+}
+
+TEST(TinyTasksTest, TestRunQueuedTasksWhileWaitingForGroupsGraphsAndFutures)
+{
+    //The only worker waits for the nested tasks, which can only run in it
+    TinyTasksPool tinyTasksPool(1);
+    std::atomic<uint32_t> numGroupTasks(0);
+    std::atomic<uint32_t> numGraphNodes(0);
+    std::atomic<uint32_t> numLoopIndices(0);
+    int futureResult = 0;
+    
+    TinyTasksPool::TaskHandle handle = tinyTasksPool.Submit([&]
+    {
+        TaskGroup group(tinyTasksPool);
+        for(uint32_t taskIndex = 0; taskIndex < 8; ++taskIndex) group.Submit([&numGroupTasks]{ numGroupTasks++; });
+        group.Wait();
+        
+        TaskGraph graph(tinyTasksPool);
+        TaskGraph::NodeID firstNode = graph.AddNode([&numGraphNodes]{ numGraphNodes++; });
+        TaskGraph::NodeID secondNode = graph.AddNode([&numGraphNodes]{ numGraphNodes++; });
+        graph.AddEdge(firstNode, secondNode);
+        graph.Run();
+        graph.Wait();
+        
+        ParallelFor(tinyTasksPool, 0u, 1000u, 10u, [&numLoopIndices](uint32_t) { numLoopIndices++; });
+        
+        Future<int> future = Async(tinyTasksPool, []{ return 20; }).Then([](const int& value) { return value + 1; });
+        ASSERT_TRUE(future.WaitFor(std::chrono::milliseconds(10000)));
+        futureResult = WhenAll(std::vector<Future<int>>(1, future)).Get().front() * 2;
+    });
+    
+    ASSERT_EQ(handle.WaitFor(std::chrono::milliseconds(10000)), TinyTasksPool::Result::SUCCEEDED);
+    tinyTasksPool.ReleaseTask(handle.GetID());
+    
+    ASSERT_EQ(numGroupTasks, 8u);
+    ASSERT_EQ(numGraphNodes, 2u);
+    ASSERT_EQ(numLoopIndices, 1000u);
+    ASSERT_EQ(futureResult, 42);
+}
+
+TEST(TinyTasksTest, TestShutdownTinyTasksPool)
+{
+    //The queued tasks are run
+    {
+        TinyTasksPool tinyTasksPool(2);
+        std::atomic<uint32_t> numRunTasks(0);
+        
+        for(uint32_t taskIndex = 0; taskIndex < 20; ++taskIndex)
+        {
+            TinyTasksPool::TaskHandle handle = tinyTasksPool.Submit([&numRunTasks]
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                numRunTasks++;
+            });
+            tinyTasksPool.ReleaseTask(handle.GetID());
+        }
+        
+        ASSERT_EQ(tinyTasksPool.Shutdown(TinyTasksPool::ShutdownMode::DRAIN), TinyTasksPool::Result::SUCCEEDED);
+        ASSERT_TRUE(tinyTasksPool.IsShutDown());
+        ASSERT_EQ(numRunTasks, 20u);
+        
+        //No more tasks are run
+        const TaskID taskID = tinyTasksPool.CreateTask();
+        ASSERT_EQ(tinyTasksPool.SetNewLambdaForTask(taskID, [&numRunTasks]{ numRunTasks++; }), TinyTasksPool::Result::SHUT_DOWN);
+        ASSERT_EQ(tinyTasksPool.Wait(taskID), TinyTasksPool::Result::SUCCEEDED);
+        ASSERT_EQ(tinyTasksPool.Shutdown(TinyTasksPool::ShutdownMode::CANCEL), TinyTasksPool::Result::SUCCEEDED);
+        ASSERT_EQ(numRunTasks, 20u);
+    }
+    
+    //The running and queued tasks are stopped
+    {
+        TinyTasksPool tinyTasksPool(2);
+        std::atomic<uint32_t> numCancelledTasks(0);
+        std::vector<TaskID> taskIDs;
+        
+        for(uint32_t taskIndex = 0; taskIndex < 10; ++taskIndex)
+        {
+            taskIDs.push_back(tinyTasksPool.Submit([&numCancelledTasks](TaskContext& context)
+            {
+                while(!context.IsCancelled()) { std::this_thread::sleep_for(std::chrono::milliseconds(1)); }
+                numCancelledTasks++;
+            }).GetID());
+        }
+        
+        ASSERT_EQ(tinyTasksPool.WaitForStatus(taskIDs.front(), TinyTask::Status::RUNNING), TinyTasksPool::Result::SUCCEEDED);
+        ASSERT_EQ(tinyTasksPool.Shutdown(TinyTasksPool::ShutdownMode::CANCEL), TinyTasksPool::Result::SUCCEEDED);
+        ASSERT_EQ(numCancelledTasks, 10u);
+        
+        for(const TaskID taskID : taskIDs)
+        {
+            ASSERT_TRUE(tinyTasksPool.GetTask(taskID)->HasStopped());
+        }
+    }
+    
+    //The tasks that don't finish in time are cancelled
+    {
+        TinyTasksPool tinyTasksPool(2);
+        std::atomic<bool> canComplete(false);
+        
+        const TaskID taskID = tinyTasksPool.CreateTask();
+        tinyTasksPool.SetNewLambdaForTask(taskID, [&canComplete]
+        {
+            while(!canComplete) { std::this_thread::sleep_for(std::chrono::milliseconds(1)); }
+        });
+        
+        ASSERT_EQ(tinyTasksPool.WaitForStatus(taskID, TinyTask::Status::RUNNING), TinyTasksPool::Result::SUCCEEDED);
+        ASSERT_EQ(tinyTasksPool.Shutdown(TinyTasksPool::ShutdownMode::DRAIN, std::chrono::milliseconds(20)), TinyTasksPool::Result::TIMED_OUT);
+        ASSERT_FALSE(tinyTasksPool.IsShutDown());
+        ASSERT_TRUE(tinyTasksPool.GetTask(taskID)->IsStopping());
+        
+        canComplete = true;
+        ASSERT_EQ(tinyTasksPool.Shutdown(TinyTasksPool::ShutdownMode::DRAIN, std::chrono::milliseconds(10000)), TinyTasksPool::Result::SUCCEEDED);
+        ASSERT_TRUE(tinyTasksPool.GetTask(taskID)->HasStopped());
+    }
+}
+
+TEST(TinyTasksTest, TestPushAndPopInMPMCQueue)
+{
+    MPMCQueue<uint32_t> queue(64);
+    std::vector<uint32_t> values(100000);
+    for(uint32_t index = 0; index < values.size(); ++index) values[index] = index;
+    
+    //Full and empty
+    for(uint32_t index = 0; index < 64; ++index) ASSERT_TRUE(queue.Push(&values[index]));
+    ASSERT_FALSE(queue.Push(&values[64]));
+    ASSERT_EQ(queue.GetSize(), 64u);
+    for(uint32_t index = 0; index < 64; ++index) ASSERT_EQ(queue.Pop(), &values[index]);
+    ASSERT_EQ(queue.Pop(), nullptr);
+    
+    //Each item is popped once, by any of the consumers
+    const uint32_t numProducers = 4;
+    std::vector<std::atomic<uint32_t>> numPops(values.size());
+    for(std::atomic<uint32_t>& numPop : numPops) numPop = 0;
+    std::atomic<uint32_t> numPopped(0);
+    std::vector<std::thread> threads;
+    
+    for(uint32_t producerIndex = 0; producerIndex < numProducers; ++producerIndex)
+    {
+        threads.emplace_back([&queue, &values, producerIndex, numProducers]
+        {
+            for(size_t index = producerIndex; index < values.size(); index += numProducers)
+            {
+                while(!queue.Push(&values[index])) { std::this_thread::yield(); }
+            }
+        });
+        
+        threads.emplace_back([&queue, &numPops, &numPopped, &values]
+        {
+            while(numPopped < values.size())
+            {
+                uint32_t* value = queue.Pop();
+                if(value == nullptr) { std::this_thread::yield(); continue; }
+                
+                numPops[*value]++;
+                numPopped++;
+            }
+        });
+    }
+    
+    for(std::thread& thread : threads) thread.join();
+    
+    for(const std::atomic<uint32_t>& numPop : numPops) ASSERT_EQ(numPop.load(), 1u);
+    ASSERT_EQ(queue.GetSize(), 0u);
+}
+
+TEST(TinyTasksTest, TestAllocateInScratchArena)
+{
+    ScratchArena arena(256);
+
+    char* bytes = static_cast<char*>(arena.Allocate(3, 1));
+    uint64_t* values = arena.AllocateArray<uint64_t>(4);
+    ASSERT_NE(bytes, nullptr);
+    ASSERT_EQ(reinterpret_cast<std::uintptr_t>(values) % alignof(uint64_t), 0u);
+    ASSERT_GE(arena.GetUsedSize(), 3u + 4 * sizeof(uint64_t));
+
+    //Bigger than what's left, so it's allocated in the heap
+    const ScratchArena::Marker marker = arena.GetMarker();
+    char* bigBytes = static_cast<char*>(arena.Allocate(1024));
+    memset(bigBytes, 0, 1024);
+    ASSERT_EQ(arena.GetNumOverflows(), 1u);
+
+    arena.AllocateArray<uint32_t>(16);
+    arena.Rewind(marker);
+    ASSERT_EQ(arena.GetUsedSize(), marker.offset);
+
+    arena.Reset();
+    ASSERT_EQ(arena.GetUsedSize(), 0u);
+    ASSERT_EQ(arena.Allocate(3, 1), bytes);
+    ASSERT_EQ(arena.GetCapacity(), 256u);
+}
+
+TEST(TinyTasksTest, TestUseScratchArenaInTinyTasksPool)
+{
+    TinyTasksPool tinyTasksPool(2, WorkerPlacement(), 4096);
+    ASSERT_EQ(tinyTasksPool.GetScratchArenaSize(), 4096u);
+
+    //The arena is rewound after each task, so they all fit in it
+    std::atomic<uint32_t> numRuns(0);
+    for(uint32_t taskIndex = 0; taskIndex < 200; ++taskIndex)
+    {
+        TinyTasksPool::TaskHandle handle = tinyTasksPool.Submit([&numRuns, taskIndex](TaskContext& context)
+        {
+            uint32_t* values = context.GetScratchArena().AllocateArray<uint32_t>(512);
+            for(uint32_t index = 0; index < 512; ++index) values[index] = taskIndex;
+
+            if(values[511] == taskIndex) numRuns++;
+        });
+        tinyTasksPool.ReleaseTask(handle.GetID());
+    }
+
+    tinyTasksPool.WaitAll();
+    ASSERT_EQ(numRuns.load(), 200u);
+
+    for(const TinyTasksPool::WorkerMetrics& workerMetrics : tinyTasksPool.GetMetrics().workers)
+    {
+        ASSERT_EQ(workerMetrics.numScratchArenaOverflows, 0u);
+    }
+}
+
+TEST(TinyTasksTest, TestAdvanceTimerWheel)
+{
+    TimerWheel timerWheel;
+    const uint64_t expiryTicks[] = { 1, 63, 64, 65, 4096, 5000, 300000 };
+    
+    for(uint64_t expiryTick : expiryTicks)
+    {
+        timerWheel.Add(std::make_shared<TimerWheel::Timer>(expiryTick, TaskFunction([]{}), expiryTick, 0));
+    }
+    
+    std::shared_ptr<TimerWheel::Timer> cancelledTimer = std::make_shared<TimerWheel::Timer>(0, TaskFunction([]{}), 100, 0);
+    timerWheel.Add(cancelledTimer);
+    cancelledTimer->isCancelled = true;
+    ASSERT_EQ(timerWheel.GetNumTimers(), 8u);
+    
+    //Each timer expires exactly at its tick
+    std::vector<std::shared_ptr<TimerWheel::Timer>> expiredTimers;
+    for(uint64_t tick = 1; tick <= 300000; ++tick)
+    {
+        timerWheel.Advance(tick, expiredTimers);
+        
+        for(const std::shared_ptr<TimerWheel::Timer>& timer : expiredTimers)
+        {
+            ASSERT_EQ(timer->expiryTick, tick);
+        }
+        expiredTimers.clear();
+    }
+    
+    ASSERT_EQ(timerWheel.GetNumTimers(), 0u);
+    ASSERT_EQ(timerWheel.GetTicksUntilNextCheck(), UINT64_MAX);
+    
+    //Advancing many ticks at once takes all the timers that expire meanwhile
+    for(uint64_t expiryTick : expiryTicks)
+    {
+        timerWheel.Add(std::make_shared<TimerWheel::Timer>(expiryTick, TaskFunction([]{}), 300000 + expiryTick, 0));
+    }
+    timerWheel.Advance(300000 + 5000, expiredTimers);
+    ASSERT_EQ(expiredTimers.size(), 6u);
+    ASSERT_EQ(timerWheel.GetNumTimers(), 1u);
+}
+
+TEST(TinyTasksTest, TestScheduleTimersInTinyTasksPool)
+{
+    TinyTasksPool tinyTasksPool(2);
+    
+    //One-shot timer, not run before its delay
+    const auto startTime = std::chrono::steady_clock::now();
+    std::atomic<int64_t> elapsedTime(-1);
+    ASSERT_NE(tinyTasksPool.ScheduleAfter(std::chrono::milliseconds(20), [&elapsedTime, startTime]
+    {
+        elapsedTime = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startTime).count();
+    }), 0u);
+    
+    //Periodic timer, until it's cancelled
+    std::atomic<uint32_t> numPeriodicRuns(0);
+    const TimerID periodicTimerID = tinyTasksPool.ScheduleEvery(std::chrono::milliseconds(5), [&numPeriodicRuns]{ numPeriodicRuns++; });
+    
+    while(elapsedTime < 0 || numPeriodicRuns < 3) { std::this_thread::sleep_for(std::chrono::milliseconds(1)); }
+    ASSERT_GE(elapsedTime.load(), 20);
+    
+    ASSERT_TRUE(tinyTasksPool.CancelTimer(periodicTimerID));
+    ASSERT_FALSE(tinyTasksPool.CancelTimer(periodicTimerID));
+    tinyTasksPool.WaitAll();
+    const uint32_t numRunsAfterCancel = numPeriodicRuns;
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    ASSERT_EQ(numPeriodicRuns.load(), numRunsAfterCancel);
+    
+    //Many timers
+    std::atomic<uint32_t> numRuns(0);
+    for(uint32_t timerIndex = 0; timerIndex < 1000; ++timerIndex)
+    {
+        tinyTasksPool.ScheduleAfter(std::chrono::milliseconds(timerIndex % 50), [&numRuns]{ numRuns++; });
+    }
+    
+    while(tinyTasksPool.GetNumTimers() > 0) { std::this_thread::sleep_for(std::chrono::milliseconds(1)); }
+    tinyTasksPool.WaitAll();
+    ASSERT_EQ(numRuns.load(), 1000u);
+    ASSERT_FALSE(tinyTasksPool.CancelTimer(123456));
+    
+    //Timers are cancelled on shutdown
+    std::atomic<bool> hasRun(false);
+    tinyTasksPool.ScheduleAfter(std::chrono::milliseconds(10000), [&hasRun]{ hasRun = true; });
+    ASSERT_EQ(tinyTasksPool.Shutdown(TinyTasksPool::ShutdownMode::DRAIN), TinyTasksPool::Result::SUCCEEDED);
+    ASSERT_EQ(tinyTasksPool.GetNumTimers(), 0u);
+    ASSERT_EQ(tinyTasksPool.ScheduleAfter(std::chrono::milliseconds(1), []{}), 0u);
+    ASSERT_FALSE(hasRun);
+}
+
+TEST(TinyTasksTest, TestSetLambdaOfScheduledTaskInTinyTasksPool)
+{
+    TinyTasksPool tinyTasksPool(2);
+    
+    //Tied to the first worker, and kept running
+    std::atomic<bool> canComplete(false);
+    std::atomic<uint32_t> numRuns(0);
+    const TaskID tiedTaskID = tinyTasksPool.CreateTask();
+    tinyTasksPool.CreateTask();
+    ASSERT_EQ(tinyTasksPool.SetNewLambdaForTask(tiedTaskID, [&canComplete, &numRuns]
+    {
+        while(!canComplete) { std::this_thread::sleep_for(std::chrono::milliseconds(1)); }
+        numRuns++;
+    }), TinyTasksPool::Result::SUCCEEDED);
+    ASSERT_EQ(tinyTasksPool.WaitForStatus(tiedTaskID, TinyTask::Status::RUNNING), TinyTasksPool::Result::SUCCEEDED);
+    
+    //The lambda of a running task isn't replaced
+    ASSERT_EQ(tinyTasksPool.SetNewLambdaForTask(tiedTaskID, [&numRuns]{ numRuns += 100; }), TinyTasksPool::Result::ALREADY_SCHEDULED);
+    
+    //Nor the lambda of a queued task
+    const TaskID queuedTaskID = tinyTasksPool.CreateTask();
+    tinyTasksPool.SetNewLambdaForTask(queuedTaskID, [&canComplete, &numRuns]
+    {
+        while(!canComplete) { std::this_thread::sleep_for(std::chrono::milliseconds(1)); }
+        numRuns++;
+    });
+    ASSERT_EQ(tinyTasksPool.SetNewLambdaForTask(queuedTaskID, [&numRuns]{ numRuns += 100; }), TinyTasksPool::Result::ALREADY_SCHEDULED);
+    
+    canComplete = true;
+    tinyTasksPool.Wait(tiedTaskID);
+    tinyTasksPool.Wait(queuedTaskID);
+    ASSERT_EQ(numRuns.load(), 2u);
+    
+    //Once the runs are waited for, the tasks can run again
+    ASSERT_EQ(tinyTasksPool.SetNewLambdaForTask(tiedTaskID, [&numRuns]{ numRuns++; }), TinyTasksPool::Result::SUCCEEDED);
+    ASSERT_NE(tinyTasksPool.SetNewLambdaForTask(queuedTaskID, [&numRuns]{ numRuns++; }), TinyTasksPool::Result::ALREADY_SCHEDULED);
+    tinyTasksPool.WaitAll();
+    ASSERT_EQ(numRuns.load(), 4u);
+}
+
+TEST(TinyTasksTest, TestSubmitGroupsAndGraphsAfterShutdown)
+{
+    TinyTasksPool tinyTasksPool(2);
+    ASSERT_EQ(tinyTasksPool.Shutdown(TinyTasksPool::ShutdownMode::DRAIN), TinyTasksPool::Result::SUCCEEDED);
+    
+    //The lambdas aren't run, and the group and the graph don't wait for them
+    std::atomic<bool> hasRun(false);
+    ASSERT_FALSE(tinyTasksPool.Submit([&hasRun]{ hasRun = true; }).IsValid());
+    {
+        TaskGroup group(tinyTasksPool);
+        group.Submit([&hasRun]{ hasRun = true; });
+        ASSERT_EQ(group.GetNumUnfinishedTasks(), 0u);
+    }
+    
+    {
+        TaskGraph graph(tinyTasksPool);
+        graph.AddNode([&hasRun]{ hasRun = true; });
+        ASSERT_EQ(graph.Run(), TaskGraph::Result::SHUT_DOWN);
+        ASSERT_FALSE(graph.IsRunning());
+    }
+    
+    ASSERT_FALSE(hasRun);
+}
+
+TEST(TinyTasksTest, TestScheduleTasksAfterShutdownTimesOut)
+{
+    TinyTasksPool tinyTasksPool(2);
+    std::atomic<bool> hasStarted(false);
+    std::atomic<bool> canComplete(false);
+    std::atomic<bool> hasRunSuccessor(false);
+    
+    TaskGraph graph(tinyTasksPool);
+    TaskGraph::NodeID blockingNode = graph.AddNode([&hasStarted, &canComplete]
+    {
+        hasStarted = true;
+        while(!canComplete) { std::this_thread::sleep_for(std::chrono::milliseconds(1)); }
+    });
+    TaskGraph::NodeID successorNode = graph.AddNode([&hasRunSuccessor]{ hasRunSuccessor = true; });
+    graph.AddEdge(blockingNode, successorNode);
+    ASSERT_EQ(graph.Run(), TaskGraph::Result::SUCCEEDED);
+    while(!hasStarted) { std::this_thread::yield(); }
+    
+    ASSERT_EQ(tinyTasksPool.Shutdown(TinyTasksPool::ShutdownMode::DRAIN, std::chrono::milliseconds(20)), TinyTasksPool::Result::TIMED_OUT);
+    ASSERT_FALSE(tinyTasksPool.IsShutDown());
+    
+    //The workers keep running, but no new runs nor timers are scheduled
+    std::atomic<bool> hasRun(false);
+    const TaskID taskID = tinyTasksPool.CreateTask();
+    ASSERT_EQ(tinyTasksPool.SetNewLambdaForTask(taskID, [&hasRun]{ hasRun = true; }), TinyTasksPool::Result::SHUT_DOWN);
+    ASSERT_EQ(tinyTasksPool.ScheduleAfter(std::chrono::milliseconds(1), [&hasRun]{ hasRun = true; }), 0u);
+    {
+        TaskGroup group(tinyTasksPool);
+        group.Submit([&hasRun]{ hasRun = true; });
+        ASSERT_EQ(group.GetNumUnfinishedTasks(), 0u);
+    }
+    
+    //The running graph still finishes, running its successors in place
+    canComplete = true;
+    graph.Wait();
+    ASSERT_TRUE(hasRunSuccessor);
+    ASSERT_FALSE(hasRun);
+    
+    tinyTasksPool.ReleaseTask(taskID);
+    ASSERT_EQ(tinyTasksPool.Shutdown(TinyTasksPool::ShutdownMode::CANCEL), TinyTasksPool::Result::SUCCEEDED);
+}
+
+TEST(TinyTasksTest, TestOverflowPoliciesOfBoundedQueue)
+{
+    TinyTasksPool tinyTasksPool(2);
+    ASSERT_EQ(tinyTasksPool.GetQueueCapacity(), 0u);
+    
+    //The tied tasks keep both workers busy, so the next tasks stay queued
+    std::atomic<bool> canComplete(false);
+    std::vector<TinyTasksPool::TaskHandle> blockers;
+    for(int blockerIndex = 0; blockerIndex < 2; ++blockerIndex)
+    {
+        blockers.push_back(tinyTasksPool.Submit([&canComplete]
+        {
+            while(!canComplete) { std::this_thread::sleep_for(std::chrono::milliseconds(1)); }
+        }));
+        ASSERT_EQ(tinyTasksPool.WaitForStatus(blockers.back().GetID(), TinyTask::Status::RUNNING), TinyTasksPool::Result::SUCCEEDED);
+    }
+    
+    std::atomic<uint32_t> numRuns(0);
+    auto countRun = [&numRuns]{ numRuns++; };
+    
+    //Rejected once the queues are full
+    tinyTasksPool.SetQueueCapacity(3, TinyTasksPool::OverflowPolicy::REJECT);
+    for(int taskIndex = 0; taskIndex < 3; ++taskIndex)
+    {
+        TinyTasksPool::TaskHandle handle = tinyTasksPool.TrySubmit(countRun);
+        ASSERT_TRUE(handle.IsValid());
+        tinyTasksPool.ReleaseTask(handle.GetID());
+    }
+    
+    ASSERT_FALSE(tinyTasksPool.TrySubmit(countRun).IsValid());
+    const TaskID rejectedTaskID = tinyTasksPool.CreateTask();
+    ASSERT_EQ(tinyTasksPool.SetNewLambdaForTask(rejectedTaskID, countRun), TinyTasksPool::Result::QUEUE_FULL);
+    
+    //Submit() gives an empty handle too, so the rejection doesn't look like a finished run
+    ASSERT_FALSE(tinyTasksPool.Submit(countRun).IsValid());
+    ASSERT_FALSE(tinyTasksPool.Submit(countRun, CancellationToken()).IsValid());
+    ASSERT_EQ(tinyTasksPool.GetNumPendingTasks(), 3u);
+    ASSERT_EQ(tinyTasksPool.GetMetrics().numRejectedRuns, 4u);
+    
+    //Run in the submitting thread
+    tinyTasksPool.SetQueueCapacity(3, TinyTasksPool::OverflowPolicy::RUN_IN_CALLER);
+    std::thread::id runThreadID;
+    ASSERT_EQ(tinyTasksPool.SetNewLambdaForTask(rejectedTaskID, [&runThreadID]{ runThreadID = std::this_thread::get_id(); }),
+              TinyTasksPool::Result::SUCCEEDED);
+    ASSERT_EQ(runThreadID, std::this_thread::get_id());
+    ASSERT_TRUE(tinyTasksPool.GetTask(rejectedTaskID)->HasCompleted());
+    ASSERT_FALSE(tinyTasksPool.TrySubmit(countRun).IsValid());
+    
+    //Block the submitting thread until a task is taken from the queues
+    tinyTasksPool.SetQueueCapacity(3, TinyTasksPool::OverflowPolicy::BLOCK);
+    std::atomic<bool> hasSubmitted(false);
+    std::thread submitter([&tinyTasksPool, &countRun, &hasSubmitted]
+    {
+        tinyTasksPool.ReleaseTask(tinyTasksPool.Submit(countRun).GetID());
+        hasSubmitted = true;
+    });
+    
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    ASSERT_FALSE(hasSubmitted);
+    
+    canComplete = true;
+    submitter.join();
+    tinyTasksPool.WaitAll();
+    ASSERT_EQ(numRuns.load(), 4u);
+    
+    //Without limit again
+    tinyTasksPool.SetQueueCapacity(0, TinyTasksPool::OverflowPolicy::REJECT);
+    ASSERT_TRUE(tinyTasksPool.TrySubmit(countRun).IsValid());
+    tinyTasksPool.WaitAll();
+    ASSERT_EQ(numRuns.load(), 5u);
+}
+
+TEST(TinyTasksTest, TestRunGroupsGraphsAndFuturesWithFullQueue)
+{
+    TinyTasksPool tinyTasksPool(2);
+    
+    //The tied tasks keep both workers busy, and the queue is full
+    std::atomic<bool> canComplete(false);
+    for(int blockerIndex = 0; blockerIndex < 2; ++blockerIndex)
+    {
+        TinyTasksPool::TaskHandle blocker = tinyTasksPool.Submit([&canComplete]
+        {
+            while(!canComplete) { std::this_thread::sleep_for(std::chrono::milliseconds(1)); }
+        });
+        ASSERT_EQ(tinyTasksPool.WaitForStatus(blocker.GetID(), TinyTask::Status::RUNNING), TinyTasksPool::Result::SUCCEEDED);
+        tinyTasksPool.ReleaseTask(blocker.GetID());
+    }
+    
+    tinyTasksPool.SetQueueCapacity(1, TinyTasksPool::OverflowPolicy::REJECT);
+    TinyTasksPool::TaskHandle queuedHandle = tinyTasksPool.TrySubmit([]{});
+    ASSERT_TRUE(queuedHandle.IsValid());
+    tinyTasksPool.ReleaseTask(queuedHandle.GetID());
+    ASSERT_FALSE(tinyTasksPool.TrySubmit([]{}).IsValid());
+    
+    //The tasks of the group, the graph and the future aren't rejected
+    std::atomic<uint32_t> numRuns(0);
+    TaskGroup group(tinyTasksPool);
+    group.Submit([&numRuns]{ numRuns++; });
+    
+    TaskGraph graph(tinyTasksPool);
+    const TaskGraph::NodeID firstNode = graph.AddNode([&numRuns]{ numRuns++; });
+    const TaskGraph::NodeID secondNode = graph.AddNode([&numRuns]{ numRuns++; });
+    graph.AddEdge(firstNode, secondNode);
+    ASSERT_EQ(graph.Run(), TaskGraph::Result::SUCCEEDED);
+    
+    Future<int> future = Async(tinyTasksPool, []{ return 42; });
+    
+    canComplete = true;
+    
+    group.Wait();
+    graph.Wait();
+    ASSERT_EQ(future.Get(), 42);
+    ASSERT_EQ(numRuns.load(), 3u);
+    ASSERT_EQ(tinyTasksPool.GetMetrics().numRejectedRuns, 1u);
+    
+    tinyTasksPool.WaitAll();
+}
+
+TEST(TinyTasksTest, TestWriteFilesWithAsyncFileWriter)
+{
+    //Small buffers, so the output goes through many of them, and the pool runs out
+    AsyncFileWriter writer(64, 4);
+    TinyTasksPool tinyTasksPool(4);
+    
+    const uint32_t numFiles = 8;
+    std::vector<std::string> paths;
+    for(uint32_t fileIndex = 0; fileIndex < numFiles; ++fileIndex)
+    {
+        paths.push_back("tinytasks_writer_test_" + std::to_string(fileIndex) + ".txt");
+    }
+    
+    for(uint32_t fileIndex = 0; fileIndex < numFiles; ++fileIndex)
+    {
+        const std::string path = paths[fileIndex];
+        tinyTasksPool.ReleaseTask(tinyTasksPool.Submit([&writer, path, fileIndex]
+        {
+            AsyncFileWriter::Stream stream = writer.Open(path);
+            
+            for(uint32_t value = 0; value < 1000; ++value)
+            {
+                char text[32];
+                const int length = snprintf(text, sizeof(text), "%u:%u ", fileIndex, value);
+                stream.Append(text, static_cast<size_t>(length));
+            }
+            
+            //Bigger than a buffer
+            stream.Append(std::string(200, 'x'));
+        }).GetID());
+    }
+    
+    tinyTasksPool.WaitAll();
+    writer.Flush();
+    
+    uint64_t numExpectedBytes = 0;
+    for(uint32_t fileIndex = 0; fileIndex < numFiles; ++fileIndex)
+    {
+        std::string expectedText;
+        for(uint32_t value = 0; value < 1000; ++value)
+        {
+            expectedText.append(std::to_string(fileIndex) + ":" + std::to_string(value) + " ");
+        }
+        expectedText.append(200, 'x');
+        numExpectedBytes += expectedText.size();
+        
+        std::ifstream file(paths[fileIndex], std::ios::binary);
+        std::stringstream text;
+        text << file.rdbuf();
+        ASSERT_EQ(text.str(), expectedText);
+        
+        std::remove(paths[fileIndex].c_str());
+    }
+    
+    AsyncFileWriter::Stats stats = writer.GetStats();
+    ASSERT_EQ(stats.numWrittenBytes, numExpectedBytes);
+    ASSERT_LE(stats.numWrites, stats.numWrittenBuffers);
+    ASSERT_EQ(stats.numQueuedBytes, 0u);
+    ASSERT_EQ(stats.numFailedFiles, 0u);
+    ASSERT_FALSE(writer.IsBackedUp());
+    
+    //Files that can't be opened fail without blocking the stream
+    AsyncFileWriter::Stream stream = writer.Open("tinytasks_missing_directory/file.txt");
+    stream.Append("text");
+    stream.Close();
+    writer.Flush();
+    ASSERT_TRUE(stream.HasFailed());
+    ASSERT_EQ(writer.GetStats().numFailedFiles, 1u);
+}
+
+#if TINYTASKS_ENABLE_COROUTINES
+CoTask<int> AddInPool(TinyTasksPool& tinyTasksPool, int a, int b)
+{
+    co_await tinyTasksPool.Schedule();
+    co_return a + b;
+}
+
+CoTask<std::thread::id> DelayInPool(TinyTasksPool& tinyTasksPool, std::chrono::milliseconds delay)
+{
+    co_await tinyTasksPool.Delay(delay);
+    co_return std::this_thread::get_id();
+}
+
+TEST(TinyTasksTest, TestAwaitCoroutinesInTinyTasksPool)
+{
+    TinyTasksPool tinyTasksPool(2);
+    
+    //Nested coroutines, futures and delays
+    auto sumCoroutine = [](TinyTasksPool& pool) -> CoTask<int>
+    {
+        const int sum = co_await AddInPool(pool, 1, 2);
+        const int product = co_await Async(pool, []{ return 10; });
+        
+        const auto startTime = std::chrono::steady_clock::now();
+        co_await DelayInPool(pool, std::chrono::milliseconds(20));
+        if(std::chrono::steady_clock::now() - startTime < std::chrono::milliseconds(20)) co_return -1;
+        
+        co_return sum * product;
+    };
+    
+    Future<int> result = Spawn(tinyTasksPool, sumCoroutine(tinyTasksPool));
+    ASSERT_EQ(result.Get(), 30);
+    
+    //Coroutines run on the workers
+    std::thread::id workerThreadID = Spawn(tinyTasksPool, DelayInPool(tinyTasksPool, std::chrono::milliseconds(1))).Get();
+    ASSERT_NE(workerThreadID, std::this_thread::get_id());
+    
+    //Many coroutines suspended at once don't hold the workers
+    std::atomic<uint32_t> numResumed(0);
+    auto delayedCoroutine = [](TinyTasksPool& pool, std::atomic<uint32_t>& numResumed) -> CoTask<void>
+    {
+        co_await pool.Delay(std::chrono::milliseconds(50));
+        numResumed++;
+    };
+    
+    std::vector<Future<void>> futures;
+    const auto startTime = std::chrono::steady_clock::now();
+    for(uint32_t index = 0; index < 2000; ++index)
+    {
+        futures.push_back(Spawn(tinyTasksPool, delayedCoroutine(tinyTasksPool, numResumed)));
+    }
+    
+    WhenAll(futures).Wait();
+    ASSERT_EQ(numResumed.load(), 2000u);
+    ASSERT_LT(std::chrono::steady_clock::now() - startTime, std::chrono::seconds(10));
+    
+    tinyTasksPool.WaitAll();
+}
+
+TEST(TinyTasksTest, TestScheduleCoroutinesAfterShutdown)
+{
+    TinyTasksPool tinyTasksPool(2);
+    ASSERT_EQ(tinyTasksPool.Shutdown(TinyTasksPool::ShutdownMode::DRAIN), TinyTasksPool::Result::SUCCEEDED);
+    
+    //The coroutine is resumed in the current thread instead
+    Future<int> result = Spawn(tinyTasksPool, AddInPool(tinyTasksPool, 1, 2));
+    ASSERT_EQ(result.Get(), 3);
+}
+
+TEST(TinyTasksTest, TestDelayCoroutinesAcrossShutdown)
+{
+    TinyTasksPool tinyTasksPool(2);
+    
+    //The delay is cut short by the shutdown, which resumes the coroutine
+    Future<std::thread::id> result = Spawn(tinyTasksPool, DelayInPool(tinyTasksPool, std::chrono::milliseconds(60000)));
+    while(tinyTasksPool.GetNumTimers() == 0) { std::this_thread::sleep_for(std::chrono::milliseconds(1)); }
+    ASSERT_EQ(tinyTasksPool.Shutdown(TinyTasksPool::ShutdownMode::DRAIN), TinyTasksPool::Result::SUCCEEDED);
+    ASSERT_TRUE(result.IsReady());
+    ASSERT_EQ(result.Get(), std::this_thread::get_id());
+    
+    //Once it's shut down, the coroutine is resumed in the current thread
+    ASSERT_EQ(Spawn(tinyTasksPool, DelayInPool(tinyTasksPool, std::chrono::milliseconds(60000))).Get(), std::this_thread::get_id());
+    ASSERT_EQ(tinyTasksPool.GetNumTimers(), 0u);
+}
+
+TEST(TinyTasksTest, TestScheduleCoroutinesWithFullQueue)
+{
+    TinyTasksPool tinyTasksPool(2);
+    
+    //The tied tasks keep both workers busy, and the queue is full
+    std::atomic<bool> canComplete(false);
+    for(int blockerIndex = 0; blockerIndex < 2; ++blockerIndex)
+    {
+        TinyTasksPool::TaskHandle blocker = tinyTasksPool.Submit([&canComplete]
+        {
+            while(!canComplete) { std::this_thread::sleep_for(std::chrono::milliseconds(1)); }
+        });
+        ASSERT_EQ(tinyTasksPool.WaitForStatus(blocker.GetID(), TinyTask::Status::RUNNING), TinyTasksPool::Result::SUCCEEDED);
+        tinyTasksPool.ReleaseTask(blocker.GetID());
+    }
+    
+    tinyTasksPool.SetQueueCapacity(1, TinyTasksPool::OverflowPolicy::REJECT);
+    tinyTasksPool.ReleaseTask(tinyTasksPool.TrySubmit([]{}).GetID());
+    ASSERT_FALSE(tinyTasksPool.TrySubmit([]{}).IsValid());
+    
+    //Scheduling the coroutine isn't rejected
+    Future<int> result = Spawn(tinyTasksPool, AddInPool(tinyTasksPool, 1, 2));
+    
+    canComplete = true;
+    ASSERT_EQ(result.Get(), 3);
+    
+    tinyTasksPool.WaitAll();
+}
+#endif
+
+TEST(TinyTasksTest, TestRecordEventsInTaskTracer)
+{
+    TaskTracer& tracer = TaskTracer::Get();
+    tracer.Clear();
+    tracer.SetThreadName("Test \"main\" thread");
+    
+    tracer.Record(TaskTracer::RUN_START, 7);
+    tracer.Record(TaskTracer::PAUSE, 7);
+    tracer.Record(TaskTracer::RESUME, 7);
+    tracer.Record(TaskTracer::COMPLETE, 7);
+    
+    std::thread thread([&tracer]{ tracer.Record(TaskTracer::CREATED, 8); });
+    thread.join();
+    
+    std::vector<TaskTracer::EventRecord> records = tracer.GetRecords();
+    ASSERT_EQ(records.size(), 5u);
+    ASSERT_EQ(records[0].event, TaskTracer::RUN_START);
+    ASSERT_EQ(records[0].taskID, 7u);
+    ASSERT_LE(records[0].time, records[3].time);
+    ASSERT_EQ(records[4].taskID, 8u);
+    ASSERT_NE(records[4].threadIndex, records[0].threadIndex);
+    
+    std::ostringstream trace;
+    tracer.WriteChromeTrace(trace);
+    ASSERT_NE(trace.str().find("{\"traceEvents\":["), std::string::npos);
+    ASSERT_NE(trace.str().find("\"name\":\"Test \\\"main\\\" thread\""), std::string::npos);
+    ASSERT_NE(trace.str().find("\"name\":\"Task\",\"cat\":\"tinytasks\",\"ph\":\"B\""), std::string::npos);
+    ASSERT_NE(trace.str().find("\"name\":\"Paused\",\"cat\":\"tinytasks\",\"ph\":\"B\""), std::string::npos);
+    
+    //Once full, the oldest events are overwritten
+    tracer.Clear();
+    for(uint32_t eventIndex = 0; eventIndex < TINYTASKS_TRACE_BUFFER_CAPACITY + 10; ++eventIndex)
+    {
+        tracer.Record(TaskTracer::SCHEDULED, eventIndex);
+    }
+    
+    records = tracer.GetRecords();
+    ASSERT_EQ(records.size(), static_cast<size_t>(TINYTASKS_TRACE_BUFFER_CAPACITY));
+    ASSERT_EQ(records.front().taskID, 10u);
+    tracer.Clear();
+}
+
+#if TINYTASKS_ENABLE_TRACING
+TEST(TinyTasksTest, TestTraceTasksInTinyTasksPool)
+{
+    TaskTracer& tracer = TaskTracer::Get();
+    tracer.Clear();
+    
+    {
+        TinyTasksPool tinyTasksPool(2);
+        
+        const TaskID taskID = tinyTasksPool.CreateTask();
+        TinyTask* task = tinyTasksPool.GetTask(taskID);
+        std::atomic<bool> canComplete(false);
+        tinyTasksPool.SetNewLambdaForTask(taskID, [task, &canComplete]
+        {
+            while(!canComplete)
+            {
+                task->PauseIfNeeded();
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        });
+        
+        ASSERT_EQ(tinyTasksPool.WaitForStatus(taskID, TinyTask::Status::RUNNING), TinyTasksPool::Result::SUCCEEDED);
+        task->Pause();
+        
+        //Resumed once the task is blocked
+        auto isTaskPaused = [&tracer]
+        {
+            const std::vector<TaskTracer::EventRecord> records = tracer.GetRecords();
+            return std::any_of(records.begin(), records.end(), [](const TaskTracer::EventRecord& record)
+            {
+                return record.event == TaskTracer::PAUSE;
+            });
+        };
+        while(!isTaskPaused()) { std::this_thread::sleep_for(std::chrono::milliseconds(1)); }
+        
+        canComplete = true;
+        task->Resume();
+        tinyTasksPool.Wait(taskID);
+    }
+    
+    uint32_t numEvents[TaskTracer::NUM_EVENTS] = {};
+    for(const TaskTracer::EventRecord& record : tracer.GetRecords()) numEvents[record.event]++;
+    
+    ASSERT_EQ(numEvents[TaskTracer::CREATED], 1u);
+    ASSERT_EQ(numEvents[TaskTracer::SCHEDULED], 1u);
+    ASSERT_EQ(numEvents[TaskTracer::DEQUEUED], 1u);
+    ASSERT_EQ(numEvents[TaskTracer::RUN_START], 1u);
+    ASSERT_EQ(numEvents[TaskTracer::COMPLETE], 1u);
+    ASSERT_EQ(numEvents[TaskTracer::PAUSE], numEvents[TaskTracer::RESUME]);
+    ASSERT_GE(numEvents[TaskTracer::PAUSE], 1u);
+    
+    std::ostringstream trace;
+    tracer.WriteChromeTrace(trace);
+    ASSERT_NE(trace.str().find("\"name\":\"Worker 0\""), std::string::npos);
+    tracer.Clear();
+}
+#endif